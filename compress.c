@@ -0,0 +1,110 @@
+#include <memory.h>
+
+#include "compress.h"
+
+static uint32_t hash(uint8_t const *p) {
+    uint32_t v = (uint32_t) p[0] << 16 | (uint32_t) p[1] << 8 | p[2];
+    return (v * 2654435761u) >> (32 - COMPRESS_HASH_BITS);
+}
+
+// Returns the compressed length, 0 when the result does not fit in capacity
+uint32_t compress_block(uint8_t const *src, uint32_t len, uint8_t *dst, uint32_t capacity) {
+    uint16_t table[1 << COMPRESS_HASH_BITS];
+    uint32_t in = 0;
+    uint32_t out = 0;
+    uint32_t flags_at = 0;
+    uint32_t item = 8;
+
+    // Positions are stored plus one, zero is an empty slot
+    memset(table, 0, sizeof(table));
+
+    while (in < len) {
+        if (item == 8) {
+            if (out >= capacity)
+                return 0;
+
+            flags_at = out;
+            dst[out++] = 0;
+            item = 0;
+        }
+
+        uint32_t match_len = 0;
+        uint32_t distance = 0;
+
+        if (len - in >= COMPRESS_MIN_MATCH) {
+            uint32_t h = hash(&src[in]);
+            uint32_t candidate = table[h];
+            table[h] = (uint16_t) (in + 1);
+
+            if (candidate > 0 && in - (candidate - 1) <= COMPRESS_MAX_DISTANCE) {
+                uint32_t from = candidate - 1;
+                uint32_t limit = len - in < COMPRESS_MAX_MATCH ? len - in : COMPRESS_MAX_MATCH;
+
+                while (match_len < limit && src[from + match_len] == src[in + match_len])
+                    match_len++;
+
+                distance = in - from;
+            }
+        }
+
+        if (match_len >= COMPRESS_MIN_MATCH) {
+            if (out + 2 > capacity)
+                return 0;
+
+            dst[flags_at] |= 1 << item;
+            dst[out++] = (uint8_t) ((distance - 1) >> 4);
+            dst[out++] = (uint8_t) ((distance - 1) << 4 | (match_len - COMPRESS_MIN_MATCH));
+
+            // Index the positions covered by the match, later data may refer to them
+            for (uint32_t i = 1; i < match_len && in + i + COMPRESS_MIN_MATCH <= len; ++i)
+                table[hash(&src[in + i])] = (uint16_t) (in + i + 1);
+
+            in += match_len;
+        } else {
+            if (out >= capacity)
+                return 0;
+
+            dst[out++] = src[in++];
+        }
+
+        item++;
+    }
+
+    return out;
+}
+
+// Returns the decompressed length, 0 for a corrupt block or one exceeding capacity
+uint32_t decompress_block(uint8_t const *src, uint32_t len, uint8_t *dst, uint32_t capacity) {
+    uint32_t in = 0;
+    uint32_t out = 0;
+
+    while (in < len) {
+        uint8_t flags = src[in++];
+
+        for (uint32_t item = 0; item < 8 && in < len; ++item) {
+            if (!(flags & (1 << item))) {
+                if (out >= capacity)
+                    return 0;
+
+                dst[out++] = src[in++];
+                continue;
+            }
+
+            if (in + 2 > len)
+                return 0;
+
+            uint32_t distance = ((uint32_t) src[in] << 4 | src[in + 1] >> 4) + 1;
+            uint32_t match_len = (src[in + 1] & 0x0F) + COMPRESS_MIN_MATCH;
+            in += 2;
+
+            if (distance > out || out + match_len > capacity)
+                return 0;
+
+            // Byte by byte, a match may overlap the data it produces
+            for (uint32_t i = 0; i < match_len; ++i, ++out)
+                dst[out] = dst[out - distance];
+        }
+    }
+
+    return out;
+}
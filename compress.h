@@ -0,0 +1,20 @@
+#ifndef _LORA_BRIDGE_COMPRESS_H_
+#define _LORA_BRIDGE_COMPRESS_H_
+
+#include <stdint.h>
+
+// LZSS block codec for datagrams. Items come in groups of eight behind a flag
+// byte, bit n set for a match: two bytes holding a 12-bit distance and a 4-bit
+// length. Clear bits are literal bytes. Each block stands alone, so a lost
+// packet never breaks the next one.
+
+#define COMPRESS_MIN_MATCH      3
+#define COMPRESS_MAX_MATCH      (COMPRESS_MIN_MATCH + 15)
+#define COMPRESS_MAX_DISTANCE   4096
+#define COMPRESS_HASH_BITS      8       ///< 256 entry table, 512 bytes of stack
+
+uint32_t compress_block(uint8_t const *src, uint32_t len, uint8_t *dst, uint32_t capacity);
+
+uint32_t decompress_block(uint8_t const *src, uint32_t len, uint8_t *dst, uint32_t capacity);
+
+#endif //_LORA_BRIDGE_COMPRESS_H_
@@ -0,0 +1,102 @@
+#ifndef _LORA_BRIDGE_HAL_H_
+#define _LORA_BRIDGE_HAL_H_
+
+// Thin hardware layer under radio_inst_t. The firmware implements it with the
+// Pico SDK in hal_pico.c, the host build with the E220 simulator in sim/.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef LORA_BRIDGE_HOST
+
+#include <hardware/uart.h>
+#include <hardware/sync.h>
+
+#define hal_barrier() __dmb()
+
+#else
+
+typedef unsigned int uint;
+
+/// Simulated UART instance, uart0 and uart1 are provided by the simulator
+typedef struct {
+    uint index;
+} uart_inst_t;
+
+extern uart_inst_t sim_uart_inst[];
+
+#define uart0 (&sim_uart_inst[0])
+#define uart1 (&sim_uart_inst[1])
+#define NUM_UARTS 2
+
+#define hal_barrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
+
+#define HAL_GPIO_EDGE_FALL  0x4u
+#define HAL_GPIO_EDGE_RISE  0x8u
+
+typedef enum {
+    HAL_PARITY_NONE = 0,
+    HAL_PARITY_EVEN,
+    HAL_PARITY_ODD,
+} hal_parity_t;
+
+typedef int32_t hal_alarm_t;
+
+/// Invoked from interrupt context, return 0 not to reschedule
+typedef int64_t (*hal_alarm_cb_t)(hal_alarm_t id, void *user_data);
+
+/// Invoked from interrupt context with HAL_GPIO_EDGE_* flags
+typedef void (*hal_gpio_cb_t)(uint pin, uint32_t events);
+
+// UART
+
+uint hal_uart_index(uart_inst_t *uart);
+
+void hal_uart_init_pins(uart_inst_t *uart, uint tx_pin, uint rx_pin);
+
+void hal_uart_configure(uart_inst_t *uart, uint baud, hal_parity_t parity);
+
+// GPIO
+
+void hal_gpio_init(uint pin, bool output);
+
+void hal_gpio_put(uint pin, bool value);
+
+bool hal_gpio_get(uint pin);
+
+void hal_gpio_set_callback(uint pin, hal_gpio_cb_t callback);
+
+// Time
+
+uint64_t hal_time_us(void);
+
+hal_alarm_t hal_alarm_in_us(uint64_t us, hal_alarm_cb_t callback, void *user_data);
+
+void hal_alarm_cancel(hal_alarm_t id);
+
+void hal_idle(void);
+
+// Cores, messages travel from one core to the other
+
+void hal_core_launch(void (*entry)(void));
+
+void hal_core_push(uint32_t msg);
+
+bool hal_core_pop(uint32_t *msg);
+
+// Flash, one sector kept for the bridge settings. Writes come from core0 and
+// hold core1 in RAM while the sector is erased, core1 lets them in by calling
+// hal_flash_park() from its loop. Erased bytes read as 0xFF. Only the UART
+// receive interrupts of core1 run while it is parked.
+
+#define HAL_FLASH_STORE_SIZE    256
+
+void hal_flash_read(void *data, uint32_t len);
+
+bool hal_flash_write(void const *data, uint32_t len);
+
+void hal_flash_park(void);
+
+#endif //_LORA_BRIDGE_HAL_H_
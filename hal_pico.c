@@ -0,0 +1,193 @@
+#include <memory.h>
+
+#include <hardware/flash.h>
+#include <hardware/gpio.h>
+#include <hardware/irq.h>
+#include <hardware/regs/m0plus.h>
+#include <pico/multicore.h>
+#include <pico/time.h>
+
+#include "hal.h"
+
+// Last sector of the flash, away from the program
+#define FLASH_STORE_OFFSET      (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define FLASH_PARK_TIMEOUT_US   (10 * 1000)
+
+// Left on while core1 is parked, their handlers run from RAM (see uart_rx.c)
+#define FLASH_PARK_IRQS         ((1u << UART0_IRQ) | (1u << UART1_IRQ))
+
+#define NVIC_ISER   (*(io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ISER_OFFSET))
+#define NVIC_ICER   (*(io_rw_32 *) (PPB_BASE + M0PLUS_NVIC_ICER_OFFSET))
+
+// Every write is a new request, core1 parks for one request at a time and
+// stays until that request is released. A stale answer never matches.
+static volatile uint32_t flash_request;     ///< Core0, the latest write
+static volatile uint32_t flash_parked;      ///< Core1, the request it is parked for
+static volatile uint32_t flash_released;    ///< Core0, the latest write done with
+
+static hal_gpio_cb_t gpio_callbacks[NUM_BANK0_GPIOS];
+
+//--------------------------------------------------------------------+
+// UART
+//--------------------------------------------------------------------+
+
+uint hal_uart_index(uart_inst_t *uart) {
+    return uart_get_index(uart);
+}
+
+void hal_uart_init_pins(uart_inst_t *uart, uint tx_pin, uint rx_pin) {
+    gpio_set_function(tx_pin, GPIO_FUNC_UART);
+    gpio_set_function(rx_pin, GPIO_FUNC_UART);
+    uart_set_hw_flow(uart, false, false);
+}
+
+void hal_uart_configure(uart_inst_t *uart, uint baud, hal_parity_t parity) {
+    uart_init(uart, baud);
+
+    switch (parity) {
+        case HAL_PARITY_EVEN:
+            uart_set_format(uart, 8, 1, UART_PARITY_EVEN);
+            break;
+
+        case HAL_PARITY_ODD:
+            uart_set_format(uart, 8, 1, UART_PARITY_ODD);
+            break;
+
+        default:
+            uart_set_format(uart, 8, 1, UART_PARITY_NONE);
+            break;
+    }
+}
+
+//--------------------------------------------------------------------+
+// GPIO
+//--------------------------------------------------------------------+
+
+void hal_gpio_init(uint pin, bool output) {
+    gpio_init(pin);
+    gpio_set_dir(pin, output ? GPIO_OUT : GPIO_IN);
+}
+
+void hal_gpio_put(uint pin, bool value) {
+    gpio_put(pin, value);
+}
+
+bool hal_gpio_get(uint pin) {
+    return gpio_get(pin);
+}
+
+// The SDK takes a single callback per core, dispatch by pin
+static void gpio_irq(uint pin, uint32_t events) {
+    if (gpio_callbacks[pin])
+        gpio_callbacks[pin](pin, events & (HAL_GPIO_EDGE_FALL | HAL_GPIO_EDGE_RISE));
+}
+
+void hal_gpio_set_callback(uint pin, hal_gpio_cb_t callback) {
+    gpio_callbacks[pin] = callback;
+    gpio_set_irq_enabled_with_callback(pin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, callback != NULL,
+                                       gpio_irq);
+}
+
+//--------------------------------------------------------------------+
+// Time
+//--------------------------------------------------------------------+
+
+uint64_t hal_time_us(void) {
+    return time_us_64();
+}
+
+hal_alarm_t hal_alarm_in_us(uint64_t us, hal_alarm_cb_t callback, void *user_data) {
+    return add_alarm_in_us(us, callback, user_data, true);
+}
+
+void hal_alarm_cancel(hal_alarm_t id) {
+    cancel_alarm(id);
+}
+
+void hal_idle(void) {
+    tight_loop_contents();
+}
+
+//--------------------------------------------------------------------+
+// Cores
+//--------------------------------------------------------------------+
+
+void hal_core_launch(void (*entry)(void)) {
+    multicore_launch_core1(entry);
+}
+
+void hal_core_push(uint32_t msg) {
+    // Make the shared data the message refers to visible first
+    __dmb();
+    multicore_fifo_push_blocking(msg);
+}
+
+bool hal_core_pop(uint32_t *msg) {
+    if (!multicore_fifo_rvalid())
+        return false;
+
+    *msg = multicore_fifo_pop_blocking();
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Flash
+//--------------------------------------------------------------------+
+
+void hal_flash_read(void *data, uint32_t len) {
+    memcpy(data, (void const *) (XIP_BASE + FLASH_STORE_OFFSET), len);
+}
+
+// XIP is off during the erase, core1 must not fetch from flash meanwhile. Only
+// the UART receive interrupts stay on, so the hardware FIFOs do not overrun
+// during an erase of up to 400 ms. Anything else core1 handles waits.
+void __not_in_flash_func(hal_flash_park)(void) {
+    uint32_t request = flash_request;
+    if (request == flash_released)
+        return;
+
+    uint32_t status = save_and_disable_interrupts();
+    uint32_t enabled = NVIC_ISER;
+    NVIC_ICER = enabled & ~FLASH_PARK_IRQS;
+    restore_interrupts(status);
+
+    __dmb();
+    flash_parked = request;
+
+    while (flash_released != request)
+        tight_loop_contents();
+
+    NVIC_ISER = enabled;
+}
+
+// Fails when core1 does not park in time, the caller tries again later. The
+// data is copied once core1 is parked, it may belong to core1.
+bool hal_flash_write(void const *data, uint32_t len) {
+    static uint8_t page[FLASH_PAGE_SIZE];
+    if (len > sizeof(page))
+        return false;
+
+    uint32_t request = flash_request + 1;
+    uint64_t start = time_us_64();
+    flash_request = request;
+
+    while (flash_parked != request) {
+        if (time_us_64() - start > FLASH_PARK_TIMEOUT_US) {
+            flash_released = request;
+            return false;
+        }
+    }
+
+    __dmb();
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, data, len);
+
+    uint32_t status = save_and_disable_interrupts();
+    flash_range_erase(FLASH_STORE_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(FLASH_STORE_OFFSET, page, FLASH_PAGE_SIZE);
+    restore_interrupts(status);
+
+    __dmb();
+    flash_released = request;
+    return true;
+}
@@ -0,0 +1,342 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bridge.h"
+
+namespace lora_bridge {
+
+#define BRIDGE_TTY_READ_SIZE  4096
+
+static std::system_error os_error(char const *what) {
+    return std::system_error(errno, std::generic_category(), what);
+}
+
+bridge::bridge(event_loop &loop, device_info info) : loop(loop), device(std::move(info)) {
+    hid_fd = open(device.hidraw.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (hid_fd < 0)
+        throw os_error(device.hidraw.c_str());
+
+    loop.add(hid_fd, EPOLLIN, [this](uint32_t events) { hid_event(events); });
+}
+
+bridge::~bridge() {
+    for (auto const &entry : in_flight)
+        loop.cancel(entry.second.timeout);
+
+    if (holding)
+        loop.cancel(hold_timer);
+
+    if (hid_fd >= 0) {
+        loop.remove(hid_fd);
+        close(hid_fd);
+    }
+
+    for (auto &tty : ttys) {
+        if (tty.fd >= 0) {
+            loop.remove(tty.fd);
+            close(tty.fd);
+        }
+    }
+}
+
+//--------------------------------------------------------------------+
+// Commands
+//--------------------------------------------------------------------+
+
+// Fails at once when the bridge is gone
+void bridge::command(uint32_t module, report_t request, command_cb_t callback) {
+    if (hid_fd < 0) {
+        callback(false, report_t{});
+        return;
+    }
+
+    request[USB_COMMAND_MODULE_INDEX] = module;
+    waiting.push_back({request, std::move(callback)});
+    start_commands();
+}
+
+void bridge::read_params(uint32_t module, bool refresh, params_cb_t callback) {
+    report_t request{};
+    request[0] = USB_COMMAND_READ_PARAMS;
+    request[1] = refresh ? USB_COMMAND_READ_REFRESH : USB_COMMAND_READ_CACHED;
+
+    command(module, request, [callback](bool ok, report_t const &response) {
+        parameters_t params{};
+        ok = ok && response[1] == USB_COMMAND_SUCCESS;
+        if (ok)
+            memcpy(&params, &response[2], sizeof(params));
+
+        callback(ok, params);
+    });
+}
+
+void bridge::write_params(uint32_t module, parameters_t const &params, bool save, params_cb_t callback) {
+    report_t request{};
+    request[0] = USB_COMMAND_WRITE_PARAMS;
+    request[1] = save ? 0x01 : 0x00;
+    memcpy(&request[2], &params, sizeof(params));
+
+    command(module, request, [callback](bool ok, report_t const &response) {
+        parameters_t written{};
+        ok = ok && response[1] == USB_COMMAND_SUCCESS;
+        if (ok)
+            memcpy(&written, &response[2], sizeof(written));
+
+        callback(ok, written);
+    });
+}
+
+// Sequence numbers tell the completions apart, the bridge runs commands in
+// the order they arrive and echoes the number in both reports
+void bridge::start_commands() {
+    while (!holding && !waiting.empty() && in_flight.size() < RADIO_CORE_COMMAND_SLOTS) {
+        while (in_flight.count(next_sequence))
+            next_sequence++;
+
+        uint8_t sequence = next_sequence++;
+        command_t &command = in_flight[sequence] = std::move(waiting.front());
+        waiting.pop_front();
+
+        command.request[USB_COMMAND_SEQUENCE_INDEX] = sequence;
+        command.timeout = loop.call_in(command_timeout, [this, sequence] { complete(sequence, false, report_t{}); });
+
+        if (!write_report(command.request))
+            complete(sequence, false, report_t{});
+    }
+}
+
+// hidraw takes the report number first, 0 for the unnumbered reports of the
+// bridge. The write returns once the report went out, within a frame or so.
+bool bridge::write_report(report_t const &request) {
+    uint8_t buffer[BRIDGE_REPORT_SIZE + 1] = {0};
+    memcpy(&buffer[1], request.data(), request.size());
+
+    ssize_t count;
+    do {
+        count = write(hid_fd, buffer, sizeof(buffer));
+    } while (count < 0 && errno == EINTR);
+
+    return count == sizeof(buffer);
+}
+
+void bridge::hid_event(uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        fail_all();
+        return;
+    }
+
+    while (hid_fd >= 0) {
+        report_t response{};
+        ssize_t count = read(hid_fd, response.data(), response.size());
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count < 0 && errno != EAGAIN) {
+            fail_all();
+            return;
+        }
+
+        if (count <= 0)
+            return;
+
+        report_received(response);
+    }
+}
+
+// Acknowledgements only tell the command was queued, the completion follows.
+// A command refused with BUSY, at once or by the radio, goes again.
+void bridge::report_received(report_t const &response) {
+    uint8_t sequence = response[USB_COMMAND_SEQUENCE_INDEX];
+    auto it = in_flight.find(sequence);
+
+    // Completion of a command that timed out
+    if (it == in_flight.end() || response[0] != it->second.request[0])
+        return;
+
+    if (response[1] == USB_COMMAND_QUEUED)
+        return;
+
+    if (response[1] == USB_COMMAND_BUSY && it->second.retries < BRIDGE_BUSY_RETRIES) {
+        retry(sequence);
+        return;
+    }
+
+    complete(sequence, true, response);
+}
+
+void bridge::complete(uint8_t sequence, bool ok, report_t const &response) {
+    auto it = in_flight.find(sequence);
+    if (it == in_flight.end())
+        return;
+
+    command_t command = std::move(it->second);
+    in_flight.erase(it);
+    loop.cancel(command.timeout);
+
+    command.callback(ok, response);
+    start_commands();
+}
+
+// Goes first once the bridge had time to make room, later commands wait with it
+void bridge::retry(uint8_t sequence) {
+    auto it = in_flight.find(sequence);
+    command_t command = std::move(it->second);
+    in_flight.erase(it);
+    loop.cancel(command.timeout);
+
+    command.retries++;
+    waiting.push_front(std::move(command));
+
+    if (holding)
+        return;
+
+    holding = true;
+    hold_timer = loop.call_in(std::chrono::milliseconds(BRIDGE_BUSY_DELAY_MS), [this] {
+        holding = false;
+        start_commands();
+    });
+}
+
+// Unplugged, everything pending fails
+void bridge::fail_all() {
+    if (hid_fd >= 0) {
+        loop.remove(hid_fd);
+        close(hid_fd);
+        hid_fd = -1;
+    }
+
+    while (!in_flight.empty())
+        complete(in_flight.begin()->first, false, report_t{});
+
+    std::deque<command_t> failed;
+    failed.swap(waiting);
+    for (auto &command : failed)
+        command.callback(false, report_t{});
+}
+
+//--------------------------------------------------------------------+
+// Data
+//--------------------------------------------------------------------+
+
+void bridge::open_tty(uint32_t module) {
+    if (module >= RADIO_CORE_MODULES || device.tty[module].empty())
+        throw std::runtime_error(device.serial + ": no CDC port for module " + std::to_string(module));
+
+    tty_t &tty = ttys[module];
+    if (tty.fd >= 0)
+        return;
+
+    char const *path = device.tty[module].c_str();
+    tty.fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (tty.fd < 0)
+        throw os_error(path);
+
+    // Bytes as they are, the baud rate is the one of the module and set over HID
+    termios settings{};
+    if (tcgetattr(tty.fd, &settings) == 0) {
+        cfmakeraw(&settings);
+        tcsetattr(tty.fd, TCSANOW, &settings);
+    }
+
+    loop.add(tty.fd, EPOLLIN, [this, module](uint32_t events) { tty_event(module, events); });
+}
+
+void bridge::send(uint32_t module, uint8_t const *data, size_t len) {
+    open_tty(module);
+
+    tty_t &tty = ttys[module];
+    tty.out.insert(tty.out.end(), data, data + len);
+    tty_flush(module);
+}
+
+void bridge::on_data(data_cb_t callback) {
+    data_callback = std::move(callback);
+}
+
+// The rest waits for room in the tty, the bridge holds off the host when its
+// queue to the radio is full
+void bridge::tty_flush(uint32_t module) {
+    tty_t &tty = ttys[module];
+
+    while (!tty.out.empty()) {
+        ssize_t count = write(tty.fd, tty.out.data(), tty.out.size());
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count < 0 && errno != EAGAIN) {
+            close_tty(module);
+            return;
+        }
+
+        if (count <= 0)
+            break;
+
+        tty.out.erase(tty.out.begin(), tty.out.begin() + count);
+    }
+
+    bool blocked = !tty.out.empty();
+    if (blocked != tty.blocked) {
+        tty.blocked = blocked;
+        loop.modify(tty.fd, blocked ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+}
+
+void bridge::tty_event(uint32_t module, uint32_t events) {
+    tty_t &tty = ttys[module];
+
+    if (events & EPOLLOUT)
+        tty_flush(module);
+
+    while (tty.fd >= 0 && (events & EPOLLIN)) {
+        uint8_t buffer[BRIDGE_TTY_READ_SIZE];
+        ssize_t count = read(tty.fd, buffer, sizeof(buffer));
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count < 0 && errno != EAGAIN) {
+            close_tty(module);
+            return;
+        }
+
+        if (count <= 0)
+            break;
+
+        if (data_callback)
+            data_callback(module, buffer, count);
+    }
+
+    if (tty.fd >= 0 && (events & (EPOLLERR | EPOLLHUP)))
+        close_tty(module);
+}
+
+// Unsent data is dropped
+void bridge::close_tty(uint32_t module) {
+    tty_t &tty = ttys[module];
+
+    loop.remove(tty.fd);
+    close(tty.fd);
+    tty.fd = -1;
+    tty.out.clear();
+    tty.blocked = false;
+}
+
+size_t bridge::pending() const {
+    size_t count = waiting.size() + in_flight.size();
+
+    for (auto const &tty : ttys)
+        count += tty.out.size();
+
+    return count;
+}
+
+}
@@ -0,0 +1,130 @@
+#ifndef _LORA_BRIDGE_HOST_BRIDGE_H_
+#define _LORA_BRIDGE_HOST_BRIDGE_H_
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "radio_core.h"
+#include "usb_command.h"
+}
+
+#include "event_loop.h"
+
+namespace lora_bridge {
+
+// Host side of the USB interfaces of a bridge, Linux only. Commands go through
+// hidraw and data through the tty of each CDC interface. Nothing blocks, open
+// any number of bridges on one event_loop and run it once for all of them.
+
+#define BRIDGE_REPORT_SIZE          (USB_COMMAND_SEQUENCE_INDEX + 1)
+#define BRIDGE_COMMAND_TIMEOUT_MS   3000
+#define BRIDGE_BUSY_RETRIES         20
+#define BRIDGE_BUSY_DELAY_MS        20
+
+/// Interfaces of one bridge found by find_bridges()
+struct device_info {
+    std::string serial;                         ///< Unique ID of the flash chip
+    std::string hidraw;                         ///< /dev/hidrawN
+    std::string tty[RADIO_CORE_MODULES];        ///< CDC port of each module, empty when not found
+};
+
+/// Bridges currently plugged in, sorted by serial
+std::vector<device_info> find_bridges();
+
+using report_t = std::array<uint8_t, BRIDGE_REPORT_SIZE>;
+
+class bridge {
+public:
+    /// ok is false when the bridge never completed the command, response then holds zeros
+    using command_cb_t = std::function<void(bool ok, report_t const &response)>;
+    using params_cb_t = std::function<void(bool ok, parameters_t const &params)>;
+    using data_cb_t = std::function<void(uint32_t module, uint8_t const *data, size_t len)>;
+
+    /// Opens the HID interface, throws std::system_error
+    bridge(event_loop &loop, device_info info);
+
+    ~bridge();
+
+    bridge(bridge const &) = delete;
+
+    bridge &operator=(bridge const &) = delete;
+
+    device_info const &info() const { return device; }
+
+    /// Runs a command report on a module. Up to RADIO_CORE_COMMAND_SLOTS are
+    /// in flight at once, the rest wait here. BUSY answers are retried.
+    void command(uint32_t module, report_t request, command_cb_t callback);
+
+    void read_params(uint32_t module, bool refresh, params_cb_t callback);
+
+    void write_params(uint32_t module, parameters_t const &params, bool save, params_cb_t callback);
+
+    /// Opens the tty of the module on first use, throws std::system_error
+    void send(uint32_t module, uint8_t const *data, size_t len);
+
+    /// Receives whatever the modules send, once their tty is open
+    void on_data(data_cb_t callback);
+
+    void open_tty(uint32_t module);
+
+    /// Commands not completed and data not written yet
+    size_t pending() const;
+
+    void set_timeout(std::chrono::milliseconds timeout) { command_timeout = timeout; }
+
+private:
+    struct command_t {
+        report_t request;
+        command_cb_t callback;
+        uint32_t retries = 0;
+        event_loop::timer_id_t timeout{};
+    };
+
+    struct tty_t {
+        int fd = -1;
+        std::vector<uint8_t> out;               ///< Not taken by the tty yet
+        bool blocked = false;                   ///< Waiting for EPOLLOUT
+    };
+
+    void start_commands();
+
+    bool write_report(report_t const &request);
+
+    void hid_event(uint32_t events);
+
+    void report_received(report_t const &response);
+
+    void complete(uint8_t sequence, bool ok, report_t const &response);
+
+    void retry(uint8_t sequence);
+
+    void tty_event(uint32_t module, uint32_t events);
+
+    void tty_flush(uint32_t module);
+
+    void close_tty(uint32_t module);
+
+    void fail_all();
+
+    event_loop &loop;
+    device_info device;
+    int hid_fd = -1;
+    uint8_t next_sequence = 0;
+    bool holding = false;                       ///< Commands wait after a BUSY
+    event_loop::timer_id_t hold_timer;
+    std::deque<command_t> waiting;
+    std::map<uint8_t, command_t> in_flight;     ///< By sequence number
+    tty_t ttys[RADIO_CORE_MODULES];
+    data_cb_t data_callback;
+    std::chrono::milliseconds command_timeout{BRIDGE_COMMAND_TIMEOUT_MS};
+};
+
+}
+
+#endif //_LORA_BRIDGE_HOST_BRIDGE_H_
@@ -0,0 +1,305 @@
+// Runs the host library against fake bridges on ptys, no hardware needed. The
+// fake stands in for the hidraw interface: it reads the report number and the
+// 64 byte request, and answers with 64 byte reports like the firmware does.
+//
+//   bridge_test [BRIDGES]
+//
+// Checks that commands to many bridges run side by side, that BUSY answers
+// are retried, that a command the bridge never completes times out, and that
+// completions find their command by sequence number whatever their order.
+// Exits with the number of failed checks.
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "bridge.h"
+
+using namespace lora_bridge;
+
+#define TEST_BRIDGES            50
+#define TEST_COMPLETION_MS      100     ///< The fake takes this long to run a command
+#define TEST_TIMEOUT_MS         200
+#define TEST_PAYLOAD_INDEX      2
+
+static int failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+/// One fake bridge, a thread of its own runs the handler for every request
+class fake_bridge {
+public:
+    using handler_t = std::function<void(fake_bridge &fake, report_t const &request)>;
+
+    explicit fake_bridge(handler_t handler) : handler(std::move(handler)) {
+        char name[64];
+        if (openpty(&master, &slave, name, nullptr, nullptr) < 0)
+            throw std::runtime_error("openpty");
+
+        // Reports are binary, no line discipline
+        termios settings{};
+        tcgetattr(slave, &settings);
+        cfmakeraw(&settings);
+        tcsetattr(slave, TCSANOW, &settings);
+
+        info.serial = name;
+        info.hidraw = name;
+        thread = std::thread([this] { serve(); });
+    }
+
+    // After the bridge, the master reads fail once no one has the slave open
+    ~fake_bridge() {
+        close(slave);
+        thread.join();
+        close(master);
+    }
+
+    /// Answers request with status, the payload byte tells responses apart
+    void reply(report_t const &request, uint8_t status, uint8_t payload = 0, size_t at = TEST_PAYLOAD_INDEX) {
+        report_t response{};
+        response[0] = request[0];
+        response[1] = status;
+        response[at] = payload;
+        response[USB_COMMAND_MODULE_INDEX] = request[USB_COMMAND_MODULE_INDEX];
+        response[USB_COMMAND_SEQUENCE_INDEX] = request[USB_COMMAND_SEQUENCE_INDEX];
+
+        if (write(master, response.data(), response.size()) != (ssize_t) response.size())
+            perror("fake bridge write");
+    }
+
+    device_info info;
+    std::atomic<uint32_t> requests{0};
+
+private:
+    // Ends once the slave side is closed
+    void serve() {
+        while (true) {
+            uint8_t buffer[BRIDGE_REPORT_SIZE + 1];
+            size_t got = 0;
+
+            while (got < sizeof(buffer)) {
+                ssize_t count = read(master, &buffer[got], sizeof(buffer) - got);
+                if (count <= 0)
+                    return;
+
+                got += count;
+            }
+
+            report_t request;
+            memcpy(request.data(), &buffer[1], request.size());
+            requests++;
+            handler(*this, request);
+        }
+    }
+
+    handler_t handler;
+    int master = -1;
+    int slave = -1;                 ///< Kept open, the bridge may open it after serve() started
+    std::thread thread;
+};
+
+static void sleep_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+static long long elapsed_ms(steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - start).count();
+}
+
+static void run_until_idle(event_loop &loop, std::vector<std::unique_ptr<bridge>> const &bridges) {
+    loop.run([&] {
+        for (auto const &b : bridges) {
+            if (b->pending())
+                return false;
+        }
+        return true;
+    });
+}
+
+// Queued at once, completed TEST_COMPLETION_MS later. Reads find channel 0x17,
+// writes answer with the channel written.
+static void run_slowly(fake_bridge &fake, report_t const &request) {
+    size_t chan = TEST_PAYLOAD_INDEX + offsetof(parameters_t, chan);
+
+    fake.reply(request, USB_COMMAND_QUEUED);
+    sleep_ms(TEST_COMPLETION_MS);
+    fake.reply(request, USB_COMMAND_SUCCESS, request[0] == USB_COMMAND_WRITE_PARAMS ? request[chan] : 0x17, chan);
+}
+
+// A read and a write on every bridge, each taking TEST_COMPLETION_MS. One
+// after the other that is two completions per bridge, side by side about two.
+static void test_concurrency(uint32_t count) {
+    std::vector<std::unique_ptr<fake_bridge>> fakes;
+    std::vector<std::unique_ptr<bridge>> bridges;
+    event_loop loop;
+    uint32_t done = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        fakes.push_back(std::make_unique<fake_bridge>(run_slowly));
+        bridges.push_back(std::make_unique<bridge>(loop, fakes.back()->info));
+    }
+
+    auto start = steady_clock::now();
+    for (auto &b : bridges) {
+        bridge *target = b.get();
+        target->read_params(0, false, [target, &done](bool ok, parameters_t params) {
+            CHECK(ok && params.chan == 0x17);
+            params.chan = 0x20;
+            target->write_params(0, params, false, [&done](bool ok, parameters_t const &written) {
+                CHECK(ok && written.chan == 0x20);
+                done++;
+            });
+        });
+    }
+
+    run_until_idle(loop, bridges);
+    long long ms = elapsed_ms(start);
+
+    printf("concurrency: %u of %u bridges in %lld ms, %d ms one after the other\n", done, count, ms,
+           2 * TEST_COMPLETION_MS * (int) count);
+    CHECK(done == count);
+    CHECK(ms < TEST_COMPLETION_MS * ((int) count + 2));
+}
+
+// BUSY twice, then the command goes through
+static void test_busy() {
+    uint32_t busy = 2;
+    fake_bridge fake([&busy](fake_bridge &fake, report_t const &request) {
+        if (busy > 0) {
+            busy--;
+            fake.reply(request, USB_COMMAND_BUSY);
+            return;
+        }
+
+        fake.reply(request, USB_COMMAND_QUEUED);
+        fake.reply(request, USB_COMMAND_SUCCESS, 0x42);
+    });
+
+    event_loop loop;
+    std::vector<std::unique_ptr<bridge>> bridges;
+    bridges.push_back(std::make_unique<bridge>(loop, fake.info));
+
+    bool ok = false;
+    report_t request{};
+    request[0] = USB_COMMAND_READ_UART_STATS;
+    bridges[0]->command(0, request, [&ok](bool success, report_t const &response) {
+        ok = success && response[1] == USB_COMMAND_SUCCESS && response[TEST_PAYLOAD_INDEX] == 0x42;
+    });
+
+    run_until_idle(loop, bridges);
+    printf("busy: %u requests, %s\n", fake.requests.load(), ok ? "completed" : "failed");
+    CHECK(ok);
+    CHECK(fake.requests == 3);
+}
+
+// Queued but never completed. The completion showing up late is ignored, the
+// next command still gets its own.
+static void test_timeout() {
+    fake_bridge fake([](fake_bridge &fake, report_t const &request) {
+        fake.reply(request, USB_COMMAND_QUEUED);
+        if (fake.requests == 1) {
+            sleep_ms(TEST_TIMEOUT_MS * 3 / 2);
+            fake.reply(request, USB_COMMAND_SUCCESS, 0x01);
+            return;
+        }
+
+        fake.reply(request, USB_COMMAND_SUCCESS, 0x02);
+    });
+
+    event_loop loop;
+    std::vector<std::unique_ptr<bridge>> bridges;
+    bridges.push_back(std::make_unique<bridge>(loop, fake.info));
+    bridges[0]->set_timeout(std::chrono::milliseconds(TEST_TIMEOUT_MS));
+
+    report_t request{};
+    request[0] = USB_COMMAND_READ_UART_STATS;
+
+    bool first_ok = true;
+    long long first_ms = 0;
+    auto start = steady_clock::now();
+    bridges[0]->command(0, request, [&](bool ok, report_t const &) {
+        first_ok = ok;
+        first_ms = elapsed_ms(start);
+    });
+    run_until_idle(loop, bridges);
+
+    // Past the late completion
+    sleep_ms(TEST_TIMEOUT_MS);
+
+    uint8_t second = 0;
+    bridges[0]->command(0, request, [&second](bool ok, report_t const &response) {
+        second = ok ? response[TEST_PAYLOAD_INDEX] : 0;
+    });
+    run_until_idle(loop, bridges);
+
+    printf("timeout: first %s after %lld ms, second got payload 0x%02X\n", first_ok ? "completed" : "timed out",
+           first_ms, second);
+    CHECK(!first_ok);
+    CHECK(first_ms >= TEST_TIMEOUT_MS);
+    CHECK(second == 0x02);
+}
+
+// All slots queued first, then completed last to first with a stray
+// completion for a sequence number nobody used
+static void test_sequence() {
+    std::vector<report_t> queued;
+    fake_bridge fake([&queued](fake_bridge &fake, report_t const &request) {
+        fake.reply(request, USB_COMMAND_QUEUED);
+        queued.push_back(request);
+        if (queued.size() < RADIO_CORE_COMMAND_SLOTS)
+            return;
+
+        report_t stray = request;
+        stray[USB_COMMAND_SEQUENCE_INDEX] ^= 0x80;
+        fake.reply(stray, USB_COMMAND_SUCCESS, 0xEE);
+
+        for (auto it = queued.rbegin(); it != queued.rend(); ++it)
+            fake.reply(*it, USB_COMMAND_SUCCESS, (*it)[1]);
+    });
+
+    event_loop loop;
+    std::vector<std::unique_ptr<bridge>> bridges;
+    bridges.push_back(std::make_unique<bridge>(loop, fake.info));
+
+    uint32_t matched = 0;
+    for (uint8_t i = 0; i < RADIO_CORE_COMMAND_SLOTS; ++i) {
+        report_t request{};
+        request[0] = USB_COMMAND_READ_UART_STATS;
+        request[1] = 0x10 + i;
+        bridges[0]->command(0, request, [&matched, i](bool ok, report_t const &response) {
+            if (ok && response[TEST_PAYLOAD_INDEX] == 0x10 + i)
+                matched++;
+        });
+    }
+
+    run_until_idle(loop, bridges);
+    printf("sequence: %u of %u completions matched\n", matched, RADIO_CORE_COMMAND_SLOTS);
+    CHECK(matched == RADIO_CORE_COMMAND_SLOTS);
+}
+
+int main(int argc, char **argv) {
+    uint32_t count = argc > 1 ? (uint32_t) strtoul(argv[1], nullptr, 0) : TEST_BRIDGES;
+
+    test_concurrency(count);
+    test_busy();
+    test_timeout();
+    test_sequence();
+
+    printf("%s\n", failures ? "FAILED" : "passed");
+    return failures;
+}
@@ -0,0 +1,104 @@
+#include <cerrno>
+#include <system_error>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+
+namespace lora_bridge {
+
+#define EVENT_LOOP_MAX_EVENTS  64
+
+event_loop::event_loop() : epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+    if (epoll_fd < 0)
+        throw std::system_error(errno, std::generic_category(), "epoll_create1");
+}
+
+event_loop::~event_loop() {
+    close(epoll_fd);
+}
+
+void event_loop::add(int fd, uint32_t events, io_handler_t handler) {
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+
+    handlers[fd] = std::move(handler);
+}
+
+void event_loop::modify(int fd, uint32_t events) {
+    epoll_event event = {};
+    event.events = events;
+    event.data.fd = fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+}
+
+void event_loop::remove(int fd) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+    handlers.erase(fd);
+}
+
+event_loop::timer_id_t event_loop::call_at(steady_clock::time_point when, timer_handler_t handler) {
+    timer_id_t id(when, next_timer++);
+    timers.emplace(id, std::move(handler));
+    return id;
+}
+
+event_loop::timer_id_t event_loop::call_in(std::chrono::milliseconds delay, timer_handler_t handler) {
+    return call_at(steady_clock::now() + delay, std::move(handler));
+}
+
+void event_loop::cancel(timer_id_t id) {
+    timers.erase(id);
+}
+
+// Handlers may add and cancel timers, each due one is taken out before it runs
+void event_loop::run_timers() {
+    auto now = steady_clock::now();
+
+    while (!timers.empty() && timers.begin()->first.first <= now) {
+        timer_handler_t handler = std::move(timers.begin()->second);
+        timers.erase(timers.begin());
+        handler();
+    }
+}
+
+void event_loop::run(std::function<bool()> const &done) {
+    epoll_event events[EVENT_LOOP_MAX_EVENTS];
+
+    while (!done()) {
+        if (handlers.empty() && timers.empty())
+            return;
+
+        int timeout_ms = -1;
+        if (!timers.empty()) {
+            auto wait = timers.begin()->first.first - steady_clock::now();
+            auto wait_ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+            timeout_ms = wait_ms < 0 ? 0 : static_cast<int>(wait_ms);
+        }
+
+        int count = epoll_wait(epoll_fd, events, EVENT_LOOP_MAX_EVENTS, timeout_ms);
+        if (count < 0 && errno != EINTR)
+            throw std::system_error(errno, std::generic_category(), "epoll_wait");
+
+        for (int i = 0; i < count; ++i) {
+            // A handler run before may have removed this descriptor
+            auto it = handlers.find(events[i].data.fd);
+            if (it == handlers.end())
+                continue;
+
+            io_handler_t handler = it->second;
+            handler(events[i].events);
+        }
+
+        run_timers();
+    }
+}
+
+}
@@ -0,0 +1,60 @@
+#ifndef _LORA_BRIDGE_HOST_EVENT_LOOP_H_
+#define _LORA_BRIDGE_HOST_EVENT_LOOP_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+namespace lora_bridge {
+
+using steady_clock = std::chrono::steady_clock;
+
+// Single threaded epoll loop. Every bridge registers its file descriptors with
+// the same loop, so a command waiting on one radio never holds up the others:
+// the time for a rack of bridges is that of the slowest one, not the sum.
+class event_loop {
+public:
+    using io_handler_t = std::function<void(uint32_t events)>;
+    using timer_handler_t = std::function<void()>;
+    using timer_id_t = std::pair<steady_clock::time_point, uint64_t>;
+
+    event_loop();
+
+    ~event_loop();
+
+    event_loop(event_loop const &) = delete;
+
+    event_loop &operator=(event_loop const &) = delete;
+
+    /// EPOLL* flags, the handler may remove its own descriptor
+    void add(int fd, uint32_t events, io_handler_t handler);
+
+    void modify(int fd, uint32_t events);
+
+    void remove(int fd);
+
+    timer_id_t call_at(steady_clock::time_point when, timer_handler_t handler);
+
+    timer_id_t call_in(std::chrono::milliseconds delay, timer_handler_t handler);
+
+    /// Cancelling a timer that already ran does nothing
+    void cancel(timer_id_t id);
+
+    /// Dispatches events and timers until done() returns true, or until
+    /// nothing is left that could change its answer
+    void run(std::function<bool()> const &done);
+
+private:
+    void run_timers();
+
+    int epoll_fd;
+    uint64_t next_timer = 0;
+    std::unordered_map<int, io_handler_t> handlers;
+    std::map<timer_id_t, timer_handler_t> timers;
+};
+
+}
+
+#endif //_LORA_BRIDGE_HOST_EVENT_LOOP_H_
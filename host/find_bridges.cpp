@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+#include "bridge.h"
+
+extern "C" {
+#include "usb_descriptors.h"
+}
+
+namespace lora_bridge {
+
+namespace fs = std::filesystem;
+
+/// Interface number of the CDC interface of each module
+static unsigned const cdc_interfaces[RADIO_CORE_MODULES] = {USBD_ITF_CDC_0, USBD_ITF_CDC_1};
+
+static std::string read_attribute(fs::path const &path) {
+    std::ifstream file(path);
+    std::string value;
+    std::getline(file, value);
+    return value;
+}
+
+// IDs and interface numbers are hex in sysfs
+static unsigned long read_hex(fs::path const &path) {
+    try {
+        return std::stoul(read_attribute(path), nullptr, 16);
+    } catch (std::exception const &) {
+        return ~0ul;
+    }
+}
+
+// The USB device behind a class device, through the interface it belongs to
+static bool usb_interface(fs::path const &class_device, fs::path *interface) {
+    std::error_code error;
+    fs::path path = fs::canonical(class_device / "device", error);
+
+    // hidraw sits one level further down, under the HID device of the interface
+    if (!error && !fs::exists(path / "bInterfaceNumber"))
+        path = path.parent_path();
+
+    if (error || !fs::exists(path / "bInterfaceNumber"))
+        return false;
+
+    fs::path device = path.parent_path();
+    if (read_hex(device / "idVendor") != USBD_VID || read_hex(device / "idProduct") != USBD_PID)
+        return false;
+
+    *interface = path;
+    return true;
+}
+
+static std::vector<fs::path> class_devices(char const *class_path) {
+    std::vector<fs::path> devices;
+    std::error_code error;
+
+    for (auto const &entry : fs::directory_iterator(class_path, error))
+        devices.push_back(entry.path());
+
+    return devices;
+}
+
+// Other boards on the Pico SDK share the IDs, a bridge is the one with a HID interface
+std::vector<device_info> find_bridges() {
+    std::map<fs::path, device_info> devices;
+
+    for (auto const &path : class_devices("/sys/class/hidraw")) {
+        fs::path interface;
+        if (usb_interface(path, &interface))
+            devices[interface.parent_path()].hidraw = "/dev/" + path.filename().string();
+    }
+
+    for (auto const &path : class_devices("/sys/class/tty")) {
+        fs::path interface;
+        if (!usb_interface(path, &interface))
+            continue;
+
+        unsigned long number = read_hex(interface / "bInterfaceNumber");
+        for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+            if (number == cdc_interfaces[module])
+                devices[interface.parent_path()].tty[module] = "/dev/" + path.filename().string();
+        }
+    }
+
+    std::vector<device_info> bridges;
+    for (auto &entry : devices) {
+        if (entry.second.hidraw.empty())
+            continue;
+
+        entry.second.serial = read_attribute(entry.first / "serial");
+        bridges.push_back(std::move(entry.second));
+    }
+
+    std::sort(bridges.begin(), bridges.end(), [](device_info const &a, device_info const &b) {
+        return a.serial < b.serial;
+    });
+
+    return bridges;
+}
+
+}
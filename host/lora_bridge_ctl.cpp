@@ -0,0 +1,269 @@
+// Reads and writes the parameters of many bridges at once, and sends data to
+// them. Every bridge found is used unless --serial picks some of them.
+//
+//   lora_bridge_ctl list
+//   lora_bridge_ctl read [--refresh]
+//   lora_bridge_ctl write [--save] chan=0x12 opt1=0x03 ...
+//   lora_bridge_ctl send [--wait MS] TEXT
+//
+// Commands to all bridges are started together and run on one event loop,
+// the run takes about as long as the slowest bridge.
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <getopt.h>
+#include <memory>
+#include <set>
+#include <string>
+
+#include "bridge.h"
+
+using namespace lora_bridge;
+
+#define CTL_DEFAULT_WAIT_MS  1000
+
+struct options_t {
+    std::set<std::string> serials;
+    uint32_t module = 0;
+    bool refresh = false;
+    bool save = false;
+    int wait_ms = CTL_DEFAULT_WAIT_MS;
+    int timeout_ms = BRIDGE_COMMAND_TIMEOUT_MS;
+};
+
+/// One field of parameters_t set by write
+struct field_t {
+    size_t offset;
+    uint8_t value;
+};
+
+static void usage(FILE *out) {
+    fprintf(out,
+            "usage: lora_bridge_ctl [options] list|read|write|send [args]\n"
+            "  list                    bridges found and their ports\n"
+            "  read                    parameters of the module, cached by the bridge\n"
+            "  write FIELD=VALUE...    change addh, addl, sped, opt1, chan or opt2\n"
+            "  send TEXT               write TEXT to the module, print what comes back\n"
+            "options:\n"
+            "  -s, --serial SERIAL     only this bridge, may be repeated\n"
+            "  -m, --module N          0 for uart0 (default), 1 for uart1\n"
+            "  -r, --refresh           read from the module instead of the cache\n"
+            "  -S, --save              keep written parameters over power cycles\n"
+            "  -w, --wait MS           how long send listens, default %d\n"
+            "  -t, --timeout MS        per command, default %d\n",
+            CTL_DEFAULT_WAIT_MS, BRIDGE_COMMAND_TIMEOUT_MS);
+}
+
+static void print_params(device_info const &device, parameters_t const &params) {
+    printf("%s addh=0x%02X addl=0x%02X sped=0x%02X opt1=0x%02X chan=0x%02X opt2=0x%02X\n",
+           device.serial.c_str(), params.addh, params.addl, params.sped, params.opt1, params.chan, params.opt2);
+}
+
+static bool parse_field(char const *arg, field_t *field) {
+    static struct {
+        char const *name;
+        size_t offset;
+    } const names[] = {
+            {"addh", offsetof(parameters_t, addh)},
+            {"addl", offsetof(parameters_t, addl)},
+            {"sped", offsetof(parameters_t, sped)},
+            {"opt1", offsetof(parameters_t, opt1)},
+            {"chan", offsetof(parameters_t, chan)},
+            {"opt2", offsetof(parameters_t, opt2)},
+    };
+
+    char const *equals = strchr(arg, '=');
+    if (!equals)
+        return false;
+
+    char *end;
+    unsigned long value = strtoul(equals + 1, &end, 0);
+    if (*end || end == equals + 1 || value > 0xFF)
+        return false;
+
+    for (auto const &name : names) {
+        if (strlen(name.name) == (size_t) (equals - arg) && strncmp(name.name, arg, equals - arg) == 0) {
+            *field = {name.offset, static_cast<uint8_t>(value)};
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Read, change the fields, write back, on each bridge independently
+static void start_write(bridge &device, options_t const &options, std::vector<field_t> const &fields,
+                        int *failures) {
+    device.read_params(options.module, false, [&device, &options, fields, failures](bool ok, parameters_t params) {
+        if (!ok) {
+            printf("%s read failed\n", device.info().serial.c_str());
+            ++*failures;
+            return;
+        }
+
+        for (auto const &field : fields)
+            reinterpret_cast<uint8_t *>(&params)[field.offset] = field.value;
+
+        device.write_params(options.module, params, options.save,
+                            [&device, failures](bool ok, parameters_t const &written) {
+                                if (ok) {
+                                    print_params(device.info(), written);
+                                } else {
+                                    printf("%s write failed\n", device.info().serial.c_str());
+                                    ++*failures;
+                                }
+                            });
+    });
+}
+
+static void start_read(bridge &device, options_t const &options, int *failures) {
+    device.read_params(options.module, options.refresh, [&device, failures](bool ok, parameters_t const &params) {
+        if (ok) {
+            print_params(device.info(), params);
+        } else {
+            printf("%s read failed\n", device.info().serial.c_str());
+            ++*failures;
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    static option const long_options[] = {
+            {"serial",  required_argument, nullptr, 's'},
+            {"module",  required_argument, nullptr, 'm'},
+            {"refresh", no_argument,       nullptr, 'r'},
+            {"save",    no_argument,       nullptr, 'S'},
+            {"wait",    required_argument, nullptr, 'w'},
+            {"timeout", required_argument, nullptr, 't'},
+            {"help",    no_argument,       nullptr, 'h'},
+            {nullptr, 0,                   nullptr, 0},
+    };
+
+    options_t options;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:m:rSw:t:h", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 's':
+                options.serials.insert(optarg);
+                break;
+            case 'm':
+                options.module = atoi(optarg);
+                break;
+            case 'r':
+                options.refresh = true;
+                break;
+            case 'S':
+                options.save = true;
+                break;
+            case 'w':
+                options.wait_ms = atoi(optarg);
+                break;
+            case 't':
+                options.timeout_ms = atoi(optarg);
+                break;
+            case 'h':
+                usage(stdout);
+                return 0;
+            default:
+                usage(stderr);
+                return 2;
+        }
+    }
+
+    if (optind >= argc || options.module >= RADIO_CORE_MODULES) {
+        usage(stderr);
+        return 2;
+    }
+
+    std::string command = argv[optind++];
+    std::vector<field_t> fields;
+    std::string text;
+
+    if (command == "write") {
+        for (; optind < argc; ++optind) {
+            field_t field;
+            if (!parse_field(argv[optind], &field)) {
+                fprintf(stderr, "bad field: %s\n", argv[optind]);
+                return 2;
+            }
+            fields.push_back(field);
+        }
+    } else if (command == "send" && optind < argc) {
+        text = argv[optind];
+    } else if (command != "list" && command != "read") {
+        usage(stderr);
+        return 2;
+    }
+
+    std::vector<device_info> found;
+    for (auto &device : find_bridges()) {
+        if (options.serials.empty() || options.serials.count(device.serial))
+            found.push_back(std::move(device));
+    }
+
+    if (command == "list") {
+        for (auto const &device : found) {
+            printf("%s %s %s %s\n", device.serial.c_str(), device.hidraw.c_str(),
+                   device.tty[0].empty() ? "-" : device.tty[0].c_str(),
+                   device.tty[1].empty() ? "-" : device.tty[1].c_str());
+        }
+        return 0;
+    }
+
+    event_loop loop;
+    std::vector<std::unique_ptr<bridge>> bridges;
+    int failures = 0;
+
+    for (auto const &device : found) {
+        try {
+            bridges.push_back(std::make_unique<bridge>(loop, device));
+            bridges.back()->set_timeout(std::chrono::milliseconds(options.timeout_ms));
+        } catch (std::exception const &e) {
+            fprintf(stderr, "%s: %s\n", device.serial.c_str(), e.what());
+            ++failures;
+        }
+    }
+
+    auto start = steady_clock::now();
+    bool listening = false;
+
+    for (auto &device : bridges) {
+        if (command == "read") {
+            start_read(*device, options, &failures);
+        } else if (command == "write") {
+            start_write(*device, options, fields, &failures);
+        } else {
+            bridge *target = device.get();
+            target->on_data([target](uint32_t module, uint8_t const *data, size_t len) {
+                printf("%s %u: %.*s\n", target->info().serial.c_str(), module, (int) len, (char const *) data);
+            });
+
+            try {
+                target->send(options.module, reinterpret_cast<uint8_t const *>(text.data()), text.size());
+            } catch (std::exception const &e) {
+                fprintf(stderr, "%s\n", e.what());
+                ++failures;
+            }
+            listening = true;
+        }
+    }
+
+    if (listening)
+        loop.call_in(std::chrono::milliseconds(options.wait_ms), [&listening] { listening = false; });
+
+    loop.run([&] {
+        if (listening)
+            return false;
+
+        for (auto const &device : bridges) {
+            if (device->pending())
+                return false;
+        }
+        return true;
+    });
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - start);
+    fprintf(stderr, "%zu bridges in %lld ms\n", bridges.size(), (long long) elapsed.count());
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,32 @@
+#ifndef _LORA_BRIDGE_LOOP_TIMER_H_
+#define _LORA_BRIDGE_LOOP_TIMER_H_
+
+#include <stdint.h>
+
+// Histogram of main loop iteration times. Bins grow four times wider each:
+// under 16 us, 64 us, 256 us, 1 ms and the rest. Counters wrap, the host works
+// with the differences between two reads.
+#define LOOP_TIMER_BINS         5
+#define LOOP_TIMER_FIRST_US     16
+
+typedef struct {
+    uint64_t last_us;
+    uint16_t histogram[LOOP_TIMER_BINS];
+} loop_timer_t;
+
+/// Call once per iteration, the first call only starts the clock
+static inline void loop_timer_tick(loop_timer_t *timer, uint64_t now_us) {
+    if (timer->last_us != 0) {
+        uint64_t elapsed_us = now_us - timer->last_us;
+        uint32_t bin = 0;
+
+        for (uint64_t limit = LOOP_TIMER_FIRST_US; bin < LOOP_TIMER_BINS - 1 && elapsed_us >= limit; limit *= 4)
+            bin++;
+
+        timer->histogram[bin]++;
+    }
+
+    timer->last_us = now_us;
+}
+
+#endif //_LORA_BRIDGE_LOOP_TIMER_H_
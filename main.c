@@ -1,46 +1,70 @@
+#include <memory.h>
+
 #include <hardware/gpio.h>
 #include <hardware/uart.h>
 #include <tusb.h>
 
 #include "usb_command.h"
-#include "radio.h"
+#include "radio_core.h"
+#include "radio_frame.h"
+
+#if CFG_TUD_VENDOR
+#include "usb_vendor.h"
+#endif
 
 #ifndef PICO_DEFAULT_LED_PIN
 #error LoRa bridge requires a board with a regular LED
 #endif
 
-#ifndef MIN
-#define MIN(a, b) ((a > b) ? b : a)
+#if CFG_TUD_CDC != RADIO_CORE_MODULES
+#error LoRa bridge requires a CDC interface for each module
 #endif
 
 #define LED_PIN PICO_DEFAULT_LED_PIN
-#define BUFFER_SIZE 64
-#define MAX_SENT 400
+
+// Acknowledgements and completions waiting for the IN endpoint, two for each
+// command in flight and one for a command answered on this core
+#define HID_REPORT_QUEUE_SIZE (2 * RADIO_CORE_COMMAND_SLOTS + 2)
+
+/// Where the completion of a command goes
+typedef enum {
+    ORIGIN_HID = 0,
+    ORIGIN_VENDOR,
+} command_origin_t;
 
 enum {
     BLINK_FAILED = 100,
+    BLINK_CHECK_FAILED = 500,
     BLINK_NOT_MOUNTED = 250,
     BLINK_MOUNTED = 1000,
     BLINK_SUSPENDED = 2500,
 };
 
-radio_inst_t radio = {
-        .uart = uart0,
-        .tx_pin = 0,
-        .rx_pin = 1,
-        .m0_pin = 2,
-        .m1_pin = 3,
-        .aux_pin = 6
-};
-
-char buf[BUFFER_SIZE];
-uint32_t sent = 0;
 uint32_t blink_interval_ms = BLINK_NOT_MOUNTED;
+bool remote_wakeup_allowed;
+uint8_t cdc_latency_ms = USB_COMMAND_DEFAULT_LATENCY_MS;
+absolute_time_t cdc_flush_time[CFG_TUD_CDC];
+usb_command_stats_t usb_stats;
+
+uint8_t hid_reports[HID_REPORT_QUEUE_SIZE][CFG_TUD_HID_EP_BUFSIZE];
+uint32_t hid_report_head;
+uint32_t hid_report_tail;
+
+// Origins of the commands in flight, completions arrive in the same order
+uint8_t command_origins[RADIO_CORE_COMMAND_SLOTS];
+uint32_t command_origin_head;
+uint32_t command_origin_tail;
 
 void led_blinking_task(void);
 
 void cdc_task(void);
 
+void hid_task(void);
+
+void response_task(void);
+
+void wakeup_task(void);
+
 //--------------------------------------------------------------------+
 // Main functions
 //--------------------------------------------------------------------+
@@ -50,6 +74,13 @@ inline void loop(void) {
     led_blinking_task();
 
     cdc_task();
+#if CFG_TUD_VENDOR
+    usb_vendor_task();
+#endif
+    response_task();
+    hid_task();
+    wakeup_task();
+    radio_core_store_task();
 }
 
 #pragma clang diagnostic push
@@ -59,7 +90,8 @@ int main(void) {
     gpio_init(LED_PIN);
     gpio_set_dir(LED_PIN, GPIO_OUT);
 
-    if (!radio_init(&radio)) {
+    // The radio runs on core1, USB stays on this core
+    if (!radio_core_launch()) {
         blink_interval_ms = BLINK_FAILED;
         while (true) {
             led_blinking_task();
@@ -69,6 +101,7 @@ int main(void) {
     tusb_init();
 
     while (true) {
+        loop_timer_tick(&usb_stats.loop, time_us_64());
         loop();
     }
 }
@@ -93,50 +126,149 @@ void tud_umount_cb(void) {
 // remote_wakeup_en : if host allow us  to perform remote wakeup
 // Within 7ms, device must draw an average of current less than 2.5 mA from bus
 void tud_suspend_cb(bool remote_wakeup_en) {
-    (void) remote_wakeup_en;
+    remote_wakeup_allowed = remote_wakeup_en;
     blink_interval_ms = BLINK_SUSPENDED;
+    radio_core_suspend(true);
 }
 
 // Invoked when usb bus is resumed
 void tud_resume_cb(void) {
+    remote_wakeup_allowed = false;
     blink_interval_ms = BLINK_MOUNTED;
+    radio_core_suspend(false);
+}
+
+// Data from the air wakes a suspended host, when it allowed it
+void wakeup_task(void) {
+    if (!remote_wakeup_allowed || !tud_suspended())
+        return;
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        if (radio_core_present(module) && ring_buffer_count(radio_core_rx_queue(module)) > 0) {
+            remote_wakeup_allowed = false;
+            tud_remote_wakeup();
+            return;
+        }
+    }
 }
 
 //--------------------------------------------------------------------+
 // USB CDC
 //--------------------------------------------------------------------+
 
-void cdc_task(void) {
+// Framed mode, every datagram goes to the host whole in one transfer
+static void cdc_write_datagrams(uint8_t itf, ring_buffer_t *rx_queue) {
+    static uint8_t datagram[RADIO_FRAME_PREFIX_SIZE + RADIO_FRAME_MAX_DATAGRAM];
+    uint32_t count;
+
+    while ((count = ring_buffer_count(rx_queue)) >= RADIO_FRAME_PREFIX_SIZE) {
+        uint32_t len = RADIO_FRAME_PREFIX_SIZE + (ring_buffer_at(rx_queue, 0) | ring_buffer_at(rx_queue, 1) << 8);
+
+        if (count < len || tud_cdc_n_write_available(itf) < len)
+            break;
+
+        ring_buffer_read(rx_queue, datagram, len);
+        usb_stats.cdc_tx_bytes += tud_cdc_n_write(itf, datagram, len);
+        tud_cdc_n_write_flush(itf);
+    }
+}
+
+static void update_high_water(uint16_t *high_water, uint32_t count) {
+    if (count > *high_water)
+        *high_water = (uint16_t) count;
+}
+
+// CDC interface n carries the data of module n
+static void cdc_module_task(uint8_t itf) {
     // connected() check for DTR bit
     // Most but not all terminal client set this when making connection
-    // if ( tud_cdc_connected() )
+    // if ( tud_cdc_n_connected(itf) )
     {
-        // Reset sent counter if the module is not busy
-        if (gpio_get(radio.aux_pin) == 1) {
-            sent = 0;
+        ring_buffer_t *tx_queue = radio_core_tx_queue(itf);
+        ring_buffer_t *rx_queue = radio_core_rx_queue(itf);
+
+        // Read from the host straight into the queue to core1. Once the module is
+        // out of credits core1 stops draining it, the data then stays in the CDC
+        // FIFO and the host is held off
+        uint8_t *dst;
+        uint32_t space = ring_buffer_peek_free(tx_queue, &dst);
+        uint32_t available = tud_cdc_n_available(itf);
+        update_high_water(&usb_stats.cdc_rx_high_water, available);
+
+        if (space > 0 && available) {
+            uint32_t count = tud_cdc_n_read(itf, dst, space);
+            ring_buffer_produce(tx_queue, count);
+            usb_stats.cdc_rx_bytes += count;
+            update_high_water(&usb_stats.tx_queue_high_water, ring_buffer_count(tx_queue));
         }
 
-        // Send available data if the module buffer is not full
-        if (sent < MAX_SENT && tud_cdc_available()) {
-            uint32_t len = tud_cdc_read(buf, MIN(MAX_SENT - sent, BUFFER_SIZE));
-            uart_write_blocking(radio.uart, (uint8_t *) buf, len);
-            sent += len;
+        if (radio_core_framed(itf)) {
+            cdc_write_datagrams(itf, rx_queue);
+            update_high_water(&usb_stats.cdc_tx_high_water, CFG_TUD_CDC_TX_BUFSIZE - tud_cdc_n_write_available(itf));
+            return;
         }
 
-        // Read available data
-        while (uart_is_readable(radio.uart)) {
-            char ch = uart_getc(radio.uart);
-            tud_cdc_write_char(ch);
-            tud_cdc_write_flush();
+        // Move received data to the CDC FIFO in contiguous spans
+        uint8_t const *data;
+        uint32_t len;
+        uint32_t total = 0;
+
+        while ((len = ring_buffer_peek(rx_queue, &data)) > 0) {
+            uint32_t written = tud_cdc_n_write(itf, data, len);
+            ring_buffer_consume(rx_queue, written);
+            total += written;
+            usb_stats.cdc_tx_bytes += written;
+
+            // CDC FIFO full, retry on next loop
+            if (written < len)
+                break;
+        }
+
+        update_high_water(&usb_stats.cdc_tx_high_water, CFG_TUD_CDC_TX_BUFSIZE - tud_cdc_n_write_available(itf));
+
+        // Full packets are sent by tud_cdc_n_write(), a partial packet is only
+        // flushed once the latency timer started by its first byte expires
+        if (total > 0 && is_nil_time(cdc_flush_time[itf])) {
+            cdc_flush_time[itf] = make_timeout_time_ms(cdc_latency_ms);
         }
+
+        if (!is_nil_time(cdc_flush_time[itf]) && time_reached(cdc_flush_time[itf])) {
+            tud_cdc_n_write_flush(itf);
+            cdc_flush_time[itf] = nil_time;
+        }
+    }
+}
+
+// The bulk interface is the only reader of the modules it claimed
+static bool vendor_claimed(uint8_t module) {
+#if CFG_TUD_VENDOR
+    return usb_vendor_claimed(module);
+#else
+    (void) module;
+    return false;
+#endif
+}
+
+// Data of a missing module stays in its CDC FIFO, the host is held off
+void cdc_task(void) {
+    for (uint8_t itf = 0; itf < CFG_TUD_CDC; ++itf) {
+        if (radio_core_present(itf) && !vendor_claimed(itf))
+            cdc_module_task(itf);
     }
 }
 
 // Invoked when cdc line state changed e.g. connected/disconnected
+// A tty opening the port takes the module back from the bulk interface
 void tud_cdc_line_state_cb(uint8_t itf, bool dtr, bool rts) {
-    (void) itf;
     (void) rts;
+
+#if CFG_TUD_VENDOR
+    if (dtr)
+        usb_vendor_release(itf);
+#else
+    (void) itf;
     (void) dtr;
+#endif
 }
 
 // Invoked when CDC interface received data from host
@@ -152,15 +284,50 @@ void tud_cdc_rx_cb(uint8_t itf) {
 // Application must fill buffer report's content and return its length.
 // Return zero will cause the stack to STALL request
 uint16_t tud_hid_get_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t report_type,
-                               uint8_t *buffer, uint16_t reqlen) { // NOLINT(readability-non-const-parameter)
-    // TODO not Implemented
+                               uint8_t *buffer, uint16_t reqlen) {
     (void) itf;
     (void) report_id;
     (void) report_type;
-    (void) buffer;
-    (void) reqlen;
 
-    return 0;
+    // Runtime counters, cheap enough to poll
+    return usb_command_get_report(&usb_stats, buffer, reqlen);
+}
+
+// Queues a report for hid_task(), false when the queue is full
+static bool queue_report(uint8_t const *report) {
+    if (hid_report_head - hid_report_tail == HID_REPORT_QUEUE_SIZE)
+        return false;
+
+    memcpy(hid_reports[hid_report_head % HID_REPORT_QUEUE_SIZE], report, CFG_TUD_HID_EP_BUFSIZE);
+    hid_report_head++;
+    return true;
+}
+
+// Runs a command on this core or hands it to core1, fills the report
+// acknowledging it. Echoes the first byte, the module and the sequence number.
+static void run_command(command_origin_t origin, uint8_t const *buffer, uint16_t bufsize, uint8_t *response) {
+    memset(response, 0, CFG_TUD_HID_EP_BUFSIZE);
+    response[0] = buffer[0];
+    if (bufsize > USB_COMMAND_SEQUENCE_INDEX) {
+        response[USB_COMMAND_MODULE_INDEX] = buffer[USB_COMMAND_MODULE_INDEX];
+        response[USB_COMMAND_SEQUENCE_INDEX] = buffer[USB_COMMAND_SEQUENCE_INDEX];
+    }
+
+    switch (buffer[0]) {
+        case USB_COMMAND_SET_LATENCY:
+            usb_command_set_latency(&cdc_latency_ms, &usb_stats, response, buffer, bufsize);
+            break;
+
+        // Proxy everything else to the radio core, response_task() routes its completion
+        default:
+            if (radio_core_post_command(buffer, bufsize)) {
+                command_origins[command_origin_head++ % RADIO_CORE_COMMAND_SLOTS] = origin;
+                response[1] = USB_COMMAND_QUEUED;
+            } else {
+                response[1] = USB_COMMAND_BUSY;
+            }
+            break;
+    }
 }
 
 // Invoked when received SET_REPORT control request or
@@ -171,41 +338,97 @@ void tud_hid_set_report_cb(uint8_t itf, uint8_t report_id, hid_report_type_t rep
     (void) report_id;
     (void) report_type;
 
-    // Echo the first byte of the request
-    uint8_t response[CFG_TUD_HID_EP_BUFSIZE] = {buffer[0]};
-
-    // Proxy command to radio module
-    switch (buffer[0]) {
-        case USB_COMMAND_READ_PARAMS:
-            usb_command_read_params(&radio, response, buffer, bufsize);
-            break;
+    // A host with more than RADIO_CORE_COMMAND_SLOTS commands outstanding can
+    // fill the queue, the command is then dropped before it runs
+    if (hid_report_head - hid_report_tail == HID_REPORT_QUEUE_SIZE) {
+        usb_stats.hid_commands_dropped++;
+        return;
+    }
 
-        case USB_COMMAND_WRITE_PARAMS:
-            usb_command_write_params(&radio, response, buffer, bufsize);
-            break;
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    run_command(ORIGIN_HID, buffer, bufsize, response);
+    queue_report(response);
+}
 
-        default:
-            break;
+// Never blocks, reports wait for the IN endpoint in the queue
+void hid_task(void) {
+    if (hid_report_head != hid_report_tail && tud_hid_ready()) {
+        tud_hid_report(0, hid_reports[hid_report_tail % HID_REPORT_QUEUE_SIZE], CFG_TUD_HID_EP_BUFSIZE);
+        hid_report_tail++;
     }
+}
 
-    tud_hid_report(0, response, CFG_TUD_HID_EP_BUFSIZE);
+#if CFG_TUD_VENDOR
+
+void usb_vendor_command_cb(uint8_t const *request, uint8_t *response) {
+    run_command(ORIGIN_VENDOR, request, CFG_TUD_HID_EP_BUFSIZE, response);
+}
+
+#else
+
+// Without the bulk interface every command comes through HID
+static bool usb_vendor_can_respond(void) {
+    return false;
+}
+
+static void usb_vendor_respond(uint8_t const *report) {
+    (void) report;
+}
+
+#endif
+
+// Completions only leave the radio core once their origin has room for them
+void response_task(void) {
+    if (command_origin_head == command_origin_tail)
+        return;
+
+    uint8_t origin = command_origins[command_origin_tail % RADIO_CORE_COMMAND_SLOTS];
+    bool room = origin == ORIGIN_VENDOR ? usb_vendor_can_respond()
+                                        : hid_report_head - hid_report_tail < HID_REPORT_QUEUE_SIZE;
+
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    if (!room || !radio_core_poll_response(response))
+        return;
+
+    command_origin_tail++;
+    if (origin == ORIGIN_VENDOR)
+        usb_vendor_respond(response);
+    else
+        queue_report(response);
 }
 
 //--------------------------------------------------------------------+
 // BLINKING TASK
 //--------------------------------------------------------------------+
 
+// A module found with other parameters than the cached ones, or no longer
+// answering, stays flagged until the next start-up
+static bool start_up_check_failed(void) {
+    radio_core_stats_t stats;
+    radio_core_get_stats(&stats);
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        if (stats.modules[module].boot == RADIO_BOOT_MISMATCH || stats.modules[module].boot == RADIO_BOOT_NO_ANSWER)
+            return true;
+    }
+
+    return false;
+}
+
 void led_blinking_task(void) {
     static uint32_t start_ms = 0;
+    static uint32_t interval_ms = BLINK_NOT_MOUNTED;
     static bool led_state = false;
     uint32_t now_ms = to_ms_since_boot(get_absolute_time());
 
     // Blink every interval ms
-    if (now_ms - start_ms < blink_interval_ms) {
+    if (now_ms - start_ms < interval_ms) {
         return; // not enough time
     }
 
-    start_ms += blink_interval_ms;
+    start_ms += interval_ms;
+    interval_ms = blink_interval_ms != BLINK_FAILED && start_up_check_failed() ? BLINK_CHECK_FAILED
+                                                                                : blink_interval_ms;
 
     gpio_put(LED_PIN, led_state);
     led_state = 1 - led_state; // toggle
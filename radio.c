@@ -1,175 +1,676 @@
-#include <hardware/gpio.h>
-#include <pico/time.h>
-#include <hardware/uart.h>
+#include <memory.h>
 
 #include "radio.h"
+#include "radio_adapt.h"
+#include "radio_arq.h"
+#include "radio_fec.h"
+#include "radio_dest.h"
+#include "radio_flow.h"
+#include "radio_frame.h"
+#include "radio_power.h"
+#include "radio_rssi.h"
+#include "radio_sched.h"
+#include "radio_store.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+
+#define RADIO_RESPONSE_TIMEOUT_US   (1000 * 1000)
+#define RADIO_AUX_TIMEOUT_US        (1000 * 1000)
+#define RADIO_GUARD_US              (10 * 1000)
+#define RADIO_SETTLE_US             (50 * 1000)  // Takes a little while to start its response
+
+#define RADIO_RESPONSE_HEAD         0xC1
+#define RADIO_RESPONSE_ERROR        0xFF
+
+/// Steps of a mode switch, advanced by radio_task()
+typedef enum {
+    STEP_IDLE = 0,
+    STEP_DRAIN,         ///< Wait for queued data to leave the UART
+    STEP_AUX_BEFORE,    ///< Wait for AUX high before touching M0/M1
+    STEP_GUARD,         ///< Wait RADIO_GUARD_US before touching M0/M1
+    STEP_AUX_AFTER,     ///< Wait for AUX high after touching M0/M1
+    STEP_SETTLE,        ///< Wait RADIO_SETTLE_US for the module to settle
+    STEP_RESPONSE,      ///< Collect the response to a configuration command
+} radio_step_t;
+
+typedef enum {
+    OP_MODE = 0,
+    OP_CONFIG,          ///< Configuration commands inside one MODE_SLEEP window
+} radio_op_t;
+
+/// Phases of a configuration transaction
+typedef enum {
+    PHASE_ENTER = 0,    ///< Switching to MODE_SLEEP
+    PHASE_COMMAND,      ///< Commands sent one by one, waiting for each response
+    PHASE_LEAVE,        ///< Switching back to MODE_NORMAL
+} radio_phase_t;
+
+typedef struct {
+    radio_step_t step;
+    radio_op_t op;
+    radio_phase_t phase;
+    operating_mode_t mode;          ///< Target of the current switch
+    bool success;
+
+    uint8_t sped;                   ///< UART settings used outside of configuration
+    parameters_t snapshot;          ///< Last parameters reported by the module
+    bool snapshot_valid;
+    radio_register_op_t single;     ///< Backs reads and writes of all parameters
+    radio_register_op_t *ops;       ///< Commands of the transaction, run in order
+    uint32_t op_count;
+    uint32_t op_index;
+    bool touched;                   ///< A response reported parameter registers
+    uint8_t response[3 + RADIO_REGISTERS];
+    uint32_t received;
+
+    volatile bool timer_fired;
+    hal_alarm_t alarm;
+
+    radio_callback_t callback;
+    void *user_data;
+
+    uint64_t switch_start_us;
+    radio_stats_t stats;
+    radio_boot_t boot;
+} radio_ctl_t;
+
+static radio_ctl_t radio_ctl[NUM_UARTS];
+
+static radio_ctl_t *get_ctl(radio_inst_t const *radio) {
+    return &radio_ctl[hal_uart_index(radio->uart)];
+}
 
-bool radio_init(radio_inst_t const *radio) {
-    gpio_init(radio->aux_pin);
-    gpio_set_dir(radio->aux_pin, GPIO_IN);
+// Data path settings follow the parameters of the module
+static void apply_snapshot(radio_inst_t const *radio, radio_ctl_t *ctl) {
+    radio_flow_configure(radio, &ctl->snapshot);
+    radio_sched_configure(radio, &ctl->snapshot);
+    radio_frame_configure(radio, &ctl->snapshot);
+    radio_rssi_configure(radio, &ctl->snapshot);
+    radio_arq_configure(radio, &ctl->snapshot);
+    radio_fec_configure(radio, &ctl->snapshot);
+    ctl->sped = ctl->snapshot.sped;
+}
 
-    gpio_init(radio->m0_pin);
-    gpio_set_dir(radio->m0_pin, GPIO_OUT);
+static void read_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data);
 
-    gpio_init(radio->m1_pin);
-    gpio_set_dir(radio->m1_pin, GPIO_OUT);
+static void verify_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data);
 
-    gpio_set_function(radio->tx_pin, GPIO_FUNC_UART);
-    gpio_set_function(radio->rx_pin, GPIO_FUNC_UART);
+// Neither way waits for the module. With cached parameters it is trusted to
+// hold them and read back in the background, returns true as it can be used
+// at once. Without, it can be used once radio_get_boot() reports it read.
+bool radio_init(radio_inst_t const *radio) {
+    radio_ctl_t *ctl = get_ctl(radio);
+
+    hal_gpio_init(radio->aux_pin, false);
+    hal_gpio_init(radio->m0_pin, true);
+    hal_gpio_init(radio->m1_pin, true);
 
-    uart_set_hw_flow(radio->uart, false, false);
+    hal_uart_init_pins(radio->uart, radio->tx_pin, radio->rx_pin);
     set_radio_uart_config_mode(radio);
+    radio_flow_init(radio);
+    radio_sched_init(radio);
+    radio_dest_init(radio);
+    radio_frame_init(radio);
+    radio_rssi_init(radio);
+    radio_adapt_init(radio);
+    radio_arq_init(radio);
+    radio_fec_init(radio);
+    radio_power_init(radio);
+
+    if (radio_store_load(radio, &ctl->snapshot)) {
+        ctl->snapshot_valid = true;
+        apply_snapshot(radio, ctl);
+        set_radio_uart(radio, ctl->sped);
+
+        ctl->boot = RADIO_BOOT_VERIFYING;
+        read_parameters_async(radio, verify_done, NULL);
+        return true;
+    }
 
-    parameters_t params;
-    if (!read_parameters(radio, &params))
-        return false;
+    // Until the module tells otherwise
+    ctl->snapshot_valid = false;
+    ctl->sped = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE;
+    ctl->boot = RADIO_BOOT_READING;
+    read_parameters_async(radio, read_done, NULL);
+    return false;
+}
 
-    set_radio_uart(radio, params.sped);
-    return true;
+//--------------------------------------------------------------------+
+// Timers
+//--------------------------------------------------------------------+
+
+static int64_t radio_alarm_cb(hal_alarm_t id, void *user_data) {
+    (void) id;
+    radio_ctl_t *ctl = user_data;
+
+    ctl->alarm = 0;
+    ctl->timer_fired = true;
+    return 0;
 }
 
-bool read_parameters(radio_inst_t const *radio, parameters_t *params) {
-    set_operating_mode(radio, MODE_SLEEP);
+static void arm_timer(radio_ctl_t *ctl, uint32_t us) {
+    if (ctl->alarm > 0)
+        hal_alarm_cancel(ctl->alarm);
 
-    uint8_t command[] = {RADIO_COMMAND_READ_PARAMS, 0x00, sizeof(parameters_t)};
-    uart_write_blocking(radio->uart, command, sizeof(command));
+    ctl->timer_fired = false;
+    ctl->alarm = hal_alarm_in_us(us, radio_alarm_cb, ctl);
+}
 
-    // Fail?
-    if (!uart_is_readable_within_us(radio->uart, 1000 * 1000)) {
-        set_operating_mode(radio, MODE_NORMAL);
-        return false;
+static void disarm_timer(radio_ctl_t *ctl) {
+    if (ctl->alarm > 0)
+        hal_alarm_cancel(ctl->alarm);
+
+    ctl->alarm = 0;
+    ctl->timer_fired = false;
+}
+
+//--------------------------------------------------------------------+
+// State machine
+//--------------------------------------------------------------------+
+
+static void put_mode_pins(radio_inst_t const *radio, operating_mode_t mode) {
+    switch (mode) {
+        default:
+        case MODE_NORMAL:
+            hal_gpio_put(radio->m0_pin, false);
+            hal_gpio_put(radio->m1_pin, false);
+            break;
+
+        case MODE_WAKE_UP:
+            hal_gpio_put(radio->m0_pin, true);
+            hal_gpio_put(radio->m1_pin, false);
+            break;
+
+        case MODE_POWER_SAVING:
+            hal_gpio_put(radio->m0_pin, false);
+            hal_gpio_put(radio->m1_pin, true);
+            break;
+
+        case MODE_SLEEP:
+            hal_gpio_put(radio->m0_pin, true);
+            hal_gpio_put(radio->m1_pin, true);
+            break;
     }
+}
 
-    uart_read_blocking(radio->uart, command, sizeof(command));
+static void begin_switch(radio_ctl_t *ctl, operating_mode_t mode) {
+    ctl->mode = mode;
+    ctl->step = STEP_DRAIN;
+    ctl->switch_start_us = hal_time_us();
+}
 
-    if (command[0] == 0xFF &&
-        command[1] == 0xFF &&
-        command[2] == 0xFF) {
-        set_operating_mode(radio, MODE_NORMAL);
-        return false;
+static void send_command(radio_inst_t const *radio, radio_ctl_t *ctl) {
+    radio_register_op_t const *op = &ctl->ops[ctl->op_index];
+    uint8_t command[3 + RADIO_REGISTERS] = {op->command, op->address, op->len};
+    uint32_t len = 3;
+
+    if (op->command != RADIO_COMMAND_READ_PARAMS) {
+        memcpy(&command[3], op->data, op->len);
+        len += op->len;
     }
-    uart_read_blocking(radio->uart, (uint8_t *) params, sizeof(parameters_t));
 
-    set_operating_mode(radio, MODE_NORMAL);
-    return true;
+    // Nothing arrives over the air in MODE_SLEEP, anything left is stale
+    uint8_t const *stale;
+    uint32_t count;
+    while ((count = uart_rx_peek(radio->uart, &stale)) > 0)
+        uart_rx_consume(radio->uart, count);
+
+    uart_tx_write(radio->uart, command, len);
+
+    ctl->received = 0;
+    ctl->phase = PHASE_COMMAND;
+    ctl->step = STEP_RESPONSE;
+    arm_timer(ctl, RADIO_RESPONSE_TIMEOUT_US);
 }
 
-bool write_parameters(radio_inst_t const *radio, parameters_t const *params, bool save) {
-    set_operating_mode(radio, MODE_SLEEP);
+// Returns true once the response is complete or rejected
+static bool collect_response(radio_inst_t const *radio, radio_ctl_t *ctl) {
+    radio_register_op_t *op = &ctl->ops[ctl->op_index];
+    uint32_t expected = 3 + op->len;
 
-    uint8_t head = save ? RADIO_COMMAND_WRITE_PARAMS_SAVE : RADIO_COMMAND_WRITE_PARAMS_NOSAVE;
-    uint8_t command[] = {head, 0x00, sizeof(parameters_t)};
+    ctl->received += uart_rx_read(radio->uart, &ctl->response[ctl->received], expected - ctl->received);
 
-    uart_write_blocking(radio->uart, command, sizeof(command));
-    uart_write_blocking(radio->uart, (uint8_t *) params, sizeof(parameters_t));
+    if (ctl->received >= 3 &&
+        ctl->response[0] == RADIO_RESPONSE_ERROR &&
+        ctl->response[1] == RADIO_RESPONSE_ERROR &&
+        ctl->response[2] == RADIO_RESPONSE_ERROR) {
+        ctl->success = false;
+        return true;
+    }
 
-    // Fail?
-    if (!uart_is_readable_within_us(radio->uart, 1000 * 1000)) {
-        set_operating_mode(radio, MODE_NORMAL);
+    if (ctl->received < expected)
         return false;
+
+    ctl->success = ctl->response[0] == RADIO_RESPONSE_HEAD &&
+                   ctl->response[1] == op->address &&
+                   ctl->response[2] == op->len;
+
+    if (ctl->success) {
+        memcpy(op->data, &ctl->response[3], op->len);
+        op->done = true;
+
+        // What the module comes up with next time
+        if (op->command == RADIO_COMMAND_WRITE_PARAMS_SAVE)
+            radio_store_update(radio, op->address, op->data, op->len);
+
+        // Keep the snapshot in step with every register the module reported
+        uint8_t *snapshot = (uint8_t *) &ctl->snapshot;
+        for (uint32_t i = 0; i < op->len; i++) {
+            if (op->address + i < sizeof(parameters_t)) {
+                snapshot[op->address + i] = op->data[i];
+                ctl->touched = true;
+            }
+        }
     }
 
-    uart_read_blocking(radio->uart, command, sizeof(command));
+    return true;
+}
 
-    if (command[0] == 0xFF &&
-        command[1] == 0xFF &&
-        command[2] == 0xFF) {
-        set_operating_mode(radio, MODE_NORMAL);
-        return false;
+static void finish(radio_inst_t const *radio, radio_ctl_t *ctl) {
+    ctl->step = STEP_IDLE;
+    disarm_timer(ctl);
+
+    parameters_t const *params = NULL;
+    if (ctl->op != OP_MODE) {
+        // Reading or writing all parameters completes the snapshot
+        if (ctl->ops == &ctl->single && ctl->single.done)
+            ctl->snapshot_valid = true;
+
+        // A failed batch still applies the commands that went through before it
+        if (ctl->touched && ctl->snapshot_valid)
+            apply_snapshot(radio, ctl);
+
+        if (ctl->success && ctl->snapshot_valid)
+            params = &ctl->snapshot;
+
+        // Back to the data UART settings, the new ones if the module accepted them
+        set_radio_uart(radio, ctl->sped);
     }
 
-    uart_read_blocking(radio->uart, (uint8_t *) params, sizeof(parameters_t));
-    set_operating_mode(radio, MODE_NORMAL);
-    return true;
+    if (ctl->callback)
+        ctl->callback(radio, ctl->success, params, ctl->user_data);
 }
 
-void set_operating_mode(radio_inst_t const *radio, operating_mode_t mode) {
-    wait_aux_high(radio);
-    sleep_ms(10);
+// Called once a mode switch has settled
+static void switch_done(radio_inst_t const *radio, radio_ctl_t *ctl) {
+    uint32_t elapsed_us = (uint32_t) (hal_time_us() - ctl->switch_start_us);
+
+    ctl->stats.switches++;
+    ctl->stats.switch_us += elapsed_us;
+    if (elapsed_us > ctl->stats.switch_max_us)
+        ctl->stats.switch_max_us = elapsed_us;
+
+    if (ctl->op == OP_MODE) {
+        ctl->success = true;
+        finish(radio, ctl);
+    } else if (ctl->phase == PHASE_ENTER) {
+        send_command(radio, ctl);
+    } else {
+        finish(radio, ctl);
+    }
+}
 
-    switch (mode) {
-        default:
-        case MODE_NORMAL:
-            gpio_put(radio->m0_pin, false);
-            gpio_put(radio->m1_pin, false);
+void radio_task(radio_inst_t const *radio) {
+    radio_ctl_t *ctl = get_ctl(radio);
+
+    switch (ctl->step) {
+        case STEP_IDLE:
             break;
 
-        case MODE_WAKE_UP:
-            gpio_put(radio->m0_pin, true);
-            gpio_put(radio->m1_pin, false);
+        case STEP_DRAIN:
+            if (!uart_tx_idle(radio->uart))
+                break;
+
+            // Configuration always happens at 9600 8N1
+            if (ctl->op != OP_MODE && ctl->phase == PHASE_ENTER)
+                set_radio_uart_config_mode(radio);
+
+            ctl->step = STEP_AUX_BEFORE;
+            arm_timer(ctl, RADIO_AUX_TIMEOUT_US);
             break;
 
-        case MODE_POWER_SAVING:
-            gpio_put(radio->m0_pin, false);
-            gpio_put(radio->m1_pin, true);
+        case STEP_AUX_BEFORE:
+            // A stuck AUX line is not fatal, a missing response is detected later
+            if (hal_gpio_get(radio->aux_pin) || ctl->timer_fired) {
+                ctl->step = STEP_GUARD;
+                arm_timer(ctl, RADIO_GUARD_US);
+            }
             break;
 
-        case MODE_SLEEP:
-            gpio_put(radio->m0_pin, true);
-            gpio_put(radio->m1_pin, true);
+        case STEP_GUARD:
+            if (ctl->timer_fired) {
+                put_mode_pins(radio, ctl->mode);
+                ctl->step = STEP_AUX_AFTER;
+                arm_timer(ctl, RADIO_AUX_TIMEOUT_US);
+            }
+            break;
+
+        case STEP_AUX_AFTER:
+            if (hal_gpio_get(radio->aux_pin) || ctl->timer_fired) {
+                ctl->step = STEP_SETTLE;
+                arm_timer(ctl, RADIO_SETTLE_US);
+            }
+            break;
+
+        case STEP_SETTLE:
+            if (ctl->timer_fired)
+                switch_done(radio, ctl);
+            break;
+
+        case STEP_RESPONSE:
+            if (collect_response(radio, ctl)) {
+                // The next command goes out in the same MODE_SLEEP window
+                if (ctl->success && ++ctl->op_index < ctl->op_count) {
+                    send_command(radio, ctl);
+                } else {
+                    ctl->phase = PHASE_LEAVE;
+                    begin_switch(ctl, MODE_NORMAL);
+                }
+            } else if (ctl->timer_fired) {
+                ctl->success = false;
+                ctl->phase = PHASE_LEAVE;
+                begin_switch(ctl, MODE_NORMAL);
+            }
             break;
     }
+}
 
-    wait_aux_high(radio);
-    sleep_ms(50); // Takes a little while to start its response
+// No data may be queued while an operation is running
+bool radio_is_busy(radio_inst_t const *radio) {
+    return get_ctl(radio)->step != STEP_IDLE;
 }
 
-void wait_aux_high(radio_inst_t const *radio) {
-    while (gpio_get(radio->aux_pin) == false);
+// Received bytes belong to a configuration response, not to the host
+bool radio_owns_rx(radio_inst_t const *radio) {
+    return get_ctl(radio)->step == STEP_RESPONSE;
 }
 
-void set_radio_uart_config_mode(radio_inst_t const *radio) {
-    set_radio_uart(radio, RADIO_PARAM_SPED_UART_BAUD_9600 | RADIO_PARAM_SPED_UART_MODE_8N1);
+// Mode the module is in, or is switching to while busy
+operating_mode_t radio_get_mode(radio_inst_t const *radio) {
+    return get_ctl(radio)->mode;
 }
 
-void set_radio_uart(radio_inst_t const *radio, uint8_t sped) {
-    // Baud rate
+radio_boot_t radio_get_boot(radio_inst_t const *radio) {
+    return get_ctl(radio)->boot;
+}
+
+void radio_get_stats(radio_inst_t const *radio, radio_stats_t *stats) {
+    *stats = get_ctl(radio)->stats;
+}
+
+// Parameters as of the last successful read or write, without touching the module
+bool get_parameters(radio_inst_t const *radio, parameters_t *params) {
+    radio_ctl_t *ctl = get_ctl(radio);
+
+    if (!ctl->snapshot_valid)
+        return false;
+
+    *params = ctl->snapshot;
+    return true;
+}
+
+static bool begin(radio_inst_t const *radio, radio_op_t op, radio_callback_t callback, void *user_data) {
+    radio_ctl_t *ctl = get_ctl(radio);
+
+    if (ctl->step != STEP_IDLE)
+        return false;
+
+    ctl->op = op;
+    ctl->phase = PHASE_ENTER;
+    ctl->success = false;
+    ctl->callback = callback;
+    ctl->user_data = user_data;
+    return true;
+}
+
+static void begin_config(radio_ctl_t *ctl, radio_register_op_t *ops, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+        ops[i].done = false;
+
+    ctl->ops = ops;
+    ctl->op_count = count;
+    ctl->op_index = 0;
+    ctl->touched = false;
+    begin_switch(ctl, MODE_SLEEP);
+}
+
+bool read_parameters_async(radio_inst_t const *radio, radio_callback_t callback, void *user_data) {
+    if (!begin(radio, OP_CONFIG, callback, user_data))
+        return false;
+
+    radio_ctl_t *ctl = get_ctl(radio);
+    ctl->single.command = RADIO_COMMAND_READ_PARAMS;
+    ctl->single.address = 0x00;
+    ctl->single.len = sizeof(parameters_t);
+    begin_config(ctl, &ctl->single, 1);
+    return true;
+}
+
+bool write_parameters_async(radio_inst_t const *radio, parameters_t const *params, bool save,
+                            radio_callback_t callback, void *user_data) {
+    if (!begin(radio, OP_CONFIG, callback, user_data))
+        return false;
+
+    radio_ctl_t *ctl = get_ctl(radio);
+    ctl->single.command = save ? RADIO_COMMAND_WRITE_PARAMS_SAVE : RADIO_COMMAND_WRITE_PARAMS_NOSAVE;
+    ctl->single.address = 0x00;
+    ctl->single.len = sizeof(parameters_t);
+    memcpy(ctl->single.data, params, sizeof(parameters_t));
+    begin_config(ctl, &ctl->single, 1);
+    return true;
+}
+
+// Runs several register commands, partial ranges included, inside a single
+// MODE_SLEEP window. The commands stay with the caller until the callback,
+// which gets the parameters once every command went through. The batch stops
+// at the first command the module rejects, done tells which ones it applied.
+bool radio_batch_async(radio_inst_t const *radio, radio_register_op_t *ops, uint32_t count,
+                       radio_callback_t callback, void *user_data) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (ops[i].len == 0 || ops[i].address + ops[i].len > RADIO_REGISTERS)
+            return false;
+    }
+
+    if (count == 0 || !begin(radio, OP_CONFIG, callback, user_data))
+        return false;
+
+    begin_config(get_ctl(radio), ops, count);
+    return true;
+}
+
+bool set_operating_mode_async(radio_inst_t const *radio, operating_mode_t mode,
+                              radio_callback_t callback, void *user_data) {
+    if (!begin(radio, OP_MODE, callback, user_data))
+        return false;
+
+    begin_switch(get_ctl(radio), mode);
+    return true;
+}
+
+static void read_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    (void) user_data;
+
+    get_ctl(radio)->boot = success ? RADIO_BOOT_READ : RADIO_BOOT_ABSENT;
+    if (success)
+        radio_store_save(radio, params);
+}
+
+// A module holding other parameters than the cached ones already runs on
+// them, the read back reconfigured the data path. The cache follows it.
+static void verify_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    radio_ctl_t *ctl = get_ctl(radio);
+    parameters_t cached;
+    (void) user_data;
+
+    if (!success) {
+        ctl->boot = RADIO_BOOT_NO_ANSWER;
+        radio_store_forget(radio);
+        return;
+    }
+
+    if (radio_store_load(radio, &cached) && memcmp(&cached, params, sizeof(cached)) == 0) {
+        ctl->boot = RADIO_BOOT_VERIFIED;
+        return;
+    }
+
+    ctl->boot = RADIO_BOOT_MISMATCH;
+    radio_store_save(radio, params);
+}
+
+//--------------------------------------------------------------------+
+// Blocking wrappers, only meant for start-up
+//--------------------------------------------------------------------+
+
+typedef struct {
+    bool done;
+    bool success;
+    parameters_t *params;
+} radio_result_t;
+
+static void blocking_cb(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    (void) radio;
+    radio_result_t *result = user_data;
+
+    result->done = true;
+    result->success = success;
+    if (params && result->params)
+        *result->params = *params;
+}
+
+static bool run_blocking(radio_inst_t const *radio, radio_result_t *result) {
+    while (!result->done) {
+        radio_task(radio);
+        hal_idle();
+    }
+
+    return result->success;
+}
+
+bool read_parameters(radio_inst_t const *radio, parameters_t *params) {
+    radio_result_t result = {.params = params};
+
+    if (!read_parameters_async(radio, blocking_cb, &result))
+        return false;
+
+    return run_blocking(radio, &result);
+}
+
+bool write_parameters(radio_inst_t const *radio, parameters_t const *params, bool save) {
+    radio_result_t result = {0};
+
+    if (!write_parameters_async(radio, params, save, blocking_cb, &result))
+        return false;
+
+    return run_blocking(radio, &result);
+}
+
+void set_operating_mode(radio_inst_t const *radio, operating_mode_t mode) {
+    radio_result_t result = {0};
+
+    if (set_operating_mode_async(radio, mode, blocking_cb, &result))
+        run_blocking(radio, &result);
+}
+
+uint32_t get_packet_length(uint8_t opt1) {
+    switch (opt1 & RADIO_PARAM_OPT1_PACKET_LEN_MASK) {
+        case RADIO_PARAM_OPT1_PACKET_LEN_128:
+            return 128;
+
+        case RADIO_PARAM_OPT1_PACKET_LEN_64:
+            return 64;
+
+        case RADIO_PARAM_OPT1_PACKET_LEN_32:
+            return 32;
+
+        default:
+            return 200;
+    }
+}
+
+uint get_uart_baud(uint8_t sped) {
     switch (sped & RADIO_PARAM_SPED_UART_BAUD_MASK) {
         case RADIO_PARAM_SPED_UART_BAUD_1200:
-            uart_init(radio->uart, 1200);
-            break;
+            return 1200;
 
         case RADIO_PARAM_SPED_UART_BAUD_2400:
-            uart_init(radio->uart, 2400);
-            break;
+            return 2400;
 
         case RADIO_PARAM_SPED_UART_BAUD_4800:
-            uart_init(radio->uart, 4800);
-            break;
+            return 4800;
 
         case RADIO_PARAM_SPED_UART_BAUD_19200:
-            uart_init(radio->uart, 19200);
-            break;
+            return 19200;
 
         case RADIO_PARAM_SPED_UART_BAUD_38400:
-            uart_init(radio->uart, 38400);
-            break;
+            return 38400;
 
         case RADIO_PARAM_SPED_UART_BAUD_57600:
-            uart_init(radio->uart, 57600);
-            break;
+            return 57600;
 
         case RADIO_PARAM_SPED_UART_BAUD_115200:
-            uart_init(radio->uart, 115200);
-            break;
+            return 115200;
 
         default:
-            uart_init(radio->uart, 9600);
-            break;
+            return 9600;
+    }
+}
+
+uint32_t get_air_data_rate(uint8_t sped) {
+    switch (sped & RADIO_PARAM_SPED_DATA_RATE_MASK) {
+        case RADIO_PARAM_SPED_DATA_RATE_4800:
+            return 4800;
+
+        case RADIO_PARAM_SPED_DATA_RATE_9600:
+            return 9600;
+
+        case RADIO_PARAM_SPED_DATA_RATE_19200:
+            return 19200;
+
+        case RADIO_PARAM_SPED_DATA_RATE_38400:
+            return 38400;
+
+        case RADIO_PARAM_SPED_DATA_RATE_62500:
+            return 62500;
+
+        default:
+            return 2400;
     }
+}
+
+void wait_aux_high(radio_inst_t const *radio) {
+    while (hal_gpio_get(radio->aux_pin) == false)
+        hal_idle();
+}
+
+void set_radio_uart_config_mode(radio_inst_t const *radio) {
+    set_radio_uart(radio, RADIO_PARAM_SPED_UART_BAUD_9600 | RADIO_PARAM_SPED_UART_MODE_8N1);
+}
+
+void set_radio_uart(radio_inst_t const *radio, uint8_t sped) {
+    // Queued data must leave at the old baud rate
+    uart_tx_flush_blocking(radio->uart);
+
+    uint baud = get_uart_baud(sped);
+    hal_parity_t parity;
 
     // Parity
     switch (sped & RADIO_PARAM_SPED_UART_MODE_MASK) {
         case RADIO_PARAM_SPED_UART_MODE_8E1:
-            uart_set_format(radio->uart, 8, 1, UART_PARITY_EVEN);
+            parity = HAL_PARITY_EVEN;
             break;
 
         case RADIO_PARAM_SPED_UART_MODE_8O1:
-            uart_set_format(radio->uart, 8, 1, UART_PARITY_ODD);
+            parity = HAL_PARITY_ODD;
             break;
 
         default:
-            uart_set_format(radio->uart, 8, 1, UART_PARITY_NONE);
+            parity = HAL_PARITY_NONE;
             break;
     }
+
+    hal_uart_configure(radio->uart, baud, parity);
+
+    // Reconfiguring resets the interrupt mask
+    uart_rx_init(radio->uart);
+    uart_tx_init(radio->uart);
 }
\ No newline at end of file
@@ -78,7 +78,7 @@
 #define RADIO_DEFAULT_UART_MODE       RADIO_PARAM_SPED_UART_MODE_8N1
 #define RADIO_DEFAULT_UART_BAUD       RADIO_PARAM_SPED_UART_BAUD_9600
 
-#include <hardware/uart.h>
+#include "hal.h"
 
 /// Structure for a radio instance
 typedef struct {
@@ -108,14 +108,81 @@ typedef struct {
     uint8_t opt2;      ///< Various control options
 } parameters_t;
 
+/// Registers the configuration commands address, CRYPT_H and CRYPT_L follow
+/// parameters_t and read back as zero
+#define RADIO_REGISTERS     8
+
+/// One configuration command of a batch
+typedef struct {
+    uint8_t command;            ///< RADIO_COMMAND_READ_PARAMS or one of the writes
+    uint8_t address;            ///< First register
+    uint8_t len;                ///< Number of registers, address + len <= RADIO_REGISTERS
+    bool done;                  ///< Set once the module answered the command
+    uint8_t data[RADIO_REGISTERS];  ///< Values to write, then the values the module reported
+} radio_register_op_t;
+
+/// Mode switch counters, a configuration transaction takes two switches
+typedef struct {
+    uint32_t switches;
+    uint32_t switch_max_us;     ///< Longest switch, from the request to the module settling
+    uint64_t switch_us;         ///< Total time spent switching
+} radio_stats_t;
+
+/// How the parameters in use at start-up were obtained
+typedef enum {
+    RADIO_BOOT_READING = 0,     ///< Nothing cached, reading the module before using it
+    RADIO_BOOT_READ,            ///< Nothing cached, read from the module
+    RADIO_BOOT_VERIFYING,       ///< Cached ones in use, reading the module back
+    RADIO_BOOT_VERIFIED,        ///< The module holds the cached ones
+    RADIO_BOOT_MISMATCH,        ///< It held others, they replaced the cached ones
+    RADIO_BOOT_NO_ANSWER,       ///< It did not answer the read back
+    RADIO_BOOT_ABSENT,          ///< Nothing cached and no answer, no module there
+} radio_boot_t;
+
+/// Invoked from radio_task() when an asynchronous operation completes, params
+/// holds the parameters reported by the module and is NULL for mode switches
+typedef void (*radio_callback_t)(radio_inst_t const *radio, bool success, parameters_t const *params,
+                                 void *user_data);
+
 bool radio_init(radio_inst_t const *radio);
 
+void radio_task(radio_inst_t const *radio);
+
+bool radio_is_busy(radio_inst_t const *radio);
+
+bool radio_owns_rx(radio_inst_t const *radio);
+
+operating_mode_t radio_get_mode(radio_inst_t const *radio);
+
+radio_boot_t radio_get_boot(radio_inst_t const *radio);
+
+void radio_get_stats(radio_inst_t const *radio, radio_stats_t *stats);
+
+bool get_parameters(radio_inst_t const *radio, parameters_t *params);
+
+bool read_parameters_async(radio_inst_t const *radio, radio_callback_t callback, void *user_data);
+
+bool write_parameters_async(radio_inst_t const *radio, parameters_t const *params, bool save,
+                            radio_callback_t callback, void *user_data);
+
+bool radio_batch_async(radio_inst_t const *radio, radio_register_op_t *ops, uint32_t count,
+                       radio_callback_t callback, void *user_data);
+
+bool set_operating_mode_async(radio_inst_t const *radio, operating_mode_t mode,
+                              radio_callback_t callback, void *user_data);
+
 bool read_parameters(radio_inst_t const *radio, parameters_t *params);
 
 bool write_parameters(radio_inst_t const *radio, parameters_t const *params, bool save);
 
 void set_operating_mode(radio_inst_t const *radio, operating_mode_t mode);
 
+uint32_t get_packet_length(uint8_t opt1);
+
+uint get_uart_baud(uint8_t sped);
+
+uint32_t get_air_data_rate(uint8_t sped);
+
 void wait_aux_high(radio_inst_t const *radio);
 
 void set_radio_uart_config_mode(radio_inst_t const *radio);
@@ -0,0 +1,335 @@
+#include <stddef.h>
+
+#include "radio_adapt.h"
+#include "radio_flow.h"
+#include "radio_frame.h"
+#include "radio_rssi.h"
+
+#define CONTROL_LEN 3
+#define RATES (sizeof(sensitivity_dbm) / sizeof(sensitivity_dbm[0]))
+
+// Receiver sensitivity at each air data rate from 2.4k to 62.5k, in dBm
+static int16_t const sensitivity_dbm[] = {-129, -126, -123, -120, -117, -114};
+
+// Output at each TX power setting from 22 dBm down to 10 dBm
+static int8_t const power_dbm[] = {22, 17, 13, 10};
+
+typedef struct {
+    radio_adapt_stats_t stats;
+    bool controller;                ///< This end proposes the changes
+    uint8_t control_pending;        ///< Control message type to send, 0 for none
+    uint8_t next_rate;              ///< Settings proposed or agreed on
+    uint8_t next_power;
+    uint8_t prev_rate;              ///< Settings to go back to
+    uint8_t prev_power;
+    bool ack_needed;                ///< Following a request, switch once the RATE_ACK is on air
+    bool ack_sent;
+    bool writing;
+    bool reverting;
+    uint32_t attempts;
+    uint64_t since_us;              ///< Request sent or probation started
+    uint32_t good_windows;
+
+    // Counters at the start of the window
+    uint32_t base_packets;
+    int32_t base_sum_dbm;
+    uint32_t base_datagrams;
+    uint32_t base_lost;
+} radio_adapt_t;
+
+static radio_adapt_t radio_adapt[NUM_UARTS];
+
+static radio_adapt_t *get_adapt(radio_inst_t const *radio) {
+    return &radio_adapt[hal_uart_index(radio->uart)];
+}
+
+static uint32_t rate_index(uint8_t rate) {
+    return rate < RADIO_PARAM_SPED_DATA_RATE_2400 ? 0 : rate - RADIO_PARAM_SPED_DATA_RATE_2400;
+}
+
+static radio_adapt_state_t idle_state(radio_adapt_t const *adapt) {
+    return adapt->controller ? RADIO_ADAPT_MONITORING : RADIO_ADAPT_OFF;
+}
+
+static void start_window(radio_inst_t const *radio, radio_adapt_t *adapt) {
+    radio_rssi_stats_t rssi;
+    radio_frame_stats_t frame;
+    radio_rssi_get_stats(radio, &rssi);
+    radio_frame_get_stats(radio, &frame);
+
+    adapt->base_packets = rssi.packets;
+    adapt->base_sum_dbm = rssi.sum_dbm;
+    adapt->base_datagrams = frame.datagrams_received;
+    adapt->base_lost = frame.lost + frame.incomplete;
+}
+
+static void switch_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    radio_adapt_t *adapt = get_adapt(radio);
+    (void) user_data;
+
+    adapt->writing = false;
+    if (success) {
+        adapt->stats.data_rate = params->sped & RADIO_PARAM_SPED_DATA_RATE_MASK;
+        adapt->stats.tx_power = params->opt1 & RADIO_PARAM_OPT1_TX_POWER_MASK;
+    }
+
+    if (!success || adapt->reverting) {
+        adapt->reverting = false;
+        adapt->stats.state = idle_state(adapt);
+        start_window(radio, adapt);
+        return;
+    }
+
+    // Faster, or as fast with less power
+    if (adapt->next_rate > adapt->prev_rate || (adapt->next_rate == adapt->prev_rate &&
+                                                adapt->next_power > adapt->prev_power))
+        adapt->stats.steps_up++;
+    else
+        adapt->stats.steps_down++;
+
+    adapt->stats.state = RADIO_ADAPT_PROBATION;
+    adapt->control_pending = RADIO_FRAME_CONTROL_RATE_CHECK;
+    adapt->since_us = hal_time_us();
+}
+
+static bool apply(radio_inst_t const *radio, radio_adapt_t *adapt) {
+    parameters_t params;
+    if (!get_parameters(radio, &params))
+        return false;
+
+    params.sped = (params.sped & ~RADIO_PARAM_SPED_DATA_RATE_MASK) | adapt->next_rate;
+    params.opt1 = (params.opt1 & ~RADIO_PARAM_OPT1_TX_POWER_MASK) | adapt->next_power;
+
+    adapt->writing = write_parameters_async(radio, &params, false, switch_done, NULL);
+    return adapt->writing;
+}
+
+static void request(radio_adapt_t *adapt, uint8_t rate, uint8_t power) {
+    adapt->prev_rate = adapt->stats.data_rate;
+    adapt->prev_power = adapt->stats.tx_power;
+    adapt->next_rate = rate;
+    adapt->next_power = power;
+    adapt->stats.state = RADIO_ADAPT_REQUESTING;
+    adapt->control_pending = RADIO_FRAME_CONTROL_RATE_REQUEST;
+    adapt->attempts = 1;
+    adapt->since_us = hal_time_us();
+}
+
+// Judges the link once enough packets came in, steps down right away and up
+// only after RADIO_ADAPT_UP_WINDOWS good windows
+static void evaluate(radio_inst_t const *radio, radio_adapt_t *adapt) {
+    radio_rssi_stats_t rssi;
+    radio_frame_stats_t frame;
+    radio_rssi_get_stats(radio, &rssi);
+    radio_frame_get_stats(radio, &frame);
+
+    // The host reset the RSSI counters
+    if (rssi.packets < adapt->base_packets) {
+        start_window(radio, adapt);
+        return;
+    }
+
+    uint32_t packets = rssi.packets - adapt->base_packets;
+    if (packets < RADIO_ADAPT_MIN_PACKETS)
+        return;
+
+    int32_t average_dbm = (rssi.sum_dbm - adapt->base_sum_dbm) / (int32_t) packets;
+    uint32_t datagrams = frame.datagrams_received - adapt->base_datagrams;
+    uint32_t lost = frame.lost + frame.incomplete - adapt->base_lost;
+    start_window(radio, adapt);
+
+    uint8_t rate = adapt->stats.data_rate;
+    uint8_t power = adapt->stats.tx_power;
+    int32_t margin_db = average_dbm - sensitivity_dbm[rate_index(rate)];
+
+    adapt->stats.margin_db = (int8_t) (margin_db < INT8_MIN ? INT8_MIN : margin_db > INT8_MAX ? INT8_MAX : margin_db);
+    adapt->stats.loss_permille = datagrams + lost > 0 ? lost * 1000 / (datagrams + lost) : 0;
+
+    // More power first, then a slower rate
+    if (adapt->stats.loss_permille > RADIO_ADAPT_DOWN_LOSS_PERMILLE || margin_db < RADIO_ADAPT_DOWN_MARGIN_DB) {
+        adapt->good_windows = 0;
+
+        if (power != RADIO_PARAM_OPT1_TX_POWER_22)
+            request(adapt, rate, power - 1);
+        else if (rate_index(rate) > 0)
+            request(adapt, RADIO_PARAM_SPED_DATA_RATE_2400 + rate_index(rate) - 1, power);
+
+        return;
+    }
+
+    if (adapt->stats.loss_permille > RADIO_ADAPT_UP_LOSS_PERMILLE || ++adapt->good_windows < RADIO_ADAPT_UP_WINDOWS)
+        return;
+
+    // A faster rate first, then less power
+    adapt->good_windows = 0;
+
+    uint32_t index = rate_index(rate);
+    if (index + 1 < RATES && average_dbm - sensitivity_dbm[index + 1] >= RADIO_ADAPT_UP_MARGIN_DB) {
+        request(adapt, RADIO_PARAM_SPED_DATA_RATE_2400 + index + 1, power);
+    } else if (power != RADIO_PARAM_OPT1_TX_POWER_10 &&
+               margin_db - (power_dbm[power] - power_dbm[power + 1]) >= RADIO_ADAPT_UP_MARGIN_DB) {
+        request(adapt, rate, power + 1);
+    }
+}
+
+void radio_adapt_init(radio_inst_t const *radio) {
+    *get_adapt(radio) = (radio_adapt_t) {0};
+}
+
+// Needs framed mode and the RSSI byte, on both ends for the follower
+bool radio_adapt_set_enabled(radio_inst_t const *radio, bool enabled) {
+    radio_adapt_t *adapt = get_adapt(radio);
+
+    if (!enabled) {
+        adapt->controller = false;
+        if (adapt->stats.state == RADIO_ADAPT_MONITORING || adapt->stats.state == RADIO_ADAPT_REQUESTING)
+            adapt->stats.state = RADIO_ADAPT_OFF;
+
+        return true;
+    }
+
+    parameters_t params;
+    if (!radio_frame_enabled(radio) || !get_parameters(radio, &params) ||
+        (params.opt2 & RADIO_PARAM_OPT2_RSSI_BYTE_MASK) != RADIO_PARAM_OPT2_RSSI_BYTE_ENABLE)
+        return false;
+
+    adapt->controller = true;
+    adapt->stats.data_rate = params.sped & RADIO_PARAM_SPED_DATA_RATE_MASK;
+    adapt->stats.tx_power = params.opt1 & RADIO_PARAM_OPT1_TX_POWER_MASK;
+    adapt->good_windows = 0;
+
+    if (adapt->stats.state == RADIO_ADAPT_OFF)
+        adapt->stats.state = RADIO_ADAPT_MONITORING;
+
+    start_window(radio, adapt);
+    return true;
+}
+
+void radio_adapt_task(radio_inst_t const *radio) {
+    radio_adapt_t *adapt = get_adapt(radio);
+    uint64_t now = hal_time_us();
+
+    if (adapt->controller && !radio_frame_enabled(radio))
+        radio_adapt_set_enabled(radio, false);
+
+    switch (adapt->stats.state) {
+        case RADIO_ADAPT_MONITORING:
+            evaluate(radio, adapt);
+            break;
+
+        case RADIO_ADAPT_REQUESTING:
+            if (now - adapt->since_us < RADIO_ADAPT_REQUEST_TIMEOUT_US)
+                break;
+
+            if (adapt->attempts == RADIO_ADAPT_REQUEST_ATTEMPTS) {
+                adapt->stats.unanswered++;
+                adapt->stats.state = RADIO_ADAPT_MONITORING;
+                start_window(radio, adapt);
+                break;
+            }
+
+            adapt->control_pending = RADIO_FRAME_CONTROL_RATE_REQUEST;
+            adapt->attempts++;
+            adapt->since_us = now;
+            break;
+
+        case RADIO_ADAPT_SWITCHING:
+            // Whatever the module holds would be lost in the switch
+            if (!adapt->writing && (!adapt->ack_needed || adapt->ack_sent) && !radio_is_busy(radio) &&
+                radio_flow_drained(radio))
+                apply(radio, adapt);
+            break;
+
+        case RADIO_ADAPT_PROBATION:
+            if (now - adapt->since_us < RADIO_ADAPT_PROBATION_US)
+                break;
+
+            adapt->stats.reverts++;
+            adapt->next_rate = adapt->prev_rate;
+            adapt->next_power = adapt->prev_power;
+            adapt->reverting = true;
+            adapt->ack_needed = false;
+            adapt->stats.state = RADIO_ADAPT_SWITCHING;
+            break;
+
+        default:
+            break;
+    }
+}
+
+// A fragment came in, at the current settings
+void radio_adapt_heard(radio_inst_t const *radio) {
+    radio_adapt_t *adapt = get_adapt(radio);
+
+    if (adapt->stats.state != RADIO_ADAPT_PROBATION)
+        return;
+
+    adapt->stats.state = idle_state(adapt);
+    adapt->good_windows = 0;
+    start_window(radio, adapt);
+}
+
+// Rate control messages: type, RADIO_PARAM_SPED_DATA_RATE_*, RADIO_PARAM_OPT1_TX_POWER_*
+void radio_adapt_control(radio_inst_t const *radio, uint8_t const *control, uint32_t len) {
+    radio_adapt_t *adapt = get_adapt(radio);
+    if (len < CONTROL_LEN)
+        return;
+
+    uint8_t rate = control[1] & RADIO_PARAM_SPED_DATA_RATE_MASK;
+    uint8_t power = control[2] & RADIO_PARAM_OPT1_TX_POWER_MASK;
+
+    switch (control[0]) {
+        case RADIO_FRAME_CONTROL_RATE_REQUEST: {
+            parameters_t params;
+            if (adapt->stats.state == RADIO_ADAPT_SWITCHING || !get_parameters(radio, &params))
+                break;
+
+            adapt->prev_rate = params.sped & RADIO_PARAM_SPED_DATA_RATE_MASK;
+            adapt->prev_power = params.opt1 & RADIO_PARAM_OPT1_TX_POWER_MASK;
+            adapt->stats.data_rate = adapt->prev_rate;
+            adapt->stats.tx_power = adapt->prev_power;
+            adapt->next_rate = rate;
+            adapt->next_power = power;
+            adapt->ack_needed = true;
+            adapt->ack_sent = false;
+            adapt->reverting = false;
+            adapt->control_pending = RADIO_FRAME_CONTROL_RATE_ACK;
+            adapt->stats.state = RADIO_ADAPT_SWITCHING;
+            break;
+        }
+
+        case RADIO_FRAME_CONTROL_RATE_ACK:
+            if (adapt->stats.state != RADIO_ADAPT_REQUESTING || rate != adapt->next_rate || power != adapt->next_power)
+                break;
+
+            adapt->ack_needed = false;
+            adapt->reverting = false;
+            adapt->stats.state = RADIO_ADAPT_SWITCHING;
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Control message to send next, returns its length or 0 for none
+uint32_t radio_adapt_stage_control(radio_inst_t const *radio, uint8_t *control) {
+    radio_adapt_t *adapt = get_adapt(radio);
+    if (adapt->control_pending == 0)
+        return 0;
+
+    control[0] = adapt->control_pending;
+    control[1] = adapt->next_rate;
+    control[2] = adapt->next_power;
+    adapt->control_pending = 0;
+    return CONTROL_LEN;
+}
+
+void radio_adapt_control_sent(radio_inst_t const *radio, uint8_t type) {
+    if (type == RADIO_FRAME_CONTROL_RATE_ACK)
+        get_adapt(radio)->ack_sent = true;
+}
+
+void radio_adapt_get_stats(radio_inst_t const *radio, radio_adapt_stats_t *stats) {
+    *stats = get_adapt(radio)->stats;
+}
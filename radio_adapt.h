@@ -0,0 +1,60 @@
+#ifndef _LORA_BRIDGE_RADIO_ADAPT_H_
+#define _LORA_BRIDGE_RADIO_ADAPT_H_
+
+#include "radio.h"
+
+// Closed loop over the air data rate and the TX power, framed mode with the
+// RSSI byte enabled. The end running the controller judges the link from what
+// it receives and proposes a step with RATE_REQUEST, any framed bridge answers
+// RATE_ACK. Both ends switch once the answer is on air and announce it with
+// RATE_CHECK at the new settings, each goes back to the old ones unless it
+// hears the other within RADIO_ADAPT_PROBATION_US.
+
+#define RADIO_ADAPT_MIN_PACKETS         16      ///< Packets needed to judge the link
+#define RADIO_ADAPT_UP_MARGIN_DB        12      ///< Over the sensitivity of the faster rate
+#define RADIO_ADAPT_DOWN_MARGIN_DB      6       ///< Over the sensitivity of the current rate
+#define RADIO_ADAPT_UP_LOSS_PERMILLE    20
+#define RADIO_ADAPT_DOWN_LOSS_PERMILLE  100
+#define RADIO_ADAPT_UP_WINDOWS          2       ///< Good windows in a row before stepping up
+#define RADIO_ADAPT_REQUEST_TIMEOUT_US  (2 * 1000 * 1000)
+#define RADIO_ADAPT_REQUEST_ATTEMPTS    3
+#define RADIO_ADAPT_PROBATION_US        (10 * 1000 * 1000)
+
+typedef enum {
+    RADIO_ADAPT_OFF = 0,
+    RADIO_ADAPT_MONITORING,
+    RADIO_ADAPT_REQUESTING,     ///< Waiting for RATE_ACK
+    RADIO_ADAPT_SWITCHING,      ///< Waiting for the module to take the new settings
+    RADIO_ADAPT_PROBATION,      ///< Waiting to hear the other end at the new settings
+} radio_adapt_state_t;
+
+/// Controller state and counters, readable over HID
+typedef struct {
+    uint8_t state;              ///< radio_adapt_state_t
+    uint8_t data_rate;          ///< RADIO_PARAM_SPED_DATA_RATE_*
+    uint8_t tx_power;           ///< RADIO_PARAM_OPT1_TX_POWER_*
+    int8_t margin_db;           ///< Over the sensitivity of the current rate, last window
+    uint32_t loss_permille;     ///< Datagrams lost, last window
+    uint32_t steps_up;          ///< Faster rate or lower power
+    uint32_t steps_down;        ///< Slower rate or higher power
+    uint32_t unanswered;        ///< Requests the peer never acknowledged
+    uint32_t reverts;           ///< Switches undone, the ends did not hear each other
+} radio_adapt_stats_t;
+
+void radio_adapt_init(radio_inst_t const *radio);
+
+bool radio_adapt_set_enabled(radio_inst_t const *radio, bool enabled);
+
+void radio_adapt_task(radio_inst_t const *radio);
+
+void radio_adapt_heard(radio_inst_t const *radio);
+
+void radio_adapt_control(radio_inst_t const *radio, uint8_t const *control, uint32_t len);
+
+uint32_t radio_adapt_stage_control(radio_inst_t const *radio, uint8_t *control);
+
+void radio_adapt_control_sent(radio_inst_t const *radio, uint8_t type);
+
+void radio_adapt_get_stats(radio_inst_t const *radio, radio_adapt_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_ADAPT_H_
@@ -0,0 +1,589 @@
+#include <memory.h>
+
+#include "radio_arq.h"
+#include "radio_frame.h"
+#include "radio_sched.h"
+
+#define SYNC_SIZE 2
+#define ACK_SIZE 4
+#define ACK_BITS 15         ///< Packets after the first missing one covered by the bitmap
+#define SLOT_MASK (RADIO_ARQ_MAX_WINDOW - 1)
+#define NOT_SENT UINT32_MAX
+
+/// Packet sent and kept until acknowledged
+typedef struct {
+    uint8_t data[RADIO_FRAME_MAX_PACKET];
+    uint32_t len;
+    bool acked;
+    bool lost;                      ///< Known missing, goes again before anything new
+    uint32_t retries;
+    uint32_t order;                 ///< Of its last transmission, tells which went out first
+} radio_arq_tx_slot_t;
+
+/// Packet received after a gap, waiting for the ones before it
+typedef struct {
+    uint8_t data[RADIO_FRAME_MAX_PACKET];
+    uint32_t len;
+    bool held;
+} radio_arq_rx_slot_t;
+
+typedef struct {
+    radio_arq_stats_t stats;
+    uint32_t packet_us;             ///< Air time of a full packet
+    uint32_t overhead_us;           ///< Expected from the end of a poll on air to its ack
+    uint32_t min_rto_us;
+    uint32_t ack_delay_us;          ///< Quiet time before acknowledging packets without a poll
+
+    // Transmit
+    uint8_t base;                   ///< Oldest packet not acknowledged
+    uint8_t next;                   ///< Sequence number of the next new packet
+    uint32_t order;
+    bool sync_due;
+    uint32_t sync_attempts;
+    uint64_t sync_sent_us;
+    bool polling;                   ///< Nothing new goes out until the poll is answered
+    bool poll_fresh;                ///< First transmission of the poll, its round trip is a sample
+    uint8_t poll_seq;
+    uint32_t poll_order;
+    uint64_t poll_sent_us;
+    uint64_t poll_air_us;           ///< End of the poll on air, as scheduled
+    bool estimated;
+    uint32_t srtt_us;
+    uint32_t turnaround_us;         ///< Smoothed, end of the poll on air to its ack
+    uint32_t rttvar_us;
+    uint32_t rto_us;
+    radio_arq_tx_slot_t tx[RADIO_ARQ_MAX_WINDOW];
+
+    // Receive
+    bool synced;
+    uint8_t rx_next;                ///< Next packet for the host
+    uint8_t rx_floor;               ///< The sender gave up on the ones before
+    bool sync_ack_due;
+    uint8_t sync_seq;
+    bool ack_due;
+    uint64_t ack_at_us;
+    radio_arq_rx_slot_t rx[RADIO_ARQ_MAX_WINDOW];
+} radio_arq_t;
+
+static radio_arq_t radio_arq[NUM_UARTS];
+
+static radio_arq_t *get_arq(radio_inst_t const *radio) {
+    return &radio_arq[hal_uart_index(radio->uart)];
+}
+
+// Sequence numbers wrap, a comes before b when b is up to half the space ahead
+static bool seq_before(uint8_t a, uint8_t b) {
+    return (uint8_t) (b - a - 1) < 127;
+}
+
+static uint8_t in_flight(radio_arq_t const *arq) {
+    return arq->next - arq->base;
+}
+
+static bool seq_in_flight(radio_arq_t const *arq, uint8_t seq) {
+    return (uint8_t) (seq - arq->base) < in_flight(arq);
+}
+
+// CRC-16/CCITT-FALSE
+static uint16_t crc16(uint8_t const *data, uint32_t len) {
+    uint16_t crc = 0xFFFF;
+
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= data[i] << 8;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static uint16_t to_ms(uint64_t us) {
+    return us / 1000 > UINT16_MAX ? UINT16_MAX : (uint16_t) (us / 1000);
+}
+
+static void set_rto(radio_arq_t *arq, uint64_t rto_us) {
+    if (rto_us < arq->min_rto_us)
+        rto_us = arq->min_rto_us;
+    if (rto_us > RADIO_ARQ_MAX_RTO_US)
+        rto_us = RADIO_ARQ_MAX_RTO_US;
+
+    arq->rto_us = (uint32_t) rto_us;
+    arq->stats.rto_ms = to_ms(rto_us);
+}
+
+// Sequence number and distance to the oldest unacknowledged packet, then the
+// CRC over everything, on every transmission
+static void write_fields(radio_arq_t const *arq, uint8_t *packet, uint32_t len, uint8_t seq, bool poll) {
+    packet[RADIO_FRAME_HEADER_SIZE] = seq;
+    packet[RADIO_FRAME_HEADER_SIZE + 1] = (uint8_t) (seq - arq->base) | (poll ? RADIO_ARQ_POLL : 0);
+
+    uint16_t crc = crc16(packet, len - RADIO_ARQ_CRC_SIZE);
+    packet[len - 2] = crc & 0xFF;
+    packet[len - 1] = crc >> 8;
+}
+
+static void slide(radio_arq_t *arq) {
+    while (arq->base != arq->next && arq->tx[arq->base & SLOT_MASK].acked)
+        arq->base++;
+
+    if (arq->base == arq->next)
+        arq->polling = false;
+}
+
+static void start(radio_arq_t *arq) {
+    arq->base = arq->next;
+    arq->polling = false;
+    arq->sync_due = false;
+    arq->sync_attempts = 0;
+    arq->sync_sent_us = 0;
+    arq->stats.state = RADIO_ARQ_SYNCING;
+}
+
+void radio_arq_init(radio_inst_t const *radio) {
+    parameters_t defaults = {
+            .sped = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE,
+            .opt1 = RADIO_PARAM_OPT1_PACKET_LEN_200,
+    };
+
+    memset(get_arq(radio), 0, sizeof(radio_arq_t));
+    radio_arq_configure(radio, &defaults);
+}
+
+// Window and timeouts for the packet length and data rate, the turnaround is
+// measured again from here on
+void radio_arq_configure(radio_inst_t const *radio, parameters_t const *params) {
+    radio_arq_t *arq = get_arq(radio);
+    uint32_t packet_len = get_packet_length(params->opt1);
+    uint32_t ack_len = RADIO_FRAME_HEADER_SIZE + ACK_SIZE;
+    uint32_t baud = get_uart_baud(params->sped);
+    uint32_t ack_us = radio_sched_airtime_us(params->sped, ack_len);
+
+    // The poll leaves the receiving module, the ack crosses both bridges and the air
+    arq->packet_us = radio_sched_airtime_us(params->sped, packet_len);
+    arq->overhead_us = ack_us + (uint64_t) (packet_len + 2 * ack_len) * 10 * 1000000 / baud + RADIO_ARQ_TURNAROUND_US;
+    arq->ack_delay_us = arq->packet_us + (uint64_t) packet_len * 10 * 1000000 / baud + RADIO_ARQ_TURNAROUND_US;
+    arq->min_rto_us = ack_us + RADIO_ARQ_TURNAROUND_US;
+
+    uint32_t window = (RADIO_ARQ_WINDOW_FACTOR * arq->overhead_us + arq->packet_us - 1) / arq->packet_us;
+    uint32_t burst = RADIO_ARQ_MAX_BURST_US / arq->packet_us;
+    if (window > burst)
+        window = burst;
+    if (window > RADIO_ARQ_MAX_WINDOW)
+        window = RADIO_ARQ_MAX_WINDOW;
+    if (window < RADIO_ARQ_MIN_WINDOW)
+        window = RADIO_ARQ_MIN_WINDOW;
+
+    arq->stats.window = window;
+    arq->estimated = false;
+    set_rto(arq, 2 * (uint64_t) arq->overhead_us);
+}
+
+// Needs framed mode without targets, the peer must answer ARQ_SYNC
+bool radio_arq_set_enabled(radio_inst_t const *radio, bool enabled) {
+    radio_arq_t *arq = get_arq(radio);
+
+    if (!enabled) {
+        arq->stats.state = RADIO_ARQ_OFF;
+        arq->base = arq->next;
+        arq->polling = false;
+        arq->sync_due = false;
+        return true;
+    }
+
+    if (!radio_frame_enabled(radio) || radio_frame_addressed(radio))
+        return false;
+
+    if (arq->stats.state == RADIO_ARQ_OFF || arq->stats.state == RADIO_ARQ_UNSUPPORTED)
+        start(arq);
+
+    return true;
+}
+
+radio_arq_state_t radio_arq_state(radio_inst_t const *radio) {
+    return (radio_arq_state_t) get_arq(radio)->stats.state;
+}
+
+// Framing started over, so do both directions, the peer is synced again
+void radio_arq_reset(radio_inst_t const *radio) {
+    radio_arq_t *arq = get_arq(radio);
+
+    arq->synced = false;
+    arq->ack_due = false;
+    arq->sync_ack_due = false;
+    for (uint32_t i = 0; i < RADIO_ARQ_MAX_WINDOW; ++i)
+        arq->rx[i].held = false;
+
+    if (arq->stats.state != RADIO_ARQ_OFF)
+        start(arq);
+}
+
+void radio_arq_task(radio_inst_t const *radio) {
+    radio_arq_t *arq = get_arq(radio);
+    uint64_t now = hal_time_us();
+
+    if (arq->stats.state == RADIO_ARQ_OFF)
+        return;
+
+    if (!radio_frame_enabled(radio) || radio_frame_addressed(radio)) {
+        radio_arq_set_enabled(radio, false);
+        return;
+    }
+
+    // Keep asking until the peer answers
+    if (arq->stats.state == RADIO_ARQ_SYNCING && !arq->sync_due &&
+        (arq->sync_sent_us == 0 || now - arq->sync_sent_us >= RADIO_ARQ_SYNC_INTERVAL_US)) {
+        if (arq->sync_attempts == RADIO_ARQ_SYNC_ATTEMPTS) {
+            arq->stats.state = RADIO_ARQ_UNSUPPORTED;
+        } else {
+            arq->sync_due = true;
+            arq->sync_sent_us = now;
+            arq->sync_attempts++;
+        }
+    }
+
+    if (arq->stats.state != RADIO_ARQ_ACTIVE || !arq->polling || now < arq->poll_air_us + arq->rto_us)
+        return;
+
+    // The ack or the poll was lost, the oldest packet goes again as a poll
+    // and its ack tells what else is missing
+    arq->stats.timeouts++;
+    arq->polling = false;
+    set_rto(arq, 2 * (uint64_t) arq->rto_us);
+    arq->tx[arq->base & SLOT_MASK].lost = true;
+}
+
+// Whether a new packet may go out, retransmissions go first
+bool radio_arq_can_send(radio_inst_t const *radio) {
+    radio_arq_t const *arq = get_arq(radio);
+    return arq->stats.state == RADIO_ARQ_ACTIVE && !arq->polling && in_flight(arq) < arq->stats.window;
+}
+
+// Numbers a new packet of len bytes, link header and room for the fields
+// included, and keeps a copy. It polls when the window is full after it or
+// nothing more is waiting. Returns its length with the CRC.
+uint32_t radio_arq_seal(radio_inst_t const *radio, uint8_t *packet, uint32_t len, bool more) {
+    radio_arq_t *arq = get_arq(radio);
+    uint8_t seq = arq->next++;
+    radio_arq_tx_slot_t *slot = &arq->tx[seq & SLOT_MASK];
+
+    len += RADIO_ARQ_CRC_SIZE;
+    write_fields(arq, packet, len, seq, !more || in_flight(arq) == arq->stats.window);
+
+    memcpy(slot->data, packet, len);
+    slot->len = len;
+    slot->acked = false;
+    slot->lost = false;
+    slot->retries = 0;
+    slot->order = NOT_SENT;
+    arq->stats.packets_sent++;
+    return len;
+}
+
+// Copies the oldest lost packet to send again, the last one lost polls.
+// Returns its length or 0 for none.
+uint32_t radio_arq_stage_retransmit(radio_inst_t const *radio, uint8_t *packet) {
+    radio_arq_t *arq = get_arq(radio);
+    if (arq->stats.state != RADIO_ARQ_ACTIVE || arq->polling)
+        return 0;
+
+    for (uint8_t seq = arq->base; seq != arq->next; ++seq) {
+        radio_arq_tx_slot_t *slot = &arq->tx[seq & SLOT_MASK];
+        if (slot->acked || !slot->lost)
+            continue;
+
+        // The receiver skips it once the base field moves past
+        if (slot->retries == RADIO_ARQ_MAX_RETRIES) {
+            slot->acked = true;
+            slot->lost = false;
+            arq->stats.given_up++;
+            continue;
+        }
+
+        bool poll = true;
+        for (uint8_t later = seq + 1; later != arq->next; ++later) {
+            if (!arq->tx[later & SLOT_MASK].acked && arq->tx[later & SLOT_MASK].lost)
+                poll = false;
+        }
+
+        slot->lost = false;
+        slot->retries++;
+        slot->order = NOT_SENT;
+        arq->stats.retransmits++;
+        slide(arq);
+
+        memcpy(packet, slot->data, slot->len);
+        write_fields(arq, packet, slot->len, seq, poll);
+        return slot->len;
+    }
+
+    slide(arq);
+    return 0;
+}
+
+// The packet was written to the UART, a poll starts the wait for its ack.
+// Returns whether this was its first transmission.
+bool radio_arq_sent(radio_inst_t const *radio, uint8_t const *packet) {
+    radio_arq_t *arq = get_arq(radio);
+    uint8_t seq = packet[RADIO_FRAME_HEADER_SIZE];
+
+    // Acknowledged while it waited for credits
+    if (arq->stats.state != RADIO_ARQ_ACTIVE || !seq_in_flight(arq, seq))
+        return true;
+
+    radio_arq_tx_slot_t *slot = &arq->tx[seq & SLOT_MASK];
+    slot->order = ++arq->order;
+
+    if (packet[RADIO_FRAME_HEADER_SIZE + 1] & RADIO_ARQ_POLL) {
+        radio_sched_stats_t sched;
+        radio_sched_get_stats(radio, &sched);
+
+        arq->polling = true;
+        arq->poll_fresh = slot->retries == 0;
+        arq->poll_seq = seq;
+        arq->poll_order = slot->order;
+        arq->poll_sent_us = hal_time_us();
+        arq->poll_air_us = arq->poll_sent_us + sched.backlog_us;
+    }
+
+    return slot->retries == 0;
+}
+
+// RFC 6298 on the turnaround, the air time of the poll is known beforehand
+static void sample(radio_arq_t *arq, uint64_t now) {
+    uint32_t rtt = (uint32_t) (now - arq->poll_sent_us);
+    uint32_t turnaround = now > arq->poll_air_us ? (uint32_t) (now - arq->poll_air_us) : 0;
+
+    if (!arq->estimated) {
+        arq->srtt_us = rtt;
+        arq->turnaround_us = turnaround;
+        arq->rttvar_us = turnaround / 2;
+        arq->estimated = true;
+    } else {
+        uint32_t delta = arq->turnaround_us > turnaround ? arq->turnaround_us - turnaround :
+                         turnaround - arq->turnaround_us;
+
+        arq->rttvar_us = (3 * arq->rttvar_us + delta) / 4;
+        arq->turnaround_us = (7 * arq->turnaround_us + turnaround) / 8;
+        arq->srtt_us = (7 * (uint64_t) arq->srtt_us + rtt) / 8;
+    }
+
+    arq->stats.rtt_ms = to_ms(rtt);
+    arq->stats.srtt_ms = to_ms(arq->srtt_us);
+    arq->stats.rttvar_ms = to_ms(arq->rttvar_us);
+    arq->stats.rtt_samples++;
+    set_rto(arq, arq->turnaround_us + 4 * (uint64_t) arq->rttvar_us);
+}
+
+// Packets sent before the latest one acknowledged, or before an answered
+// poll, and still missing are lost
+static void ack_received(radio_arq_t *arq, uint8_t ack_next, uint16_t bitmap) {
+    uint64_t now = hal_time_us();
+
+    if (arq->stats.state != RADIO_ARQ_ACTIVE || seq_before(arq->next, ack_next))
+        return;
+
+    arq->stats.acks_received++;
+
+    // Built after the poll was on air
+    bool answered = arq->polling && now >= arq->poll_air_us;
+    uint32_t lost_order = answered ? arq->poll_order : 0;
+
+    for (uint8_t seq = arq->base; seq != arq->next; ++seq) {
+        radio_arq_tx_slot_t *slot = &arq->tx[seq & SLOT_MASK];
+        uint8_t bit = seq - ack_next - 1;
+
+        if (slot->acked || !(seq_before(seq, ack_next) || (bit < ACK_BITS && (bitmap >> bit) & 1)))
+            continue;
+
+        slot->acked = true;
+        slot->lost = false;
+        if (slot->order != NOT_SENT && slot->order - 1 > lost_order)
+            lost_order = slot->order - 1;
+    }
+
+    for (uint8_t seq = arq->base; seq != arq->next; ++seq) {
+        radio_arq_tx_slot_t *slot = &arq->tx[seq & SLOT_MASK];
+        if (!slot->acked && slot->order <= lost_order)
+            slot->lost = true;
+    }
+
+    // A poll sent again gives no sample, its answer still ends the backoff
+    if (answered) {
+        if (arq->poll_fresh && arq->tx[arq->poll_seq & SLOT_MASK].acked)
+            sample(arq, now);
+        else if (arq->estimated)
+            set_rto(arq, arq->turnaround_us + 4 * (uint64_t) arq->rttvar_us);
+        else
+            set_rto(arq, 2 * (uint64_t) arq->overhead_us);
+
+        arq->polling = false;
+    }
+
+    slide(arq);
+}
+
+// A reliable packet with its CRC, held until the ones before it are in
+bool radio_arq_receive(radio_inst_t const *radio, uint8_t const *packet, uint32_t len) {
+    radio_arq_t *arq = get_arq(radio);
+
+    if (len < RADIO_FRAME_HEADER_SIZE + RADIO_ARQ_OVERHEAD || len > RADIO_FRAME_MAX_PACKET ||
+        crc16(packet, len - RADIO_ARQ_CRC_SIZE) != (packet[len - 2] | packet[len - 1] << 8)) {
+        arq->stats.rx_crc_errors++;
+        return false;
+    }
+
+    uint8_t seq = packet[RADIO_FRAME_HEADER_SIZE];
+    uint8_t fields = packet[RADIO_FRAME_HEADER_SIZE + 1];
+    uint8_t floor = seq - (fields & RADIO_ARQ_BACK_MASK);
+    bool duplicate = false;
+
+    arq->stats.rx_packets++;
+
+    // Joined midway, or either end started over
+    if (!arq->synced) {
+        arq->synced = true;
+        arq->rx_next = floor;
+        arq->rx_floor = floor;
+    } else if (seq_before(arq->rx_floor, floor)) {
+        arq->rx_floor = floor;
+    }
+
+    radio_arq_rx_slot_t *slot = &arq->rx[seq & SLOT_MASK];
+    if ((uint8_t) (seq - arq->rx_next) < RADIO_ARQ_MAX_WINDOW) {
+        duplicate = slot->held;
+        if (!slot->held) {
+            memcpy(slot->data, packet, len);
+            slot->len = len;
+            slot->held = true;
+        }
+    } else {
+        // Handed on already and the ack went missing, or the host is not
+        // reading and there is no room: it comes again either way
+        duplicate = seq_before(seq, arq->rx_next);
+    }
+
+    if (duplicate)
+        arq->stats.rx_duplicates++;
+
+    uint64_t now = hal_time_us();
+    arq->ack_due = true;
+    arq->ack_at_us = (fields & RADIO_ARQ_POLL) || duplicate ? now : now + arq->ack_delay_us;
+    return true;
+}
+
+// Next packet in sequence for the host, returns its length or 0 while the
+// next one is missing
+uint32_t radio_arq_next(radio_inst_t const *radio, uint8_t const **packet) {
+    radio_arq_t *arq = get_arq(radio);
+    if (!arq->synced)
+        return 0;
+
+    while (seq_before(arq->rx_next, arq->rx_floor) && !arq->rx[arq->rx_next & SLOT_MASK].held) {
+        arq->rx_next++;
+        arq->stats.rx_skipped++;
+    }
+
+    radio_arq_rx_slot_t const *slot = &arq->rx[arq->rx_next & SLOT_MASK];
+    if (!slot->held)
+        return 0;
+
+    *packet = slot->data;
+    return slot->len;
+}
+
+void radio_arq_consume(radio_inst_t const *radio) {
+    radio_arq_t *arq = get_arq(radio);
+
+    arq->rx[arq->rx_next & SLOT_MASK].held = false;
+    arq->rx_next++;
+}
+
+// ARQ_SYNC and ARQ_SYNC_ACK carry the first sequence number, ARQ_ACK the
+// first packet missing and the 16-bit little endian bitmap after it
+void radio_arq_control(radio_inst_t const *radio, uint8_t const *control, uint32_t len) {
+    radio_arq_t *arq = get_arq(radio);
+
+    switch (control[0]) {
+        case RADIO_FRAME_CONTROL_ARQ_SYNC:
+            if (len < SYNC_SIZE)
+                break;
+
+            arq->synced = true;
+            arq->rx_next = control[1];
+            arq->rx_floor = control[1];
+            arq->ack_due = false;
+            for (uint32_t i = 0; i < RADIO_ARQ_MAX_WINDOW; ++i)
+                arq->rx[i].held = false;
+
+            arq->sync_ack_due = true;
+            arq->sync_seq = control[1];
+            break;
+
+        case RADIO_FRAME_CONTROL_ARQ_SYNC_ACK:
+            if (len >= SYNC_SIZE && arq->stats.state == RADIO_ARQ_SYNCING && control[1] == arq->next)
+                arq->stats.state = RADIO_ARQ_ACTIVE;
+            break;
+
+        case RADIO_FRAME_CONTROL_ARQ_ACK:
+            if (len >= ACK_SIZE)
+                ack_received(arq, control[1], control[2] | control[3] << 8);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Control message to send next, returns its length or 0 for none. Acks go
+// as soon as they are due, even in the middle of a datagram.
+uint32_t radio_arq_stage_control(radio_inst_t const *radio, uint8_t *control) {
+    radio_arq_t *arq = get_arq(radio);
+
+    if (arq->sync_ack_due) {
+        control[0] = RADIO_FRAME_CONTROL_ARQ_SYNC_ACK;
+        control[1] = arq->sync_seq;
+        arq->sync_ack_due = false;
+        return SYNC_SIZE;
+    }
+
+    if (arq->sync_due) {
+        control[0] = RADIO_FRAME_CONTROL_ARQ_SYNC;
+        control[1] = arq->next;
+        arq->sync_due = false;
+        return SYNC_SIZE;
+    }
+
+    if (!arq->ack_due || hal_time_us() < arq->ack_at_us)
+        return 0;
+
+    uint8_t ack_next = arq->rx_next;
+    while ((uint8_t) (ack_next - arq->rx_next) < RADIO_ARQ_MAX_WINDOW && arq->rx[ack_next & SLOT_MASK].held)
+        ack_next++;
+
+    uint16_t bitmap = 0;
+    for (uint8_t bit = 0; bit < ACK_BITS; ++bit) {
+        uint8_t seq = ack_next + 1 + bit;
+        if ((uint8_t) (seq - arq->rx_next) < RADIO_ARQ_MAX_WINDOW && arq->rx[seq & SLOT_MASK].held)
+            bitmap |= 1 << bit;
+    }
+
+    control[0] = RADIO_FRAME_CONTROL_ARQ_ACK;
+    control[1] = ack_next;
+    control[2] = bitmap & 0xFF;
+    control[3] = bitmap >> 8;
+    arq->ack_due = false;
+    arq->stats.acks_sent++;
+    return ACK_SIZE;
+}
+
+void radio_arq_get_stats(radio_inst_t const *radio, radio_arq_stats_t *stats) {
+    radio_arq_t const *arq = get_arq(radio);
+    uint8_t held = 0;
+
+    for (uint32_t i = 0; i < RADIO_ARQ_MAX_WINDOW; ++i)
+        held += arq->rx[i].held;
+
+    *stats = arq->stats;
+    stats->in_flight = in_flight(arq);
+    stats->held = held;
+}
@@ -0,0 +1,108 @@
+#ifndef _LORA_BRIDGE_RADIO_ARQ_H_
+#define _LORA_BRIDGE_RADIO_ARQ_H_
+
+#include "radio.h"
+
+// Selective repeat over framed mode. Fragments go as reliable packets: the
+// link header with RADIO_FRAME_MAGIC_ARQ, a packet sequence number, how far
+// the oldest unacknowledged packet lies behind it, the payload and a CRC-16.
+// The receiver holds packets arriving after a gap and hands fragments on in
+// order, and answers with ARQ_ACK: the first packet missing and a bitmap of
+// the ones after it it holds.
+//
+// The module is half duplex, so acks must not meet data on air. The sender
+// marks the last packet it can send with RADIO_ARQ_POLL and waits for the
+// ack, which the receiver sends as soon as the poll is in. Packets sent before
+// a poll and missing from its ack go again, and a poll left unanswered past
+// its time on air plus the timeout sends the oldest packet again as a poll.
+// The timeout follows the measured ack turnaround as in RFC 6298.
+//
+// The window keeps the air busy for RADIO_ARQ_WINDOW_FACTOR times the ack
+// turnaround at the configured packet length and data rate, so acks cost
+// about a ninth of the air time, and never spans more than
+// RADIO_ARQ_MAX_BURST_US of air.
+//
+// ARQ_SYNC starts the sequence numbers on the receiving end, data waits for
+// its answer. Any framed bridge receives reliable packets and acknowledges
+// them, the host only enables sending them.
+
+#define RADIO_ARQ_MAX_WINDOW        16      ///< Power of two, the ack bitmap covers the packets after the first
+#define RADIO_ARQ_MIN_WINDOW        2
+#define RADIO_ARQ_WINDOW_FACTOR     8
+#define RADIO_ARQ_MAX_BURST_US      (4 * 1000 * 1000)
+#define RADIO_ARQ_TURNAROUND_US     (20 * 1000)     ///< Receiving bridge and module, past the UART and air times
+#define RADIO_ARQ_MAX_RTO_US        (10 * 1000 * 1000)
+#define RADIO_ARQ_MAX_RETRIES       8               ///< Then the packet is given up, the receiver skips it
+#define RADIO_ARQ_SYNC_INTERVAL_US  (1000 * 1000)
+#define RADIO_ARQ_SYNC_ATTEMPTS     5
+
+// Reliable packet: link header, fields, payload, CRC-16/CCITT of all before it
+#define RADIO_ARQ_FIELDS_SIZE       2
+#define RADIO_ARQ_CRC_SIZE          2
+#define RADIO_ARQ_OVERHEAD          (RADIO_ARQ_FIELDS_SIZE + RADIO_ARQ_CRC_SIZE)
+#define RADIO_ARQ_POLL              0x80    ///< Second field, acknowledge right away
+#define RADIO_ARQ_BACK_MASK         0x0F    ///< Second field, packets since the oldest unacknowledged
+
+typedef enum {
+    RADIO_ARQ_OFF = 0,
+    RADIO_ARQ_SYNCING,          ///< Waiting for ARQ_SYNC_ACK
+    RADIO_ARQ_ACTIVE,
+    RADIO_ARQ_UNSUPPORTED,      ///< The peer never answered, fragments go unacknowledged
+} radio_arq_state_t;
+
+/// Retry and round trip counters, readable over HID
+typedef struct {
+    uint8_t state;              ///< radio_arq_state_t
+    uint8_t window;             ///< Packets in flight at most
+    uint8_t in_flight;          ///< Sent and not acknowledged yet
+    uint8_t held;               ///< Received after a gap, waiting for the missing ones
+    uint32_t packets_sent;      ///< New packets, retransmissions excluded
+    uint32_t retransmits;
+    uint32_t timeouts;          ///< Polls left unanswered
+    uint32_t given_up;          ///< Packets dropped after RADIO_ARQ_MAX_RETRIES retransmissions
+    uint32_t acks_sent;
+    uint32_t acks_received;
+    uint32_t rx_packets;        ///< Received with a good CRC, duplicates included
+    uint32_t rx_duplicates;
+    uint32_t rx_crc_errors;
+    uint32_t rx_skipped;        ///< Never received, the sender gave up on them
+    uint16_t rtt_ms;            ///< Last sample, poll handed to the module to its ack
+    uint16_t srtt_ms;           ///< Smoothed
+    uint16_t rttvar_ms;         ///< Variation of the ack turnaround
+    uint16_t rto_ms;            ///< Wait for an ack once the poll is on air
+    uint32_t rtt_samples;
+} radio_arq_stats_t;
+
+void radio_arq_init(radio_inst_t const *radio);
+
+void radio_arq_configure(radio_inst_t const *radio, parameters_t const *params);
+
+bool radio_arq_set_enabled(radio_inst_t const *radio, bool enabled);
+
+radio_arq_state_t radio_arq_state(radio_inst_t const *radio);
+
+void radio_arq_reset(radio_inst_t const *radio);
+
+void radio_arq_task(radio_inst_t const *radio);
+
+bool radio_arq_can_send(radio_inst_t const *radio);
+
+uint32_t radio_arq_seal(radio_inst_t const *radio, uint8_t *packet, uint32_t len, bool more);
+
+uint32_t radio_arq_stage_retransmit(radio_inst_t const *radio, uint8_t *packet);
+
+bool radio_arq_sent(radio_inst_t const *radio, uint8_t const *packet);
+
+bool radio_arq_receive(radio_inst_t const *radio, uint8_t const *packet, uint32_t len);
+
+uint32_t radio_arq_next(radio_inst_t const *radio, uint8_t const **packet);
+
+void radio_arq_consume(radio_inst_t const *radio);
+
+void radio_arq_control(radio_inst_t const *radio, uint8_t const *control, uint32_t len);
+
+uint32_t radio_arq_stage_control(radio_inst_t const *radio, uint8_t *control);
+
+void radio_arq_get_stats(radio_inst_t const *radio, radio_arq_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_ARQ_H_
@@ -0,0 +1,449 @@
+#include <memory.h>
+
+#include "radio.h"
+#include "radio_adapt.h"
+#include "radio_arq.h"
+#include "radio_core.h"
+#include "radio_flow.h"
+#include "radio_frame.h"
+#include "radio_power.h"
+#include "radio_rssi.h"
+#include "radio_sched.h"
+#include "radio_store.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+#include "usb_command.h"
+#include "tusb_config.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a > b) ? b : a)
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a > b) ? a : b)
+#endif
+
+// Everything touching the UART, the AUX pin or the module runs on core1. Data
+// crosses between the cores through two single-producer/single-consumer rings,
+// commands and completions through the multicore FIFO.
+
+static radio_inst_t const radios[RADIO_CORE_MODULES] = {
+        {
+                .uart = uart0,
+                .tx_pin = 0,
+                .rx_pin = 1,
+                .m0_pin = 2,
+                .m1_pin = 3,
+                .aux_pin = 6
+        },
+        {
+                .uart = uart1,
+                .tx_pin = 4,
+                .rx_pin = 5,
+                .m0_pin = 7,
+                .m1_pin = 8,
+                .aux_pin = 9
+        },
+};
+
+static uint8_t tx_data[RADIO_CORE_MODULES][RADIO_CORE_QUEUE_SIZE];
+static uint8_t rx_data[RADIO_CORE_MODULES][RADIO_CORE_QUEUE_SIZE];
+static ring_buffer_t tx_queues[RADIO_CORE_MODULES];    ///< Host to radio, produced by core0
+static ring_buffer_t rx_queues[RADIO_CORE_MODULES];    ///< Radio to host, produced by core1
+static volatile uint32_t present;   ///< Modules in use, one bit each, only ever set by core1
+static uint32_t probing;        ///< Core1, modules read for the first time
+
+/// HID command handed to core1, owned by core1 from RADIO_CORE_MSG_COMMAND
+/// until RADIO_CORE_MSG_RESPONSE
+typedef struct {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE];
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    uint32_t request_len;
+    volatile bool in_use;
+} radio_core_slot_t;
+
+static radio_core_slot_t slots[RADIO_CORE_COMMAND_SLOTS];
+static uint32_t active_slot;    ///< Core1, slot of the command waiting for the radio
+static bool active;
+
+/// Counters copied out by core1, the sequence number is odd while it writes
+typedef struct {
+    volatile uint32_t seq;
+    radio_core_stats_t stats;
+} radio_core_published_t;
+
+static radio_core_published_t published;
+static loop_timer_t loop_timer;
+static uint32_t rx_queue_high_water[RADIO_CORE_MODULES];
+static uint64_t next_publish_us;
+static volatile bool suspended;     ///< Set by core0 while the host suspends the bus
+
+//--------------------------------------------------------------------+
+// Core1
+//--------------------------------------------------------------------+
+
+// The response carries the module and the sequence number of its request
+static void post_response(uint32_t index, uint8_t const *response) {
+    radio_core_slot_t *slot = &slots[index];
+
+    memcpy(slot->response, response, CFG_TUD_HID_EP_BUFSIZE);
+    slot->response[USB_COMMAND_MODULE_INDEX] = slot->request[USB_COMMAND_MODULE_INDEX];
+    slot->response[USB_COMMAND_SEQUENCE_INDEX] = slot->request[USB_COMMAND_SEQUENCE_INDEX];
+    hal_core_push(RADIO_CORE_MSG(RADIO_CORE_MSG_RESPONSE, index));
+}
+
+// Asynchronous HID commands complete here, still on core1
+void usb_command_complete_cb(uint8_t const *response) {
+    post_response(active_slot, response);
+    active = false;
+}
+
+// Commands run one at a time in the order they were posted, the next one
+// waits in the FIFO while a radio operation is in progress
+static void command_task(void) {
+    uint32_t msg;
+    if (active || !hal_core_pop(&msg) || RADIO_CORE_MSG_TYPE(msg) != RADIO_CORE_MSG_COMMAND)
+        return;
+
+    uint32_t index = RADIO_CORE_MSG_ARG(msg);
+    uint8_t const *buffer = slots[index].request;
+    uint32_t bufsize = slots[index].request_len;
+    uint32_t module = buffer[USB_COMMAND_MODULE_INDEX];
+
+    // Echo the first byte of the request
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE] = {buffer[0]};
+    bool pending = false;
+
+    // No such module, or it did not answer at start-up
+    if (!radio_core_present(module)) {
+        response[1] = USB_COMMAND_FAILED;
+        post_response(index, response);
+        return;
+    }
+
+    radio_inst_t const *radio = &radios[module];
+
+    // Proxy command to radio module
+    switch (buffer[0]) {
+        case USB_COMMAND_READ_PARAMS:
+            pending = usb_command_read_params(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_WRITE_PARAMS:
+            pending = usb_command_write_params(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_READ_UART_STATS:
+            usb_command_read_uart_stats(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_READ_AIRTIME:
+            usb_command_read_airtime(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_SET_FRAMING:
+            usb_command_set_framing(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_SET_COMPRESSION:
+            usb_command_set_compression(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_READ_DESTINATION:
+            usb_command_read_destination(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_READ_RSSI:
+            usb_command_read_rssi(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_SET_ADAPT:
+            usb_command_set_adapt(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_BATCH:
+            pending = usb_command_batch(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_SET_POWER:
+            usb_command_set_power(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_SET_ARQ:
+            usb_command_set_arq(radio, response, buffer, bufsize);
+            break;
+
+        case USB_COMMAND_SET_FEC:
+            usb_command_set_fec(radio, response, buffer, bufsize);
+            break;
+
+        default:
+            break;
+    }
+
+    // Radio operations complete through usb_command_complete_cb()
+    if (pending) {
+        active_slot = index;
+        active = true;
+    } else {
+        post_response(index, response);
+    }
+}
+
+static void pump_task(uint32_t module) {
+    radio_inst_t const *radio = &radios[module];
+    ring_buffer_t *tx_queue = &tx_queues[module];
+    ring_buffer_t *rx_queue = &rx_queues[module];
+    uint8_t const *data;
+    uint32_t len;
+
+    // Host data in whole packets, as the module buffer and the TX queue take them
+    if (!radio_is_busy(radio) && radio_frame_enabled(radio)) {
+        uint32_t credits = MIN(radio_flow_credits(radio), uart_tx_space(radio->uart));
+        len = radio_frame_tx_fragment(radio, tx_queue, &data);
+
+        if (radio_power_ready(radio, len > 0) && radio_sched_release_packet(radio, len, credits)) {
+            uart_tx_write(radio->uart, data, len);
+            radio_flow_consume(radio, len);
+            radio_frame_tx_done(radio);
+        }
+    } else if (!radio_is_busy(radio) && radio_power_ready(radio, ring_buffer_count(tx_queue) > 0)) {
+        uint32_t credits = MIN(radio_flow_credits(radio), uart_tx_space(radio->uart));
+        uint32_t release = radio_sched_release(radio, ring_buffer_count(tx_queue), credits);
+
+        while (release > 0 && (len = ring_buffer_peek(tx_queue, &data)) > 0) {
+            len = uart_tx_write(radio->uart, data, MIN(len, release));
+            ring_buffer_consume(tx_queue, len);
+            radio_flow_consume(radio, len);
+            release -= len;
+        }
+    }
+
+    // Received data, unless it is a configuration response
+    if (radio_owns_rx(radio))
+        return;
+
+    if (radio_frame_enabled(radio)) {
+        radio_frame_receive(radio, rx_queue);
+        rx_queue_high_water[module] = MAX(rx_queue_high_water[module], ring_buffer_count(rx_queue));
+        return;
+    }
+
+    while ((len = radio_rssi_peek(radio, &data)) > 0) {
+        uint32_t written = ring_buffer_write(rx_queue, data, len);
+        radio_rssi_consume(radio, written);
+        rx_queue_high_water[module] = MAX(rx_queue_high_water[module], ring_buffer_count(rx_queue));
+
+        // Queue full, core0 catches up on its next loop
+        if (written < len)
+            break;
+    }
+}
+
+// Nothing waits for the modules. Those with cached parameters are in use right
+// away, the others once they answered. A missing module costs nothing.
+bool radio_core_setup(void) {
+    present = 0;
+    probing = 0;
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        ring_buffer_init(&tx_queues[module], tx_data[module], RADIO_CORE_QUEUE_SIZE);
+        ring_buffer_init(&rx_queues[module], rx_data[module], RADIO_CORE_QUEUE_SIZE);
+
+        // Interrupts are routed to the core enabling them
+        if (radio_init(&radios[module]))
+            present |= 1u << module;
+        else
+            probing |= 1u << module;
+    }
+
+    hal_core_push(RADIO_CORE_MSG(RADIO_CORE_MSG_READY, present | probing));
+    return (present | probing) != 0;
+}
+
+// The first read of a module without cached parameters
+static void probe_task(uint32_t module) {
+    radio_inst_t const *radio = &radios[module];
+    radio_task(radio);
+
+    switch (radio_get_boot(radio)) {
+        case RADIO_BOOT_READ:
+            probing &= ~(1u << module);
+            hal_barrier();
+            present |= 1u << module;
+            break;
+
+        case RADIO_BOOT_ABSENT:
+            probing &= ~(1u << module);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Seqlock, core0 retries a copy that overlapped with an update
+static void publish_stats(void) {
+    radio_core_stats_t stats;
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        radio_core_module_stats_t *counters = &stats.modules[module];
+        radio_inst_t const *radio = &radios[module];
+        uart_rx_stats_t rx_stats;
+        radio_flow_stats_t flow_stats;
+
+        uart_rx_get_stats(radio->uart, &rx_stats);
+        radio_flow_get_stats(radio, &flow_stats);
+        radio_get_stats(radio, &counters->radio);
+
+        counters->uart_tx_bytes = flow_stats.sent;
+        counters->uart_rx_bytes = rx_stats.received;
+        counters->uart_overruns = rx_stats.overruns;
+        counters->uart_errors = rx_stats.errors;
+        counters->uart_overflows = rx_stats.overflows;
+        counters->rx_queue_high_water = rx_queue_high_water[module];
+        counters->aux_low_us = flow_stats.busy_us;
+        counters->boot = (uint8_t) radio_get_boot(radio);
+    }
+
+    memcpy(stats.loop_histogram, loop_timer.histogram, sizeof(stats.loop_histogram));
+
+    published.seq++;
+    hal_barrier();
+    published.stats = stats;
+    hal_barrier();
+    published.seq++;
+}
+
+void radio_core_task(void) {
+    uint64_t now = hal_time_us();
+
+    // Core0 may be waiting to write the flash
+    hal_flash_park();
+
+    loop_timer_tick(&loop_timer, now);
+    if (now >= next_publish_us) {
+        publish_stats();
+        next_publish_us = now + RADIO_CORE_STATS_INTERVAL_US;
+    }
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        if (probing & (1u << module))
+            probe_task(module);
+
+        if (!(present & (1u << module)))
+            continue;
+
+        radio_task(&radios[module]);
+        radio_adapt_task(&radios[module]);
+        radio_arq_task(&radios[module]);
+        radio_power_task(&radios[module], suspended);
+        pump_task(module);
+    }
+
+    command_task();
+}
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "EndlessLoop"
+
+static void radio_core_main(void) {
+    if (!radio_core_setup())
+        return;
+
+    while (true) {
+        radio_core_task();
+    }
+}
+
+#pragma clang diagnostic pop
+
+//--------------------------------------------------------------------+
+// Core0
+//--------------------------------------------------------------------+
+
+// Starts core1 and waits for it to take the modules in hand, false if none
+// can ever be used
+bool radio_core_launch(void) {
+    hal_core_launch(radio_core_main);
+
+    uint32_t msg;
+    while (!hal_core_pop(&msg) || RADIO_CORE_MSG_TYPE(msg) != RADIO_CORE_MSG_READY)
+        hal_idle();
+
+    return RADIO_CORE_MSG_ARG(msg) != 0;
+}
+
+// Modules with cached parameters are present from RADIO_CORE_MSG_READY on,
+// the others join once they answered
+bool radio_core_present(uint32_t module) {
+    return module < RADIO_CORE_MODULES && (present & (1u << module));
+}
+
+ring_buffer_t *radio_core_tx_queue(uint32_t module) {
+    return &tx_queues[module];
+}
+
+ring_buffer_t *radio_core_rx_queue(uint32_t module) {
+    return &rx_queues[module];
+}
+
+// In framed mode the RX queue holds length prefixed datagrams
+bool radio_core_framed(uint32_t module) {
+    return radio_frame_enabled(&radios[module]);
+}
+
+// While the host suspends the bus, duty-cycling modules rest without waiting
+// for the idle timeout
+void radio_core_suspend(bool suspend) {
+    suspended = suspend;
+}
+
+// Parameters core1 changed go to flash from here, core1 waits in RAM meanwhile
+void radio_core_store_task(void) {
+    radio_store_flush();
+}
+
+// Hands a HID command to core1, false while RADIO_CORE_COMMAND_SLOTS are
+// waiting for their response
+bool radio_core_post_command(uint8_t const *buffer, uint32_t bufsize) {
+    uint32_t index = 0;
+    while (index < RADIO_CORE_COMMAND_SLOTS && slots[index].in_use)
+        index++;
+
+    if (index == RADIO_CORE_COMMAND_SLOTS)
+        return false;
+
+    radio_core_slot_t *slot = &slots[index];
+    slot->in_use = true;
+    slot->request_len = MIN(bufsize, CFG_TUD_HID_EP_BUFSIZE);
+    memcpy(slot->request, buffer, slot->request_len);
+    memset(&slot->request[slot->request_len], 0, CFG_TUD_HID_EP_BUFSIZE - slot->request_len);
+
+    hal_core_push(RADIO_CORE_MSG(RADIO_CORE_MSG_COMMAND, index));
+    return true;
+}
+
+// Copies the response of the next command core1 completed
+bool radio_core_poll_response(uint8_t *response) {
+    uint32_t msg;
+    if (!hal_core_pop(&msg) || RADIO_CORE_MSG_TYPE(msg) != RADIO_CORE_MSG_RESPONSE)
+        return false;
+
+    radio_core_slot_t *slot = &slots[RADIO_CORE_MSG_ARG(msg)];
+    memcpy(response, slot->response, CFG_TUD_HID_EP_BUFSIZE);
+    slot->in_use = false;
+    return true;
+}
+
+// Latest counters published by core1, safe to call from core0 at any time
+void radio_core_get_stats(radio_core_stats_t *stats) {
+    uint32_t seq;
+
+    do {
+        seq = published.seq;
+        hal_barrier();
+        *stats = published.stats;
+        hal_barrier();
+    } while ((seq & 1) || seq != published.seq);
+}
@@ -0,0 +1,77 @@
+#ifndef _LORA_BRIDGE_RADIO_CORE_H_
+#define _LORA_BRIDGE_RADIO_CORE_H_
+
+#include "loop_timer.h"
+#include "radio.h"
+#include "ring_buffer.h"
+
+// Modules driven by core1, each one on a UART of its own and behind a CDC
+// interface of its own
+#define RADIO_CORE_MODULES 2
+
+// Must be a power of two
+#define RADIO_CORE_QUEUE_SIZE 1024
+
+// Control messages over the multicore FIFO, the message type sits in the top byte
+#define RADIO_CORE_MSG_READY      0x01  ///< core1 -> core0, modules in use or being read in the low byte, one bit each
+#define RADIO_CORE_MSG_COMMAND    0x02  ///< core0 -> core1, HID command waiting in the slot in the low byte
+#define RADIO_CORE_MSG_RESPONSE   0x03  ///< core1 -> core0, HID response waiting in the slot in the low byte
+
+#define RADIO_CORE_MSG(type, arg)     (((uint32_t) (type) << 24) | ((arg) & 0xFFFFFF))
+#define RADIO_CORE_MSG_TYPE(msg)      ((msg) >> 24)
+#define RADIO_CORE_MSG_ARG(msg)       ((msg) & 0xFFFFFF)
+
+// HID commands in flight, the multicore FIFO holds one message for each
+#define RADIO_CORE_COMMAND_SLOTS  4
+
+// How often core1 publishes its counters for radio_core_get_stats()
+#define RADIO_CORE_STATS_INTERVAL_US  (10 * 1000)
+
+/// Counters of one module
+typedef struct {
+    uint32_t uart_tx_bytes;         ///< Handed to the UART, configuration commands excluded
+    uint32_t uart_rx_bytes;
+    uint32_t uart_overruns;
+    uint32_t uart_errors;           ///< Framing, parity or break errors
+    uint32_t uart_overflows;        ///< RX ring full
+    uint32_t rx_queue_high_water;   ///< Radio to host queue
+    uint64_t aux_low_us;
+    radio_stats_t radio;            ///< Mode switches
+    uint8_t boot;                   ///< radio_boot_t
+} radio_core_module_stats_t;
+
+/// Core1 counters as of the last publication
+typedef struct {
+    radio_core_module_stats_t modules[RADIO_CORE_MODULES];
+    uint16_t loop_histogram[LOOP_TIMER_BINS];
+} radio_core_stats_t;
+
+// Core1 side, also driven directly by the host simulator
+
+bool radio_core_setup(void);
+
+void radio_core_task(void);
+
+// Core0 side, the radio runs on core1
+
+bool radio_core_launch(void);
+
+bool radio_core_present(uint32_t module);
+
+ring_buffer_t *radio_core_tx_queue(uint32_t module);
+
+ring_buffer_t *radio_core_rx_queue(uint32_t module);
+
+bool radio_core_framed(uint32_t module);
+
+void radio_core_suspend(bool suspend);
+
+void radio_core_store_task(void);
+
+bool radio_core_post_command(uint8_t const *buffer, uint32_t bufsize);
+
+bool radio_core_poll_response(uint8_t *response);
+
+void radio_core_get_stats(radio_core_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_CORE_H_
@@ -0,0 +1,172 @@
+#include <memory.h>
+
+#include "radio_dest.h"
+#include "radio_frame.h"
+
+// A target with a long backlog only fills its own queue. Each call to
+// radio_dest_next() starts looking after the queue it served last, so every
+// target with something to send gets one datagram per round.
+typedef struct {
+    bool in_use;
+    uint8_t target[RADIO_DEST_ADDRESS_SIZE];
+    ring_buffer_t queue;            ///< Length prefixed datagrams, target stripped
+    uint8_t data[RADIO_DEST_QUEUE_SIZE];
+    uint32_t datagrams_sent;
+    uint32_t bytes_sent;
+    uint32_t dropped;
+} radio_dest_queue_t;
+
+typedef struct {
+    radio_dest_queue_t queues[RADIO_DEST_MAX];
+    uint32_t current;               ///< Queue served last
+    uint32_t unroutable;            ///< Datagrams dropped, every queue busy with another target
+} radio_dest_t;
+
+static radio_dest_t radio_dest[NUM_UARTS];
+
+static radio_dest_t *get_dest(radio_inst_t const *radio) {
+    return &radio_dest[hal_uart_index(radio->uart)];
+}
+
+// The queue of a target, or with claim a new one taking over an unused or
+// drained queue
+static radio_dest_queue_t *find_queue(radio_dest_t *dest, uint8_t const *target, bool claim) {
+    radio_dest_queue_t *spare = NULL;
+
+    for (uint32_t i = 0; i < RADIO_DEST_MAX; ++i) {
+        radio_dest_queue_t *queue = &dest->queues[i];
+
+        if (queue->in_use && memcmp(queue->target, target, RADIO_DEST_ADDRESS_SIZE) == 0)
+            return queue;
+
+        if (spare == NULL && (!queue->in_use || ring_buffer_empty(&queue->queue)))
+            spare = queue;
+    }
+
+    if (spare == NULL || !claim)
+        return spare;
+
+    spare->in_use = true;
+    memcpy(spare->target, target, RADIO_DEST_ADDRESS_SIZE);
+    spare->datagrams_sent = 0;
+    spare->bytes_sent = 0;
+    spare->dropped = 0;
+    return spare;
+}
+
+void radio_dest_init(radio_inst_t const *radio) {
+    radio_dest_reset(radio);
+}
+
+// Drops everything queued and forgets the targets
+void radio_dest_reset(radio_inst_t const *radio) {
+    radio_dest_t *dest = get_dest(radio);
+
+    for (uint32_t i = 0; i < RADIO_DEST_MAX; ++i) {
+        radio_dest_queue_t *queue = &dest->queues[i];
+
+        queue->in_use = false;
+        queue->datagrams_sent = 0;
+        queue->bytes_sent = 0;
+        queue->dropped = 0;
+        ring_buffer_init(&queue->queue, queue->data, RADIO_DEST_QUEUE_SIZE);
+    }
+
+    dest->current = RADIO_DEST_MAX - 1;
+    dest->unroutable = 0;
+}
+
+// Whether a datagram of len bytes for target would be queued right now
+bool radio_dest_has_room(radio_inst_t const *radio, uint8_t const *target, uint32_t len) {
+    radio_dest_queue_t *queue = find_queue(get_dest(radio), target, false);
+
+    if (queue == NULL)
+        return false;
+
+    return !queue->in_use || memcmp(queue->target, target, RADIO_DEST_ADDRESS_SIZE) != 0 ||
+           ring_buffer_space(&queue->queue) >= RADIO_FRAME_PREFIX_SIZE + len;
+}
+
+// Moves a whole addressed datagram of len bytes, its prefix already taken, from
+// the host queue to the queue of its target. Returns false when it was dropped.
+bool radio_dest_push(radio_inst_t const *radio, ring_buffer_t *queue, uint32_t len) {
+    radio_dest_t *dest = get_dest(radio);
+    uint8_t target[RADIO_DEST_ADDRESS_SIZE];
+
+    ring_buffer_read(queue, target, RADIO_DEST_ADDRESS_SIZE);
+    len -= RADIO_DEST_ADDRESS_SIZE;
+
+    radio_dest_queue_t *dest_queue = find_queue(dest, target, true);
+    if (dest_queue == NULL) {
+        ring_buffer_consume(queue, len);
+        dest->unroutable++;
+        return false;
+    }
+
+    if (ring_buffer_space(&dest_queue->queue) < RADIO_FRAME_PREFIX_SIZE + len) {
+        ring_buffer_consume(queue, len);
+        dest_queue->dropped++;
+        return false;
+    }
+
+    ring_buffer_put(&dest_queue->queue, len & 0xFF);
+    ring_buffer_put(&dest_queue->queue, len >> 8);
+
+    uint8_t const *data;
+    uint32_t chunk;
+    while (len > 0 && (chunk = ring_buffer_peek(queue, &data)) > 0) {
+        if (chunk > len)
+            chunk = len;
+
+        ring_buffer_write(&dest_queue->queue, data, chunk);
+        ring_buffer_consume(queue, chunk);
+        len -= chunk;
+    }
+
+    return true;
+}
+
+// The next queue in turn with a datagram waiting, NULL when all are empty.
+// The target of its datagrams is copied to target.
+ring_buffer_t *radio_dest_next(radio_inst_t const *radio, uint8_t *target) {
+    radio_dest_t *dest = get_dest(radio);
+
+    for (uint32_t i = 1; i <= RADIO_DEST_MAX; ++i) {
+        uint32_t index = (dest->current + i) % RADIO_DEST_MAX;
+        radio_dest_queue_t *queue = &dest->queues[index];
+
+        if (!queue->in_use || ring_buffer_empty(&queue->queue))
+            continue;
+
+        dest->current = index;
+        memcpy(target, queue->target, RADIO_DEST_ADDRESS_SIZE);
+        queue->datagrams_sent++;
+        queue->bytes_sent += ring_buffer_at(&queue->queue, 0) | ring_buffer_at(&queue->queue, 1) << 8;
+        return &queue->queue;
+    }
+
+    return NULL;
+}
+
+bool radio_dest_get_stats(radio_inst_t const *radio, uint32_t index, radio_dest_stats_t *stats) {
+    if (index >= RADIO_DEST_MAX)
+        return false;
+
+    radio_dest_queue_t const *queue = &get_dest(radio)->queues[index];
+
+    *stats = (radio_dest_stats_t) {
+            .in_use = queue->in_use,
+            .addh = queue->target[0],
+            .addl = queue->target[1],
+            .chan = queue->target[2],
+            .queued = ring_buffer_count(&queue->queue),
+            .datagrams_sent = queue->datagrams_sent,
+            .bytes_sent = queue->bytes_sent,
+            .dropped = queue->dropped,
+    };
+    return true;
+}
+
+uint32_t radio_dest_unroutable(radio_inst_t const *radio) {
+    return get_dest(radio)->unroutable;
+}
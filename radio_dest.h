@@ -0,0 +1,42 @@
+#ifndef _LORA_BRIDGE_RADIO_DEST_H_
+#define _LORA_BRIDGE_RADIO_DEST_H_
+
+#include "radio.h"
+#include "ring_buffer.h"
+
+// Addressed framing: each host datagram starts with the ADDH, ADDL and CHAN of
+// its fixed transmission target, counted in its length prefix. Datagrams wait
+// in one queue per target, and the queues take turns on the air.
+
+#define RADIO_DEST_MAX              8
+#define RADIO_DEST_QUEUE_SIZE       2048    ///< Two of the longest datagrams
+#define RADIO_DEST_ADDRESS_SIZE     3
+#define RADIO_DEST_BROADCAST        0xFFFF  ///< Fixed transmission address every module receives
+
+/// One destination, readable over HID
+typedef struct {
+    uint8_t in_use;
+    uint8_t addh;
+    uint8_t addl;
+    uint8_t chan;
+    uint32_t queued;            ///< Bytes waiting, length prefixes included
+    uint32_t datagrams_sent;
+    uint32_t bytes_sent;
+    uint32_t dropped;           ///< Datagrams dropped, the queue was full
+} radio_dest_stats_t;
+
+void radio_dest_init(radio_inst_t const *radio);
+
+void radio_dest_reset(radio_inst_t const *radio);
+
+bool radio_dest_has_room(radio_inst_t const *radio, uint8_t const *target, uint32_t len);
+
+bool radio_dest_push(radio_inst_t const *radio, ring_buffer_t *queue, uint32_t len);
+
+ring_buffer_t *radio_dest_next(radio_inst_t const *radio, uint8_t *target);
+
+bool radio_dest_get_stats(radio_inst_t const *radio, uint32_t index, radio_dest_stats_t *stats);
+
+uint32_t radio_dest_unroutable(radio_inst_t const *radio);
+
+#endif //_LORA_BRIDGE_RADIO_DEST_H_
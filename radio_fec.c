@@ -0,0 +1,289 @@
+#include <memory.h>
+
+#include "radio_arq.h"
+#include "radio_fec.h"
+#include "radio_frame.h"
+
+#define GF_POLY 0x11D       ///< x^8 + x^4 + x^3 + x^2 + 1, generator 2
+
+typedef struct {
+    radio_fec_stats_t stats;
+    uint8_t generator[RADIO_FEC_MAX_PARITY + 1];    ///< Highest power first, for stats.parity
+} radio_fec_t;
+
+static radio_fec_t radio_fec[NUM_UARTS];
+
+static uint8_t gf_exp[2 * 255];
+static uint8_t gf_log[256];
+
+static radio_fec_t *get_fec(radio_inst_t const *radio) {
+    return &radio_fec[hal_uart_index(radio->uart)];
+}
+
+static void init_tables(void) {
+    uint32_t x = 1;
+
+    for (uint32_t i = 0; i < 255; ++i) {
+        gf_exp[i] = gf_exp[i + 255] = (uint8_t) x;
+        gf_log[x] = (uint8_t) i;
+        x <<= 1;
+        if (x & 0x100)
+            x ^= GF_POLY;
+    }
+}
+
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+    return a == 0 || b == 0 ? 0 : gf_exp[gf_log[a] + gf_log[b]];
+}
+
+static uint8_t gf_div(uint8_t a, uint8_t b) {
+    return a == 0 ? 0 : gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+static uint8_t gf_inv(uint8_t a) {
+    return gf_exp[255 - gf_log[a]];
+}
+
+// Lowest power first
+static uint8_t poly_eval(uint8_t const *poly, uint32_t len, uint8_t x) {
+    uint8_t y = 0;
+
+    while (len-- > 0)
+        y = gf_mul(y, x) ^ poly[len];
+
+    return y;
+}
+
+// Product of (x - 2^i) for the parity bytes in use
+static void build_generator(radio_fec_t *fec) {
+    uint32_t parity = fec->stats.parity;
+
+    memset(fec->generator, 0, sizeof(fec->generator));
+    fec->generator[0] = 1;
+
+    for (uint32_t i = 0; i < parity; ++i) {
+        for (uint32_t j = i + 1; j > 0; --j)
+            fec->generator[j] ^= gf_mul(fec->generator[j - 1], gf_exp[i]);
+    }
+}
+
+static void apply(radio_fec_t *fec) {
+    uint32_t parity = fec->stats.requested < fec->stats.limit ? fec->stats.requested : fec->stats.limit;
+
+    if (parity != fec->stats.parity) {
+        fec->stats.parity = parity;
+        build_generator(fec);
+    }
+}
+
+void radio_fec_init(radio_inst_t const *radio) {
+    parameters_t defaults = {
+            .sped = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE,
+            .opt1 = RADIO_PARAM_OPT1_PACKET_LEN_200,
+    };
+
+    if (gf_exp[0] == 0)
+        init_tables();
+
+    memset(get_fec(radio), 0, sizeof(radio_fec_t));
+    radio_fec_configure(radio, &defaults);
+}
+
+// Half of what is left of a packet at most, so short packets still carry data
+void radio_fec_configure(radio_inst_t const *radio, parameters_t const *params) {
+    radio_fec_t *fec = get_fec(radio);
+    uint32_t room = get_packet_length(params->opt1) - RADIO_FRAME_HEADER_SIZE - RADIO_ARQ_OVERHEAD -
+                    RADIO_FEC_FIELD_SIZE;
+    uint32_t limit = room / 2 & ~1u;
+
+    fec->stats.limit = limit > RADIO_FEC_MAX_PARITY ? RADIO_FEC_MAX_PARITY : limit;
+    apply(fec);
+}
+
+bool radio_fec_valid_parity(uint32_t parity) {
+    return parity >= RADIO_FEC_MIN_PARITY && parity <= RADIO_FEC_MAX_PARITY && parity % 2 == 0;
+}
+
+// 0 turns coding off, raw mode has no packets to code
+bool radio_fec_set_parity(radio_inst_t const *radio, uint32_t parity) {
+    radio_fec_t *fec = get_fec(radio);
+
+    if (parity != 0 && (!radio_fec_valid_parity(parity) || !radio_frame_enabled(radio)))
+        return false;
+
+    fec->stats.requested = parity;
+    apply(fec);
+    return true;
+}
+
+uint32_t radio_fec_parity(radio_inst_t const *radio) {
+    return get_fec(radio)->stats.parity;
+}
+
+// Bytes a packet grows by
+uint32_t radio_fec_overhead(radio_inst_t const *radio) {
+    uint32_t parity = get_fec(radio)->stats.parity;
+    return parity ? RADIO_FEC_FIELD_SIZE + parity : 0;
+}
+
+// Appends the parity count and the parity to len bytes of packet, returns the
+// new length. The packet must have room for radio_fec_overhead() more.
+uint32_t radio_fec_encode(radio_inst_t const *radio, uint8_t *packet, uint32_t len) {
+    radio_fec_t *fec = get_fec(radio);
+    uint32_t parity = fec->stats.parity;
+    uint8_t *remainder = &packet[len + RADIO_FEC_FIELD_SIZE];
+
+    if (parity == 0)
+        return len;
+
+    packet[len++] = (uint8_t) parity;
+    memset(remainder, 0, parity);
+
+    // Division by the generator, the remainder is the parity
+    for (uint32_t i = 0; i < len; ++i) {
+        uint8_t coef = packet[i] ^ remainder[0];
+
+        memmove(remainder, &remainder[1], parity - 1);
+        remainder[parity - 1] = 0;
+
+        if (coef != 0) {
+            for (uint32_t j = 0; j < parity; ++j)
+                remainder[j] ^= gf_mul(fec->generator[j + 1], coef);
+        }
+    }
+
+    fec->stats.packets_coded++;
+    return len + parity;
+}
+
+// Berlekamp-Massey for the error locator, lowest power first. Returns the
+// number of errors, or more than parity / 2 when they cannot be corrected.
+static uint32_t find_locator(uint8_t const *syndromes, uint32_t parity, uint8_t *locator) {
+    uint8_t previous[RADIO_FEC_MAX_PARITY + 1] = {1};
+    uint8_t saved[RADIO_FEC_MAX_PARITY + 1];
+    uint32_t errors = 0;
+    uint32_t shift = 1;
+    uint8_t last = 1;
+
+    memset(locator, 0, parity + 1);
+    locator[0] = 1;
+
+    for (uint32_t n = 0; n < parity; ++n) {
+        uint8_t discrepancy = syndromes[n];
+        for (uint32_t i = 1; i <= errors; ++i)
+            discrepancy ^= gf_mul(locator[i], syndromes[n - i]);
+
+        if (discrepancy == 0) {
+            shift++;
+            continue;
+        }
+
+        uint8_t scale = gf_div(discrepancy, last);
+        bool grow = 2 * errors <= n;
+        if (grow)
+            memcpy(saved, locator, parity + 1);
+
+        for (uint32_t i = 0; i + shift <= parity; ++i)
+            locator[i + shift] ^= gf_mul(scale, previous[i]);
+
+        if (grow) {
+            errors = n + 1 - errors;
+            memcpy(previous, saved, parity + 1);
+            last = discrepancy;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+
+    return errors;
+}
+
+static bool count_uncorrectable(radio_fec_t *fec) {
+    fec->stats.uncorrectable++;
+    return false;
+}
+
+// Checks and corrects a packet of len bytes in place, data_len of them before
+// the parity count. False when it has more errors than the parity covers.
+bool radio_fec_decode(radio_inst_t const *radio, uint8_t *packet, uint32_t data_len, uint32_t len) {
+    radio_fec_t *fec = get_fec(radio);
+    uint8_t syndromes[RADIO_FEC_MAX_PARITY];
+    uint8_t locator[RADIO_FEC_MAX_PARITY + 1];
+    uint8_t evaluator[RADIO_FEC_MAX_PARITY];
+    uint32_t parity = len - data_len - RADIO_FEC_FIELD_SIZE;
+    bool clean = true;
+
+    fec->stats.packets_decoded++;
+    fec->stats.last_errors = 0;
+
+    if (data_len >= len || len > 255 || !radio_fec_valid_parity(parity))
+        return count_uncorrectable(fec);
+
+    // The packet read as a polynomial, first byte highest, at the generator roots
+    for (uint32_t i = 0; i < parity; ++i) {
+        uint8_t s = 0;
+        for (uint32_t j = 0; j < len; ++j)
+            s = gf_mul(s, gf_exp[i]) ^ packet[j];
+
+        syndromes[i] = s;
+        clean = clean && s == 0;
+    }
+
+    if (clean)
+        return packet[data_len] == parity || count_uncorrectable(fec);
+
+    uint32_t errors = find_locator(syndromes, parity, locator);
+    if (2 * errors > parity)
+        return count_uncorrectable(fec);
+
+    // Forney, the evaluator is the syndromes times the locator below x^parity
+    for (uint32_t i = 0; i < parity; ++i) {
+        evaluator[i] = 0;
+        for (uint32_t j = 0; j <= i && j <= errors; ++j)
+            evaluator[i] ^= gf_mul(syndromes[i - j], locator[j]);
+    }
+
+    // Chien search over the bytes there are, a root outside means too many errors
+    uint32_t found = 0;
+    uint8_t positions[RADIO_FEC_MAX_PARITY / 2];
+    uint8_t values[RADIO_FEC_MAX_PARITY / 2];
+
+    for (uint32_t j = 0; j < len && found < errors; ++j) {
+        uint32_t power = len - 1 - j;
+        uint8_t x_inv = gf_exp[(255 - power) % 255];
+
+        if (poly_eval(locator, errors + 1, x_inv) != 0)
+            continue;
+
+        // Odd terms of the locator make its derivative
+        uint8_t derivative = 0;
+        for (uint32_t i = 1; i <= errors; i += 2)
+            derivative ^= gf_mul(locator[i], gf_exp[(uint32_t) gf_log[x_inv] * (i - 1) % 255]);
+
+        if (derivative == 0)
+            break;
+
+        positions[found] = (uint8_t) j;
+        values[found++] = gf_mul(gf_inv(x_inv), gf_div(poly_eval(evaluator, parity, x_inv), derivative));
+    }
+
+    if (found != errors)
+        return count_uncorrectable(fec);
+
+    for (uint32_t i = 0; i < found; ++i)
+        packet[positions[i]] ^= values[i];
+
+    // The count is part of the codeword, the length read goes by it
+    if (packet[data_len] != parity)
+        return count_uncorrectable(fec);
+
+    fec->stats.packets_corrected++;
+    fec->stats.bytes_corrected += errors;
+    fec->stats.last_errors = (uint8_t) errors;
+    return true;
+}
+
+void radio_fec_get_stats(radio_inst_t const *radio, radio_fec_stats_t *stats) {
+    *stats = get_fec(radio)->stats;
+}
@@ -0,0 +1,53 @@
+#ifndef _LORA_BRIDGE_RADIO_FEC_H_
+#define _LORA_BRIDGE_RADIO_FEC_H_
+
+#include "radio.h"
+
+// Reed-Solomon over GF(256) on every framed packet. A coded packet keeps its
+// link header, with RADIO_FRAME_MAGIC_FEC or RADIO_FRAME_MAGIC_FEC_ARQ, and
+// body, then the number of parity bytes and the parity itself. The whole
+// packet is one shortened codeword, up to half as many byte errors as parity
+// bytes are corrected anywhere in it.
+//
+// The receiver finds the packet by its header, so errors in the header still
+// cost the packet. More errors than the parity covers mostly fail to decode,
+// with little parity they may decode to the wrong packet, which only the CRC
+// of reliable mode catches. Any framed bridge decodes coded packets, the host
+// only chooses the parity bytes the sending end adds.
+
+#define RADIO_FEC_MIN_PARITY    2
+#define RADIO_FEC_MAX_PARITY    64      ///< Corrects 32 byte errors, costs a third of a 200 byte packet
+#define RADIO_FEC_FIELD_SIZE    1       ///< Parity bytes, after the body
+
+/// Parity in use and decoder counters, readable over HID
+typedef struct {
+    uint8_t parity;             ///< Parity bytes added to every packet, 0 when off
+    uint8_t requested;          ///< Set by the host, parity is capped for short packets
+    uint8_t limit;              ///< Most parity the packet length leaves room for
+    uint8_t last_errors;        ///< Byte errors corrected in the last packet received
+    uint32_t packets_coded;     ///< Sent with parity
+    uint32_t packets_decoded;   ///< Received with parity, good or not
+    uint32_t packets_corrected; ///< Received with errors, all corrected
+    uint32_t bytes_corrected;
+    uint32_t uncorrectable;     ///< Dropped, more errors than the parity covers
+} radio_fec_stats_t;
+
+void radio_fec_init(radio_inst_t const *radio);
+
+void radio_fec_configure(radio_inst_t const *radio, parameters_t const *params);
+
+bool radio_fec_set_parity(radio_inst_t const *radio, uint32_t parity);
+
+uint32_t radio_fec_parity(radio_inst_t const *radio);
+
+uint32_t radio_fec_overhead(radio_inst_t const *radio);
+
+bool radio_fec_valid_parity(uint32_t parity);
+
+uint32_t radio_fec_encode(radio_inst_t const *radio, uint8_t *packet, uint32_t len);
+
+bool radio_fec_decode(radio_inst_t const *radio, uint8_t *packet, uint32_t data_len, uint32_t len);
+
+void radio_fec_get_stats(radio_inst_t const *radio, radio_fec_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_FEC_H_
@@ -0,0 +1,96 @@
+#include <stddef.h>
+
+#include "radio_flow.h"
+#include "uart_tx.h"
+
+// Bytes that may still sit in the UART hardware FIFO
+#define UART_FIFO_DEPTH 32
+
+// Credits are counted in bytes handed to the UART. The module only raises AUX
+// once its buffer is empty, so a rising edge returns every credit except for the
+// bytes still on their way through the TX queue and the UART FIFO.
+typedef struct {
+    radio_inst_t const *radio;
+    uint32_t window;                ///< Whole packets fitting in the module buffer, in bytes
+    volatile uint32_t sent;         ///< Bytes handed to the UART
+    volatile uint32_t released;     ///< Bytes known to have left the module buffer
+    uint64_t busy_since_us;
+    radio_flow_stats_t stats;
+} radio_flow_t;
+
+static radio_flow_t radio_flow[NUM_UARTS];
+
+static radio_flow_t *get_flow(radio_inst_t const *radio) {
+    return &radio_flow[hal_uart_index(radio->uart)];
+}
+
+static void radio_flow_gpio_irq(uint gpio, uint32_t events) {
+    for (uint i = 0; i < NUM_UARTS; ++i) {
+        radio_flow_t *flow = &radio_flow[i];
+
+        if (flow->radio == NULL || flow->radio->aux_pin != gpio)
+            continue;
+
+        if (events & HAL_GPIO_EDGE_FALL) {
+            flow->stats.busy_edges++;
+            flow->busy_since_us = hal_time_us();
+        }
+
+        if (events & HAL_GPIO_EDGE_RISE) {
+            flow->stats.idle_edges++;
+            if (flow->busy_since_us)
+                flow->stats.busy_us += hal_time_us() - flow->busy_since_us;
+            flow->busy_since_us = 0;
+
+            uart_inst_t *uart = flow->radio->uart;
+            uint32_t in_transit = uart_tx_idle(uart) ? 0 : uart_tx_pending(uart) + UART_FIFO_DEPTH;
+            uint32_t released = flow->sent - in_transit;
+
+            // Never move backwards, in_transit is an upper bound
+            if ((int32_t) (released - flow->released) > 0)
+                flow->released = released;
+        }
+    }
+}
+
+void radio_flow_init(radio_inst_t const *radio) {
+    radio_flow_t *flow = get_flow(radio);
+
+    flow->radio = radio;
+    flow->window = RADIO_FLOW_MODULE_BUFFER_SIZE;
+    flow->sent = 0;
+    flow->released = 0;
+
+    hal_gpio_set_callback(radio->aux_pin, radio_flow_gpio_irq);
+}
+
+void radio_flow_configure(radio_inst_t const *radio, parameters_t const *params) {
+    uint32_t packet_len = get_packet_length(params->opt1);
+
+    // Partial packets wait in the module for more data, only count whole ones
+    get_flow(radio)->window = (RADIO_FLOW_MODULE_BUFFER_SIZE / packet_len) * packet_len;
+}
+
+// Bytes that can be sent without overrunning the module buffer
+uint32_t radio_flow_credits(radio_inst_t const *radio) {
+    radio_flow_t *flow = get_flow(radio);
+    uint32_t outstanding = flow->sent - flow->released;
+    return outstanding < flow->window ? flow->window - outstanding : 0;
+}
+
+// Every byte handed to the UART has left the module
+bool radio_flow_drained(radio_inst_t const *radio) {
+    radio_flow_t *flow = get_flow(radio);
+    return flow->sent == flow->released;
+}
+
+void radio_flow_consume(radio_inst_t const *radio, uint32_t len) {
+    get_flow(radio)->sent += len;
+}
+
+void radio_flow_get_stats(radio_inst_t const *radio, radio_flow_stats_t *stats) {
+    radio_flow_t *flow = get_flow(radio);
+
+    *stats = flow->stats;
+    stats->sent = flow->sent;
+}
@@ -0,0 +1,29 @@
+#ifndef _LORA_BRIDGE_RADIO_FLOW_H_
+#define _LORA_BRIDGE_RADIO_FLOW_H_
+
+#include "radio.h"
+
+// Size of the module transmit buffer
+#define RADIO_FLOW_MODULE_BUFFER_SIZE 400
+
+/// AUX pin counters, updated from the GPIO interrupt
+typedef struct {
+    uint32_t busy_edges;    ///< AUX falling edges, the module started working
+    uint32_t idle_edges;    ///< AUX rising edges, the module buffer is empty
+    uint64_t busy_us;       ///< Total time spent with AUX low
+    uint32_t sent;          ///< Bytes handed to the UART
+} radio_flow_stats_t;
+
+void radio_flow_init(radio_inst_t const *radio);
+
+void radio_flow_configure(radio_inst_t const *radio, parameters_t const *params);
+
+uint32_t radio_flow_credits(radio_inst_t const *radio);
+
+bool radio_flow_drained(radio_inst_t const *radio);
+
+void radio_flow_consume(radio_inst_t const *radio, uint32_t len);
+
+void radio_flow_get_stats(radio_inst_t const *radio, radio_flow_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_FLOW_H_
@@ -0,0 +1,827 @@
+#include <memory.h>
+
+#include "compress.h"
+#include "radio_adapt.h"
+#include "radio_arq.h"
+#include "radio_dest.h"
+#include "radio_fec.h"
+#include "radio_flow.h"
+#include "radio_frame.h"
+#include "radio_rssi.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+
+#define CONTROL_SIZE 4      ///< Longest control message
+#define HELLO_SIZE 2
+
+// A fragment never spans two module packets: full fragments are exactly one
+// packet long, and a short one is followed by a UART idle gap so the module
+// closes its packet before the next fragment starts. A lost packet then takes
+// whole fragments with it and the receiver stays aligned on the headers.
+typedef struct {
+    volatile bool enabled;
+    bool addressed;                 ///< Host datagrams carry a fixed transmission target
+    uint32_t target_len;            ///< Target bytes in front of every fragment
+    uint8_t chan;
+    uint32_t packet_len;
+    uint64_t gap_us;
+
+    // Transmit
+    uint8_t seq;
+    uint8_t index;
+    uint8_t datagram_flags;         ///< RADIO_FRAME_FLAG_COMPRESSED or 0
+    uint8_t tx_datagram[RADIO_FRAME_MAX_DATAGRAM];
+    uint8_t tx_plain[RADIO_FRAME_MAX_DATAGRAM];     ///< Host datagram before compression
+    uint32_t tx_len;
+    uint32_t tx_offset;             ///< Bytes of tx_datagram already fragmented
+    uint32_t discard;               ///< Bytes of an oversized datagram still to drop
+    uint8_t target[RADIO_DEST_ADDRESS_SIZE];
+    uint8_t module_target[RADIO_DEST_ADDRESS_SIZE];     ///< Target of the data in the module buffer
+    uint8_t fragment[RADIO_DEST_ADDRESS_SIZE + RADIO_FRAME_MAX_PACKET];
+    uint32_t fragment_len;          ///< Fragment staged, waiting for credits
+    bool gap;                       ///< A short fragment went out, keep the line idle
+    bool drain;                     ///< And wait for it to leave the module
+    uint64_t idle_since_us;
+
+    // Link control
+    uint8_t control_pending;        ///< Control message type to send, 0 for none
+    uint8_t peer_caps;
+    volatile radio_frame_compress_t compress;
+    uint32_t hello_attempts;
+    uint64_t hello_sent_us;
+
+    // Receive
+    bool rssi_trailer;              ///< The module follows every packet with its RSSI
+    bool rssi_next;                 ///< A fragment just ended, the next byte is its RSSI
+    uint8_t header[RADIO_FRAME_HEADER_SIZE];
+    uint32_t header_len;
+    uint32_t payload_left;
+    bool skip;                      ///< Payload of a fragment out of sequence
+    bool active;                    ///< A datagram is being reassembled
+    uint8_t rx_seq;
+    uint8_t rx_index;
+    uint8_t rx_flags;               ///< Flags of the first fragment
+    uint8_t last_seq;               ///< Sequence number of the last datagram started
+    bool seq_valid;
+    uint8_t control[CONTROL_SIZE];
+    uint32_t control_len;
+    uint8_t reliable[RADIO_FRAME_MAX_PACKET];   ///< Reliable fragment, for radio_arq
+    uint32_t reliable_len;
+    uint8_t coded[RADIO_FRAME_MAX_PACKET];      ///< Packet with parity, for radio_fec
+    uint32_t coded_len;
+    uint32_t coded_body;            ///< Header and body bytes, the parity count follows
+    uint8_t datagram[RADIO_FRAME_PREFIX_SIZE + RADIO_FRAME_MAX_DATAGRAM];
+    uint32_t datagram_len;
+    uint8_t plain[RADIO_FRAME_PREFIX_SIZE + RADIO_FRAME_MAX_DATAGRAM];
+    uint8_t const *ready;           ///< Datagram complete, waiting for room in the queue
+    uint32_t ready_len;
+
+    radio_frame_stats_t stats;
+    radio_frame_compress_stats_t compress_stats;
+} radio_frame_t;
+
+static radio_frame_t radio_frame[NUM_UARTS];
+
+static radio_frame_t *get_frame(radio_inst_t const *radio) {
+    return &radio_frame[hal_uart_index(radio->uart)];
+}
+
+static uint8_t header_check(uint8_t const *header) {
+    return ~(header[0] ^ header[1] ^ header[2] ^ header[3]);
+}
+
+static bool magic_coded(uint8_t flags) {
+    uint8_t magic = flags & RADIO_FRAME_MAGIC_MASK;
+    return magic == RADIO_FRAME_MAGIC_FEC || magic == RADIO_FRAME_MAGIC_FEC_ARQ;
+}
+
+static bool magic_reliable(uint8_t flags) {
+    uint8_t magic = flags & RADIO_FRAME_MAGIC_MASK;
+    return magic == RADIO_FRAME_MAGIC_ARQ || magic == RADIO_FRAME_MAGIC_FEC_ARQ;
+}
+
+void radio_frame_init(radio_inst_t const *radio) {
+    radio_frame_t *frame = get_frame(radio);
+    parameters_t defaults = {
+            .sped = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE,
+            .opt1 = RADIO_PARAM_OPT1_PACKET_LEN_200,
+    };
+
+    memset(frame, 0, sizeof(*frame));
+    radio_frame_configure(radio, &defaults);
+}
+
+void radio_frame_configure(radio_inst_t const *radio, parameters_t const *params) {
+    radio_frame_t *frame = get_frame(radio);
+
+    frame->packet_len = get_packet_length(params->opt1);
+    frame->chan = params->chan;
+    frame->rssi_trailer = (params->opt2 & RADIO_PARAM_OPT2_RSSI_BYTE_MASK) == RADIO_PARAM_OPT2_RSSI_BYTE_ENABLE;
+    frame->rssi_next = false;
+    frame->gap_us = (uint64_t) RADIO_FRAME_GAP_BYTES * 10 * 1000000 / get_uart_baud(params->sped);
+}
+
+// Both directions start over, anything half way through is dropped
+void radio_frame_set_enabled(radio_inst_t const *radio, bool enabled) {
+    radio_frame_t *frame = get_frame(radio);
+
+    frame->tx_len = 0;
+    frame->tx_offset = 0;
+    frame->discard = 0;
+    frame->fragment_len = 0;
+    frame->gap = false;
+    frame->header_len = 0;
+    frame->rssi_next = false;
+    frame->payload_left = 0;
+    frame->active = false;
+    frame->seq_valid = false;
+    frame->ready = NULL;
+    frame->addressed = false;
+    frame->target_len = 0;
+    frame->enabled = enabled;
+
+    radio_dest_reset(radio);
+    radio_arq_reset(radio);
+
+    // Only framed packets are coded
+    if (!enabled)
+        radio_fec_set_parity(radio, 0);
+}
+
+// Framed mode where every host datagram starts with its target, the module
+// must be set to fixed transmission
+void radio_frame_set_addressed(radio_inst_t const *radio, bool addressed) {
+    radio_frame_t *frame = get_frame(radio);
+
+    radio_frame_set_enabled(radio, true);
+    frame->addressed = addressed;
+    frame->target_len = addressed ? RADIO_DEST_ADDRESS_SIZE : 0;
+}
+
+bool radio_frame_addressed(radio_inst_t const *radio) {
+    return get_frame(radio)->addressed;
+}
+
+bool radio_frame_enabled(radio_inst_t const *radio) {
+    return get_frame(radio)->enabled;
+}
+
+// Compression is used once the peer confirms it decodes compressed datagrams
+void radio_frame_set_compression(radio_inst_t const *radio, bool enabled) {
+    radio_frame_t *frame = get_frame(radio);
+
+    if (!enabled) {
+        frame->compress = RADIO_FRAME_COMPRESS_OFF;
+        return;
+    }
+
+    if (frame->peer_caps & RADIO_FRAME_CAPS_COMPRESS) {
+        frame->compress = RADIO_FRAME_COMPRESS_ACTIVE;
+        return;
+    }
+
+    frame->compress = RADIO_FRAME_COMPRESS_NEGOTIATING;
+    frame->hello_attempts = 0;
+    frame->hello_sent_us = 0;
+}
+
+radio_frame_compress_t radio_frame_compression(radio_inst_t const *radio) {
+    return get_frame(radio)->compress;
+}
+
+void radio_frame_get_compress_stats(radio_inst_t const *radio, radio_frame_compress_stats_t *stats) {
+    *stats = get_frame(radio)->compress_stats;
+}
+
+//--------------------------------------------------------------------+
+// Transmit
+//--------------------------------------------------------------------+
+
+static void stage(radio_frame_t *frame, uint8_t flags, uint8_t index, uint8_t const *payload, uint32_t len) {
+    uint8_t *start = &frame->fragment[frame->target_len];
+    radio_frame_header_t *header = (radio_frame_header_t *) start;
+
+    // The module takes the fixed transmission target off the front, control
+    // messages go to every bridge on the channel
+    if (frame->target_len > 0 && (flags & RADIO_FRAME_FLAG_CONTROL)) {
+        frame->fragment[0] = RADIO_DEST_BROADCAST >> 8;
+        frame->fragment[1] = RADIO_DEST_BROADCAST & 0xFF;
+        frame->fragment[2] = frame->chan;
+    } else if (frame->target_len > 0) {
+        memcpy(frame->fragment, frame->target, RADIO_DEST_ADDRESS_SIZE);
+    }
+
+    header->flags = RADIO_FRAME_MAGIC | flags;
+    header->seq = frame->seq;
+    header->index = index;
+    header->len = len;
+    header->check = header_check(start);
+
+    memcpy(&start[RADIO_FRAME_HEADER_SIZE], payload, len);
+    frame->fragment_len = frame->target_len + RADIO_FRAME_HEADER_SIZE + len;
+}
+
+// Reliable fragments are never addressed, radio_arq numbers them and adds the CRC
+static void stage_reliable(radio_inst_t const *radio, radio_frame_t *frame, uint8_t flags, uint8_t index,
+                           uint8_t const *payload, uint32_t len, bool more) {
+    radio_frame_header_t *header = (radio_frame_header_t *) frame->fragment;
+
+    header->flags = RADIO_FRAME_MAGIC_ARQ | flags;
+    header->seq = frame->seq;
+    header->index = index;
+    header->len = len;
+    header->check = header_check(frame->fragment);
+
+    memcpy(&frame->fragment[RADIO_FRAME_HEADER_SIZE + RADIO_ARQ_FIELDS_SIZE], payload, len);
+    frame->fragment_len = radio_arq_seal(radio, frame->fragment,
+                                         RADIO_FRAME_HEADER_SIZE + RADIO_ARQ_FIELDS_SIZE + len, more);
+}
+
+// Acks go out between any two fragments, other control messages only in
+// between datagrams
+static bool stage_control(radio_inst_t const *radio, radio_frame_t *frame, bool between) {
+    uint8_t control[CONTROL_SIZE];
+    uint32_t len = radio_arq_stage_control(radio, control);
+
+    if (len > 0) {
+        stage(frame, RADIO_FRAME_FLAG_CONTROL | RADIO_FRAME_FLAG_FIRST | RADIO_FRAME_FLAG_LAST, 0, control, len);
+        return true;
+    }
+
+    if (!between)
+        return false;
+
+    // Keep asking until the peer answers
+    if (frame->compress == RADIO_FRAME_COMPRESS_NEGOTIATING && frame->control_pending == 0) {
+        uint64_t now = hal_time_us();
+
+        if (frame->hello_attempts == RADIO_FRAME_HELLO_ATTEMPTS) {
+            frame->compress = RADIO_FRAME_COMPRESS_UNSUPPORTED;
+        } else if (frame->hello_sent_us == 0 || now - frame->hello_sent_us >= RADIO_FRAME_HELLO_INTERVAL_US) {
+            frame->control_pending = RADIO_FRAME_CONTROL_HELLO;
+            frame->hello_sent_us = now;
+            frame->hello_attempts++;
+        }
+    }
+
+    control[0] = frame->control_pending;
+    control[1] = RADIO_FRAME_CAPS_COMPRESS;
+    len = HELLO_SIZE;
+
+    if (frame->control_pending == 0 && (len = radio_adapt_stage_control(radio, control)) == 0)
+        return false;
+
+    stage(frame, RADIO_FRAME_FLAG_CONTROL | RADIO_FRAME_FLAG_FIRST | RADIO_FRAME_FLAG_LAST, 0, control, len);
+    frame->control_pending = 0;
+    return true;
+}
+
+// Length of the datagram at offset in the queue, once all of it arrived
+static bool datagram_at(ring_buffer_t const *queue, uint32_t offset, uint32_t *len) {
+    uint32_t count = ring_buffer_count(queue);
+    if (count < offset + RADIO_FRAME_PREFIX_SIZE)
+        return false;
+
+    *len = ring_buffer_at(queue, offset) | ring_buffer_at(queue, offset + 1) << 8;
+    return count >= offset + RADIO_FRAME_PREFIX_SIZE + *len;
+}
+
+// Length of the datagram at the head of the queue once all of it arrived, its
+// prefix still in place. Datagrams longer than max_len are dropped.
+static bool next_datagram(radio_frame_t *frame, ring_buffer_t *queue, uint32_t max_len, uint32_t *len) {
+    while (frame->discard > 0) {
+        uint8_t byte;
+        if (!ring_buffer_get(queue, &byte))
+            return false;
+
+        frame->discard--;
+    }
+
+    if (ring_buffer_count(queue) < RADIO_FRAME_PREFIX_SIZE)
+        return false;
+
+    *len = ring_buffer_at(queue, 0) | ring_buffer_at(queue, 1) << 8;
+    if (*len > max_len) {
+        ring_buffer_consume(queue, RADIO_FRAME_PREFIX_SIZE);
+        frame->stats.oversized++;
+        frame->discard = *len;
+        return false;
+    }
+
+    return datagram_at(queue, 0, len);
+}
+
+// Whether a datagram queued behind offset could go to its target right away
+static bool others_waiting(radio_inst_t const *radio, ring_buffer_t const *queue, uint32_t offset) {
+    uint32_t len;
+
+    while (datagram_at(queue, offset, &len)) {
+        uint8_t const target[RADIO_DEST_ADDRESS_SIZE] = {
+                ring_buffer_at(queue, offset + RADIO_FRAME_PREFIX_SIZE),
+                ring_buffer_at(queue, offset + RADIO_FRAME_PREFIX_SIZE + 1),
+                ring_buffer_at(queue, offset + RADIO_FRAME_PREFIX_SIZE + 2),
+        };
+
+        if (len > RADIO_DEST_ADDRESS_SIZE && radio_dest_has_room(radio, target, len - RADIO_DEST_ADDRESS_SIZE))
+            return true;
+
+        offset += RADIO_FRAME_PREFIX_SIZE + len;
+    }
+
+    return false;
+}
+
+// Moves the addressed datagrams from the host queue to the queues of their
+// targets. One for a full queue waits there, pushing back on the host, until
+// it holds up a datagram for another target: then it is dropped instead.
+static void sort_datagrams(radio_inst_t const *radio, radio_frame_t *frame, ring_buffer_t *queue) {
+    uint32_t len;
+
+    while (next_datagram(frame, queue, RADIO_DEST_ADDRESS_SIZE + RADIO_FRAME_MAX_DATAGRAM, &len)) {
+        if (len > RADIO_DEST_ADDRESS_SIZE) {
+            uint8_t const target[RADIO_DEST_ADDRESS_SIZE] = {
+                    ring_buffer_at(queue, RADIO_FRAME_PREFIX_SIZE),
+                    ring_buffer_at(queue, RADIO_FRAME_PREFIX_SIZE + 1),
+                    ring_buffer_at(queue, RADIO_FRAME_PREFIX_SIZE + 2),
+            };
+
+            if (!radio_dest_has_room(radio, target, len - RADIO_DEST_ADDRESS_SIZE) &&
+                !others_waiting(radio, queue, RADIO_FRAME_PREFIX_SIZE + len))
+                return;
+        }
+
+        ring_buffer_consume(queue, RADIO_FRAME_PREFIX_SIZE);
+
+        // No payload behind the target, nothing to send
+        if (len <= RADIO_DEST_ADDRESS_SIZE)
+            ring_buffer_consume(queue, len);
+        else
+            radio_dest_push(radio, queue, len);
+    }
+}
+
+// Takes the next datagram from the host queue once all of it arrived, in
+// addressed mode from the queue of the next target in turn
+static bool load_datagram(radio_inst_t const *radio, radio_frame_t *frame, ring_buffer_t *queue) {
+    if (frame->addressed) {
+        sort_datagrams(radio, frame, queue);
+
+        queue = radio_dest_next(radio, frame->target);
+        if (queue == NULL)
+            return false;
+    }
+
+    uint32_t len;
+    if (!next_datagram(frame, queue, RADIO_FRAME_MAX_DATAGRAM, &len))
+        return false;
+
+    ring_buffer_consume(queue, RADIO_FRAME_PREFIX_SIZE);
+    if (len == 0)
+        return false;
+
+    frame->datagram_flags = 0;
+    frame->tx_len = len;
+    frame->tx_offset = 0;
+    frame->index = 0;
+    frame->seq++;
+
+    if (frame->compress != RADIO_FRAME_COMPRESS_ACTIVE) {
+        ring_buffer_read(queue, frame->tx_datagram, len);
+        return true;
+    }
+
+    // Kept only when it saves air time
+    ring_buffer_read(queue, frame->tx_plain, len);
+
+    uint32_t coded = compress_block(frame->tx_plain, len, frame->tx_datagram, len - 1);
+    frame->compress_stats.tx_plain += len;
+
+    if (coded == 0) {
+        memcpy(frame->tx_datagram, frame->tx_plain, len);
+        frame->compress_stats.incompressible++;
+        frame->compress_stats.tx_coded += len;
+        return true;
+    }
+
+    frame->datagram_flags = RADIO_FRAME_FLAG_COMPRESSED;
+    frame->tx_len = coded;
+    frame->compress_stats.tx_coded += coded;
+    return true;
+}
+
+static uint32_t next_fragment(radio_inst_t const *radio, radio_frame_t *frame, ring_buffer_t *queue) {
+    // The module must see the line idle after a short fragment. Behind a
+    // packet on air it would still join the next one, throwing reliable
+    // packets out of step with the fragments.
+    if (frame->gap) {
+        if (!uart_tx_idle(radio->uart) || (frame->drain && !radio_flow_drained(radio))) {
+            frame->idle_since_us = 0;
+            return 0;
+        }
+
+        uint64_t now = hal_time_us();
+        if (frame->idle_since_us == 0)
+            frame->idle_since_us = now;
+
+        if (now - frame->idle_since_us < frame->gap_us)
+            return 0;
+
+        frame->gap = false;
+    }
+
+    bool between = frame->tx_offset == frame->tx_len;
+    if (stage_control(radio, frame, between))
+        return frame->fragment_len;
+
+    // Data waits until the peer numbers packets the same way, lost ones go first
+    radio_arq_state_t arq = radio_arq_state(radio);
+    if (arq == RADIO_ARQ_SYNCING)
+        return 0;
+
+    if (arq == RADIO_ARQ_ACTIVE) {
+        frame->fragment_len = radio_arq_stage_retransmit(radio, frame->fragment);
+        if (frame->fragment_len > 0 || !radio_arq_can_send(radio))
+            return frame->fragment_len;
+    }
+
+    if (between && !load_datagram(radio, frame, queue))
+        return 0;
+
+    uint32_t payload = frame->packet_len - RADIO_FRAME_HEADER_SIZE - radio_fec_overhead(radio) -
+                       (arq == RADIO_ARQ_ACTIVE ? RADIO_ARQ_OVERHEAD : 0);
+    if (payload > frame->tx_len - frame->tx_offset)
+        payload = frame->tx_len - frame->tx_offset;
+
+    uint8_t flags = frame->datagram_flags;
+    if (frame->tx_offset == 0)
+        flags |= RADIO_FRAME_FLAG_FIRST;
+    if (frame->tx_offset + payload == frame->tx_len)
+        flags |= RADIO_FRAME_FLAG_LAST;
+
+    uint8_t const *start = &frame->tx_datagram[frame->tx_offset];
+    frame->tx_offset += payload;
+
+    // A poll waits for its ack, only the last packet of a burst asks for one
+    if (arq == RADIO_ARQ_ACTIVE) {
+        uint32_t next_len;
+        bool more = frame->tx_offset < frame->tx_len || (frame->discard == 0 && datagram_at(queue, 0, &next_len));
+        stage_reliable(radio, frame, flags, frame->index++, start, payload, more);
+    } else {
+        stage(frame, flags, frame->index++, start, payload);
+    }
+
+    return frame->fragment_len;
+}
+
+// Parity goes on once the fragment is final, radio_arq keeps its copies without
+static uint32_t stage_fragment(radio_inst_t const *radio, radio_frame_t *frame, ring_buffer_t *queue) {
+    if (frame->fragment_len > 0 || next_fragment(radio, frame, queue) == 0 || radio_fec_parity(radio) == 0)
+        return frame->fragment_len;
+
+    uint8_t *start = &frame->fragment[frame->target_len];
+    start[0] += RADIO_FRAME_MAGIC_FEC - RADIO_FRAME_MAGIC;
+    start[RADIO_FRAME_HEADER_SIZE - 1] = header_check(start);
+
+    frame->fragment_len = frame->target_len + radio_fec_encode(radio, start, frame->fragment_len - frame->target_len);
+    return frame->fragment_len;
+}
+
+// Stages the next fragment from the host queue, returns its length or 0 while
+// there is nothing to send yet
+uint32_t radio_frame_tx_fragment(radio_inst_t const *radio, ring_buffer_t *queue, uint8_t const **fragment) {
+    radio_frame_t *frame = get_frame(radio);
+    uint32_t len = stage_fragment(radio, frame, queue);
+    *fragment = frame->fragment;
+
+    // The module applies the latest target to everything it holds, a new
+    // target waits until the data for the previous one is on air
+    if (len > 0 && frame->target_len > 0 &&
+        memcmp(frame->fragment, frame->module_target, RADIO_DEST_ADDRESS_SIZE) != 0 && !radio_flow_drained(radio))
+        return 0;
+
+    return len;
+}
+
+// The staged fragment was written to the UART
+void radio_frame_tx_done(radio_inst_t const *radio) {
+    radio_frame_t *frame = get_frame(radio);
+    uint8_t flags = frame->fragment[frame->target_len];
+
+    // Every addressed fragment is a UART frame of its own, starting with its target
+    frame->gap = frame->target_len > 0 || frame->fragment_len < frame->packet_len;
+    frame->drain = frame->gap && radio_arq_state(radio) == RADIO_ARQ_ACTIVE;
+    memcpy(frame->module_target, frame->fragment, frame->target_len);
+    frame->idle_since_us = 0;
+    frame->fragment_len = 0;
+
+    if (flags & RADIO_FRAME_FLAG_CONTROL) {
+        radio_adapt_control_sent(radio, frame->fragment[frame->target_len + RADIO_FRAME_HEADER_SIZE]);
+        return;
+    }
+
+    // Retransmissions are counted by radio_arq
+    if (magic_reliable(flags) && !radio_arq_sent(radio, frame->fragment))
+        return;
+
+    frame->stats.fragments_sent++;
+    if (flags & RADIO_FRAME_FLAG_LAST)
+        frame->stats.datagrams_sent++;
+}
+
+//--------------------------------------------------------------------+
+// Receive
+//--------------------------------------------------------------------+
+
+static void control_done(radio_inst_t const *radio, radio_frame_t *frame) {
+    if (frame->control_len == 0)
+        return;
+
+    if (frame->control[0] >= RADIO_FRAME_CONTROL_ARQ_SYNC) {
+        radio_arq_control(radio, frame->control, frame->control_len);
+        return;
+    }
+
+    if (frame->control[0] != RADIO_FRAME_CONTROL_HELLO && frame->control[0] != RADIO_FRAME_CONTROL_HELLO_ACK) {
+        radio_adapt_control(radio, frame->control, frame->control_len);
+        return;
+    }
+
+    if (frame->control_len < HELLO_SIZE)
+        return;
+
+    frame->peer_caps = frame->control[1];
+
+    if (frame->control[0] == RADIO_FRAME_CONTROL_HELLO)
+        frame->control_pending = RADIO_FRAME_CONTROL_HELLO_ACK;
+
+    if (frame->compress == RADIO_FRAME_COMPRESS_NEGOTIATING && (frame->peer_caps & RADIO_FRAME_CAPS_COMPRESS))
+        frame->compress = RADIO_FRAME_COMPRESS_ACTIVE;
+}
+
+static void datagram_done(radio_frame_t *frame) {
+    uint32_t len = frame->datagram_len - RADIO_FRAME_PREFIX_SIZE;
+    uint8_t *out = frame->datagram;
+
+    if (frame->rx_flags & RADIO_FRAME_FLAG_COMPRESSED) {
+        uint32_t plain_len = decompress_block(&frame->datagram[RADIO_FRAME_PREFIX_SIZE], len,
+                                              &frame->plain[RADIO_FRAME_PREFIX_SIZE], RADIO_FRAME_MAX_DATAGRAM);
+
+        if (plain_len == 0) {
+            frame->compress_stats.errors++;
+            return;
+        }
+
+        frame->compress_stats.rx_coded += len;
+        frame->compress_stats.rx_plain += plain_len;
+        len = plain_len;
+        out = frame->plain;
+    } else {
+        frame->compress_stats.rx_coded += len;
+        frame->compress_stats.rx_plain += len;
+    }
+
+    out[0] = len & 0xFF;
+    out[1] = len >> 8;
+    frame->ready = out;
+    frame->ready_len = RADIO_FRAME_PREFIX_SIZE + len;
+}
+
+static void fragment_done(radio_inst_t const *radio, radio_frame_t *frame, uint8_t flags) {
+    if (flags & RADIO_FRAME_FLAG_CONTROL) {
+        control_done(radio, frame);
+        return;
+    }
+
+    frame->stats.fragments_received++;
+    frame->rx_index++;
+
+    if (frame->active && (flags & RADIO_FRAME_FLAG_LAST)) {
+        frame->active = false;
+        datagram_done(frame);
+    }
+}
+
+// Fits a data fragment into the datagram being reassembled, its payload is
+// skipped when it does not
+static void start_fragment(radio_frame_t *frame, radio_frame_header_t const *header) {
+    if (header->flags & RADIO_FRAME_FLAG_FIRST) {
+        if (frame->active)
+            frame->stats.incomplete++;
+
+        // Datagrams never seen at all, a gap this long means the peer started over
+        uint8_t gap = header->seq - frame->last_seq - 1;
+        if (frame->seq_valid && gap < 128)
+            frame->stats.lost += gap;
+
+        frame->last_seq = header->seq;
+        frame->seq_valid = true;
+        frame->active = true;
+        frame->rx_seq = header->seq;
+        frame->rx_index = 0;
+        frame->rx_flags = header->flags;
+        frame->datagram_len = RADIO_FRAME_PREFIX_SIZE;
+    } else if (frame->active && (header->seq != frame->rx_seq || header->index != frame->rx_index)) {
+        frame->stats.incomplete++;
+        frame->active = false;
+    }
+
+    if (frame->active && frame->datagram_len + header->len > sizeof(frame->datagram)) {
+        frame->stats.incomplete++;
+        frame->active = false;
+    }
+
+    frame->skip = !frame->active;
+}
+
+// Data fragment taken whole, from radio_arq or radio_fec
+static void take_fragment(radio_inst_t const *radio, radio_frame_t *frame, radio_frame_header_t const *header,
+                          uint8_t const *payload) {
+    start_fragment(frame, header);
+
+    if (!frame->skip) {
+        memcpy(&frame->datagram[frame->datagram_len], payload, header->len);
+        frame->datagram_len += header->len;
+    }
+
+    fragment_done(radio, frame, header->flags);
+}
+
+// Once corrected the packet goes on as it was before the parity went on
+static void coded_done(radio_inst_t const *radio, radio_frame_t *frame) {
+    uint8_t *packet = frame->coded;
+    radio_frame_header_t const *header = (radio_frame_header_t const *) packet;
+
+    if (!radio_fec_decode(radio, packet, frame->coded_body, frame->coded_len))
+        return;
+
+    packet[0] -= RADIO_FRAME_MAGIC_FEC - RADIO_FRAME_MAGIC;
+    packet[RADIO_FRAME_HEADER_SIZE - 1] = header_check(packet);
+
+    if (magic_reliable(header->flags)) {
+        radio_arq_receive(radio, packet, frame->coded_body);
+    } else if (header->flags & RADIO_FRAME_FLAG_CONTROL) {
+        frame->control_len = header->len < CONTROL_SIZE ? header->len : CONTROL_SIZE;
+        memcpy(frame->control, &packet[RADIO_FRAME_HEADER_SIZE], frame->control_len);
+        fragment_done(radio, frame, header->flags);
+    } else {
+        take_fragment(radio, frame, header, &packet[RADIO_FRAME_HEADER_SIZE]);
+    }
+}
+
+static void header_done(radio_inst_t const *radio, radio_frame_t *frame) {
+    radio_frame_header_t const *header = (radio_frame_header_t const *) frame->header;
+
+    frame->payload_left = header->len;
+    frame->header_len = 0;
+    radio_adapt_heard(radio);
+
+    // Packets with parity are decoded whole, reliable fragments are taken whole
+    // and radio_arq hands them back in order. Control messages leave the
+    // datagram being reassembled alone.
+    if (magic_coded(header->flags)) {
+        memcpy(frame->coded, frame->header, RADIO_FRAME_HEADER_SIZE);
+        frame->coded_len = RADIO_FRAME_HEADER_SIZE;
+        frame->coded_body = RADIO_FRAME_HEADER_SIZE + header->len +
+                            (magic_reliable(header->flags) ? RADIO_ARQ_OVERHEAD : 0);
+        frame->payload_left = frame->coded_body - RADIO_FRAME_HEADER_SIZE + RADIO_FEC_FIELD_SIZE;
+        return;
+    }
+
+    if ((header->flags & RADIO_FRAME_MAGIC_MASK) == RADIO_FRAME_MAGIC_ARQ) {
+        memcpy(frame->reliable, frame->header, RADIO_FRAME_HEADER_SIZE);
+        frame->reliable_len = RADIO_FRAME_HEADER_SIZE;
+        frame->payload_left += RADIO_ARQ_OVERHEAD;
+        return;
+    }
+
+    if (header->flags & RADIO_FRAME_FLAG_CONTROL) {
+        frame->control_len = 0;
+        frame->skip = false;
+    } else {
+        start_fragment(frame, header);
+    }
+
+    if (frame->payload_left == 0) {
+        fragment_done(radio, frame, header->flags);
+        frame->rssi_next = frame->rssi_trailer;
+    }
+}
+
+// Fragments fill one packet each, so the RSSI byte comes right after them
+static void parse(radio_inst_t const *radio, radio_frame_t *frame, uint8_t byte) {
+    if (frame->rssi_next) {
+        frame->rssi_next = false;
+        radio_rssi_record(radio, byte);
+        return;
+    }
+
+    if (frame->payload_left > 0) {
+        uint8_t flags = frame->header[0];
+        bool coded = magic_coded(flags);
+        bool reliable = !coded && magic_reliable(flags);
+
+        // The parity count tells how much more is coming, a bad one ends the packet
+        if (coded) {
+            frame->coded[frame->coded_len++] = byte;
+            if (frame->coded_len == frame->coded_body + RADIO_FEC_FIELD_SIZE && radio_fec_valid_parity(byte) &&
+                frame->coded_len + byte <= RADIO_FRAME_MAX_PACKET)
+                frame->payload_left += byte;
+        } else if (reliable) {
+            frame->reliable[frame->reliable_len++] = byte;
+        } else if (frame->header[0] & RADIO_FRAME_FLAG_CONTROL) {
+            if (frame->control_len < CONTROL_SIZE)
+                frame->control[frame->control_len++] = byte;
+        } else if (!frame->skip) {
+            frame->datagram[frame->datagram_len++] = byte;
+        }
+
+        if (--frame->payload_left == 0) {
+            if (coded)
+                coded_done(radio, frame);
+            else if (reliable)
+                radio_arq_receive(radio, frame->reliable, frame->reliable_len);
+            else
+                fragment_done(radio, frame, frame->header[0]);
+
+            frame->rssi_next = frame->rssi_trailer;
+        }
+
+        return;
+    }
+
+    frame->header[frame->header_len++] = byte;
+
+    // Slide over bytes that cannot start a header
+    while (frame->header_len > 0) {
+        radio_frame_header_t const *header = (radio_frame_header_t const *) frame->header;
+        uint8_t magic = header->flags & RADIO_FRAME_MAGIC_MASK;
+        bool reliable = magic_reliable(header->flags);
+        bool valid = (magic == RADIO_FRAME_MAGIC || reliable || magic_coded(header->flags)) &&
+                     !(reliable && (header->flags & RADIO_FRAME_FLAG_CONTROL));
+
+        if (valid && frame->header_len == RADIO_FRAME_HEADER_SIZE)
+            valid = header->check == header_check(frame->header) &&
+                    header->len <= RADIO_FRAME_MAX_PAYLOAD - (reliable ? RADIO_ARQ_OVERHEAD : 0) -
+                                   (magic_coded(header->flags) ? RADIO_FEC_FIELD_SIZE + RADIO_FEC_MIN_PARITY : 0);
+
+        if (valid)
+            break;
+
+        frame->stats.resync_bytes++;
+        memmove(frame->header, &frame->header[1], --frame->header_len);
+    }
+
+    if (frame->header_len == RADIO_FRAME_HEADER_SIZE)
+        header_done(radio, frame);
+}
+
+// Next reliable fragment in sequence, never in the middle of a plain one
+static bool deliver(radio_inst_t const *radio, radio_frame_t *frame) {
+    uint8_t const *packet;
+
+    if (frame->payload_left > 0 &&
+        (frame->header[0] & (RADIO_FRAME_MAGIC_MASK | RADIO_FRAME_FLAG_CONTROL)) == RADIO_FRAME_MAGIC)
+        return false;
+
+    if (radio_arq_next(radio, &packet) == 0)
+        return false;
+
+    take_fragment(radio, frame, (radio_frame_header_t const *) packet,
+                  &packet[RADIO_FRAME_HEADER_SIZE + RADIO_ARQ_FIELDS_SIZE]);
+    radio_arq_consume(radio);
+    return true;
+}
+
+// Reassembles datagrams from the module, complete ones go to the host queue
+void radio_frame_receive(radio_inst_t const *radio, ring_buffer_t *queue) {
+    radio_frame_t *frame = get_frame(radio);
+    uint8_t const *data;
+    uint32_t len;
+
+    while (true) {
+        if (frame->ready) {
+            if (ring_buffer_space(queue) < frame->ready_len)
+                return;
+
+            ring_buffer_write(queue, frame->ready, frame->ready_len);
+            frame->stats.datagrams_received++;
+            frame->ready = NULL;
+        }
+
+        if (deliver(radio, frame))
+            continue;
+
+        if ((len = uart_rx_peek(radio->uart, &data)) == 0)
+            return;
+
+        uint32_t i = 0;
+        while (i < len && !frame->ready)
+            parse(radio, frame, data[i++]);
+
+        uart_rx_consume(radio->uart, i);
+    }
+}
+
+void radio_frame_get_stats(radio_inst_t const *radio, radio_frame_stats_t *stats) {
+    *stats = get_frame(radio)->stats;
+}
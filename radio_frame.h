@@ -0,0 +1,109 @@
+#ifndef _LORA_BRIDGE_RADIO_FRAME_H_
+#define _LORA_BRIDGE_RADIO_FRAME_H_
+
+#include "radio.h"
+#include "ring_buffer.h"
+
+// Framed mode: the host writes datagrams as a 16-bit little endian length and
+// the payload. Datagrams travel as fragments, each filling at most one module
+// packet and starting with a link header. The receiving bridge hands complete
+// datagrams to its host with the same length prefix.
+
+#define RADIO_FRAME_MAX_DATAGRAM    1000    ///< Longest payload, with its prefix it fits the CDC FIFO
+#define RADIO_FRAME_PREFIX_SIZE     2
+#define RADIO_FRAME_MAX_PACKET      200
+
+// Link header
+#define RADIO_FRAME_HEADER_SIZE     5
+#define RADIO_FRAME_MAGIC           0xA0    ///< Upper nibble of the flags byte
+#define RADIO_FRAME_MAGIC_MASK      0xF0
+#define RADIO_FRAME_MAGIC_ARQ       0xB0    ///< Reliable fragment, see radio_arq.h
+#define RADIO_FRAME_MAGIC_FEC       0xC0    ///< Fragment with parity, see radio_fec.h
+#define RADIO_FRAME_MAGIC_FEC_ARQ   0xD0    ///< Reliable fragment with parity
+#define RADIO_FRAME_FLAG_FIRST      0x01    ///< First fragment of a datagram
+#define RADIO_FRAME_FLAG_LAST       0x02    ///< Last fragment of a datagram
+#define RADIO_FRAME_FLAG_CONTROL    0x04    ///< Link control message, never passed to the host
+#define RADIO_FRAME_FLAG_COMPRESSED 0x08    ///< Datagram payload compressed with compress_block()
+
+// Link control messages, a type byte and its arguments
+#define RADIO_FRAME_CONTROL_HELLO           0x01    ///< Announces capabilities, answered with HELLO_ACK
+#define RADIO_FRAME_CONTROL_HELLO_ACK       0x02
+#define RADIO_FRAME_CONTROL_RATE_REQUEST    0x03    ///< Rate control, see radio_adapt.h
+#define RADIO_FRAME_CONTROL_RATE_ACK        0x04
+#define RADIO_FRAME_CONTROL_RATE_CHECK      0x05
+#define RADIO_FRAME_CONTROL_ARQ_SYNC        0x06    ///< Reliable fragments, see radio_arq.h
+#define RADIO_FRAME_CONTROL_ARQ_SYNC_ACK    0x07
+#define RADIO_FRAME_CONTROL_ARQ_ACK         0x08
+#define RADIO_FRAME_CAPS_COMPRESS           0x01    ///< Decodes RADIO_FRAME_FLAG_COMPRESSED datagrams
+
+#define RADIO_FRAME_HELLO_INTERVAL_US   (1000 * 1000)
+#define RADIO_FRAME_HELLO_ATTEMPTS      5
+
+#define RADIO_FRAME_MAX_PAYLOAD     (RADIO_FRAME_MAX_PACKET - RADIO_FRAME_HEADER_SIZE)
+
+// UART idle time after a short fragment, makes the module close its packet
+#define RADIO_FRAME_GAP_BYTES       4
+
+/// Link header at the start of every fragment
+typedef struct {
+    uint8_t flags;      ///< RADIO_FRAME_MAGIC and RADIO_FRAME_FLAG_*
+    uint8_t seq;        ///< Datagram sequence number
+    uint8_t index;      ///< Fragment number within the datagram
+    uint8_t len;        ///< Payload bytes following the header
+    uint8_t check;      ///< Complement of the XOR of the other header bytes
+} radio_frame_header_t;
+
+typedef struct {
+    uint32_t datagrams_sent;
+    uint32_t datagrams_received;
+    uint32_t fragments_sent;
+    uint32_t fragments_received;
+    uint32_t oversized;         ///< Host datagrams dropped, longer than RADIO_FRAME_MAX_DATAGRAM
+    uint32_t incomplete;        ///< Datagrams dropped, a fragment went missing
+    uint32_t resync_bytes;      ///< Bytes skipped looking for a valid header
+    uint32_t lost;              ///< Datagrams missing from the sequence numbers
+} radio_frame_stats_t;
+
+typedef enum {
+    RADIO_FRAME_COMPRESS_OFF = 0,
+    RADIO_FRAME_COMPRESS_NEGOTIATING,   ///< Waiting for the peer to confirm it decodes
+    RADIO_FRAME_COMPRESS_ACTIVE,
+    RADIO_FRAME_COMPRESS_UNSUPPORTED,   ///< The peer never answered
+} radio_frame_compress_t;
+
+typedef struct {
+    uint32_t tx_plain;          ///< Datagram bytes from the host
+    uint32_t tx_coded;          ///< The same bytes as sent over the air
+    uint32_t rx_coded;          ///< Datagram bytes received over the air
+    uint32_t rx_plain;          ///< The same bytes handed to the host
+    uint32_t incompressible;    ///< Datagrams sent as is, compression did not help
+    uint32_t errors;            ///< Received datagrams failing to decompress
+} radio_frame_compress_stats_t;
+
+void radio_frame_init(radio_inst_t const *radio);
+
+void radio_frame_configure(radio_inst_t const *radio, parameters_t const *params);
+
+void radio_frame_set_enabled(radio_inst_t const *radio, bool enabled);
+
+bool radio_frame_enabled(radio_inst_t const *radio);
+
+void radio_frame_set_addressed(radio_inst_t const *radio, bool addressed);
+
+bool radio_frame_addressed(radio_inst_t const *radio);
+
+void radio_frame_set_compression(radio_inst_t const *radio, bool enabled);
+
+radio_frame_compress_t radio_frame_compression(radio_inst_t const *radio);
+
+void radio_frame_get_compress_stats(radio_inst_t const *radio, radio_frame_compress_stats_t *stats);
+
+uint32_t radio_frame_tx_fragment(radio_inst_t const *radio, ring_buffer_t *queue, uint8_t const **fragment);
+
+void radio_frame_tx_done(radio_inst_t const *radio);
+
+void radio_frame_receive(radio_inst_t const *radio, ring_buffer_t *queue);
+
+void radio_frame_get_stats(radio_inst_t const *radio, radio_frame_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_FRAME_H_
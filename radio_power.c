@@ -0,0 +1,158 @@
+#include <stddef.h>
+
+#include "radio_flow.h"
+#include "radio_power.h"
+#include "uart_rx.h"
+
+typedef struct {
+    radio_power_stats_t stats;
+    bool enabled;                   ///< This end duty-cycles
+    bool peer_wor;                  ///< The other end does, send with the preamble
+    bool writing;
+    uint64_t last_activity_us;
+    uint64_t last_tick_us;
+    uint64_t mode_us[MODE_SLEEP + 1];
+    uint32_t last_received;         ///< UART counter at the last check
+} radio_power_t;
+
+static radio_power_t radio_power[NUM_UARTS];
+
+static radio_power_t *get_power(radio_inst_t const *radio) {
+    return &radio_power[hal_uart_index(radio->uart)];
+}
+
+// Longest cycle not above the target
+static uint8_t wor_cycle(uint32_t latency_ms) {
+    uint32_t cycle = latency_ms / RADIO_POWER_MIN_LATENCY_MS - 1;
+    return cycle > RADIO_PARAM_OPT2_WOR_CYCLE_4000 ? RADIO_PARAM_OPT2_WOR_CYCLE_4000 : cycle;
+}
+
+static void write_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    (void) success;
+    (void) params;
+    (void) user_data;
+
+    get_power(radio)->writing = false;
+}
+
+// The WOR cycle of the module, once it differs from the one the target picked
+static bool write_cycle(radio_inst_t const *radio, radio_power_t *power) {
+    parameters_t params;
+    if (!get_parameters(radio, &params) || (params.opt2 & RADIO_PARAM_OPT2_WOR_CYCLE_MASK) == power->stats.wor_cycle)
+        return false;
+
+    params.opt2 = (params.opt2 & ~RADIO_PARAM_OPT2_WOR_CYCLE_MASK) | power->stats.wor_cycle;
+    power->writing = write_parameters_async(radio, &params, false, write_done, NULL);
+    return power->writing;
+}
+
+// Whatever the module holds would be lost in the switch
+static void switch_mode(radio_inst_t const *radio, radio_power_t *power, operating_mode_t mode) {
+    if (!radio_flow_drained(radio))
+        return;
+
+    if (radio_get_mode(radio) == MODE_POWER_SAVING)
+        power->stats.wakeups++;
+
+    set_operating_mode_async(radio, mode, NULL, NULL);
+}
+
+void radio_power_init(radio_inst_t const *radio) {
+    radio_power_t *power = get_power(radio);
+
+    *power = (radio_power_t) {0};
+    power->stats.wor_cycle = RADIO_DEFAULT_WOR_CYCLE;
+}
+
+// A latency target is needed whenever either end duty-cycles
+bool radio_power_set(radio_inst_t const *radio, bool enabled, uint32_t latency_ms, bool peer_wor) {
+    radio_power_t *power = get_power(radio);
+
+    if ((enabled || peer_wor) && latency_ms < RADIO_POWER_MIN_LATENCY_MS)
+        return false;
+
+    power->enabled = enabled;
+    power->peer_wor = peer_wor;
+    power->last_activity_us = hal_time_us();
+
+    if (enabled || peer_wor) {
+        power->stats.latency_ms = latency_ms > UINT16_MAX ? UINT16_MAX : latency_ms;
+        power->stats.wor_cycle = wor_cycle(latency_ms);
+    }
+
+    return true;
+}
+
+void radio_power_task(radio_inst_t const *radio, bool suspended) {
+    radio_power_t *power = get_power(radio);
+    uint64_t now = hal_time_us();
+    operating_mode_t mode = radio_get_mode(radio);
+
+    if (power->last_tick_us != 0)
+        power->mode_us[mode] += now - power->last_tick_us;
+
+    power->last_tick_us = now;
+
+    // Anything from the air counts as traffic, the reply may follow
+    uart_rx_stats_t rx_stats;
+    uart_rx_get_stats(radio->uart, &rx_stats);
+    if (rx_stats.received != power->last_received) {
+        power->last_received = rx_stats.received;
+        power->last_activity_us = now;
+    }
+
+    if (radio_is_busy(radio) || power->writing)
+        return;
+
+    if ((power->enabled || power->peer_wor) && write_cycle(radio, power))
+        return;
+
+    bool idle = now - power->last_activity_us >= RADIO_POWER_IDLE_US;
+    operating_mode_t rest = MODE_NORMAL;
+
+    // A peer already woken keeps being sent to with the preamble until traffic stops
+    if (power->enabled && (suspended || idle))
+        rest = MODE_POWER_SAVING;
+    else if (mode == MODE_WAKE_UP && power->peer_wor && !idle)
+        rest = MODE_WAKE_UP;
+
+    if (mode != rest)
+        switch_mode(radio, power, rest);
+}
+
+// Called before data goes to the module, true once the mode allows sending it.
+// Otherwise the switch is started and the data waits for it.
+bool radio_power_ready(radio_inst_t const *radio, bool pending) {
+    radio_power_t *power = get_power(radio);
+    if (!pending)
+        return true;
+
+    power->last_activity_us = hal_time_us();
+
+    operating_mode_t wanted = power->peer_wor ? MODE_WAKE_UP : MODE_NORMAL;
+    if (radio_get_mode(radio) == wanted)
+        return true;
+
+    if (!radio_is_busy(radio) && !power->writing)
+        switch_mode(radio, power, wanted);
+
+    return false;
+}
+
+void radio_power_get_stats(radio_inst_t const *radio, radio_power_stats_t *stats) {
+    radio_power_t const *power = get_power(radio);
+
+    *stats = power->stats;
+    stats->normal_ms = power->mode_us[MODE_NORMAL] / 1000;
+    stats->saving_ms = power->mode_us[MODE_POWER_SAVING] / 1000;
+    stats->wake_up_ms = power->mode_us[MODE_WAKE_UP] / 1000;
+
+    if (!power->enabled && !power->peer_wor)
+        stats->state = RADIO_POWER_OFF;
+    else if (radio_get_mode(radio) == MODE_POWER_SAVING)
+        stats->state = RADIO_POWER_SAVING;
+    else if (radio_get_mode(radio) == MODE_WAKE_UP)
+        stats->state = RADIO_POWER_WAKING;
+    else
+        stats->state = RADIO_POWER_AWAKE;
+}
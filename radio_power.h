@@ -0,0 +1,48 @@
+#ifndef _LORA_BRIDGE_RADIO_POWER_H_
+#define _LORA_BRIDGE_RADIO_POWER_H_
+
+#include "radio.h"
+
+// Duty cycling for battery powered bridges. Once neither the host nor the air
+// brought data for RADIO_POWER_IDLE_US, or right away while USB is suspended,
+// the module rests in MODE_POWER_SAVING and only wakes for packets sent with
+// the wake-up preamble. Host data brings it back to MODE_NORMAL, or to
+// MODE_WAKE_UP when the peer duty-cycles too so that the preamble wakes it.
+//
+// The latency target picks the longest WOR cycle not above it. A sleeping
+// receiver listens once per cycle, so the cycle bounds the wake latency, and
+// a sender spends one cycle of preamble on air in front of every packet. Both
+// ends need the same cycle.
+
+#define RADIO_POWER_IDLE_US         (2 * 1000 * 1000)
+#define RADIO_POWER_MIN_LATENCY_MS  500     ///< Shortest WOR cycle
+
+typedef enum {
+    RADIO_POWER_OFF = 0,        ///< Neither end duty-cycles
+    RADIO_POWER_AWAKE,          ///< MODE_NORMAL
+    RADIO_POWER_SAVING,         ///< MODE_POWER_SAVING
+    RADIO_POWER_WAKING,         ///< MODE_WAKE_UP, sending to a duty-cycled peer
+} radio_power_state_t;
+
+/// Settings and time spent in each mode since start-up, readable over HID
+typedef struct {
+    uint8_t state;              ///< radio_power_state_t
+    uint8_t wor_cycle;          ///< RADIO_PARAM_OPT2_WOR_CYCLE_*
+    uint16_t latency_ms;        ///< Target set by the host
+    uint32_t normal_ms;
+    uint32_t saving_ms;
+    uint32_t wake_up_ms;
+    uint32_t wakeups;           ///< Times data brought the module out of MODE_POWER_SAVING
+} radio_power_stats_t;
+
+void radio_power_init(radio_inst_t const *radio);
+
+bool radio_power_set(radio_inst_t const *radio, bool enabled, uint32_t latency_ms, bool peer_wor);
+
+void radio_power_task(radio_inst_t const *radio, bool suspended);
+
+bool radio_power_ready(radio_inst_t const *radio, bool pending);
+
+void radio_power_get_stats(radio_inst_t const *radio, radio_power_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_POWER_H_
@@ -0,0 +1,148 @@
+#include <memory.h>
+
+#include "radio_rssi.h"
+#include "uart_rx.h"
+
+#define PACKET_LEN_MAX 200
+
+// Packets are collected from the UART until they are whole: packet_len data
+// bytes and the RSSI byte, or fewer once the line goes quiet. Their data is
+// then handed out from the packet buffer. Without the RSSI byte the UART ring
+// is passed through untouched.
+//
+// A short packet is only told apart by the quiet line behind it. With a UART
+// slower than the air the module may send the next packet right after it, the
+// RSSI byte then stays in the data. Framed mode knows the length of every
+// packet from its link header and is not affected.
+typedef struct {
+    volatile bool enabled;
+    uint32_t packet_len;
+    uint64_t idle_us;
+    uint8_t packet[PACKET_LEN_MAX + 1];
+    uint32_t received;              ///< Bytes of the packet collected so far
+    uint64_t last_rx_us;
+    uint32_t out_offset;            ///< Data of a whole packet waiting for the consumer
+    uint32_t out_len;
+    radio_rssi_stats_t stats;
+} radio_rssi_t;
+
+static radio_rssi_t radio_rssi[NUM_UARTS];
+
+static radio_rssi_t *get_rssi(radio_inst_t const *radio) {
+    return &radio_rssi[hal_uart_index(radio->uart)];
+}
+
+// Adds the RSSI byte of a packet, framed mode finds them on its own
+void radio_rssi_record(radio_inst_t const *radio, uint8_t value) {
+    radio_rssi_stats_t *stats = &get_rssi(radio)->stats;
+    int dbm = (int) value - 256;
+
+    // Bytes below 0x80 are weaker than the fields hold, the module's floor anyway
+    if (dbm < INT8_MIN)
+        dbm = INT8_MIN;
+
+    if (stats->packets == 0) {
+        stats->min_dbm = (int8_t) dbm;
+        stats->max_dbm = (int8_t) dbm;
+        stats->average_dbm_16 = (int16_t) (dbm * 16);
+    } else {
+        if (dbm < stats->min_dbm)
+            stats->min_dbm = (int8_t) dbm;
+        if (dbm > stats->max_dbm)
+            stats->max_dbm = (int8_t) dbm;
+
+        stats->average_dbm_16 += (int16_t) ((dbm * 16 - stats->average_dbm_16) / (1 << RADIO_RSSI_EWMA_SHIFT));
+    }
+
+    int bin = (dbm - RADIO_RSSI_FLOOR_DBM) / RADIO_RSSI_BIN_DB;
+    if (bin < 0)
+        bin = 0;
+    if (bin >= RADIO_RSSI_BINS)
+        bin = RADIO_RSSI_BINS - 1;
+
+    if (stats->histogram[bin] != UINT16_MAX)
+        stats->histogram[bin]++;
+
+    stats->sum_dbm += dbm;
+    stats->packets++;
+}
+
+// Completes the packet in the buffer, false while more of it may arrive
+static bool collect(radio_inst_t const *radio, radio_rssi_t *rssi) {
+    uint64_t now = hal_time_us();
+    uint32_t len = uart_rx_read(radio->uart, &rssi->packet[rssi->received], rssi->packet_len + 1 - rssi->received);
+
+    if (len > 0) {
+        rssi->received += len;
+        rssi->last_rx_us = now;
+    }
+
+    if (rssi->received == 0)
+        return false;
+
+    return rssi->received == rssi->packet_len + 1 || now - rssi->last_rx_us >= rssi->idle_us;
+}
+
+void radio_rssi_init(radio_inst_t const *radio) {
+    radio_rssi_t *rssi = get_rssi(radio);
+    parameters_t defaults = {
+            .sped = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE,
+            .opt1 = RADIO_PARAM_OPT1_PACKET_LEN_200,
+    };
+
+    memset(rssi, 0, sizeof(*rssi));
+    radio_rssi_configure(radio, &defaults);
+}
+
+// A packet half way through is dropped
+void radio_rssi_configure(radio_inst_t const *radio, parameters_t const *params) {
+    radio_rssi_t *rssi = get_rssi(radio);
+
+    rssi->packet_len = get_packet_length(params->opt1);
+    rssi->idle_us = (uint64_t) RADIO_RSSI_IDLE_BYTES * 10 * 1000000 / get_uart_baud(params->sped);
+    rssi->received = 0;
+    rssi->out_len = 0;
+    rssi->enabled = (params->opt2 & RADIO_PARAM_OPT2_RSSI_BYTE_MASK) == RADIO_PARAM_OPT2_RSSI_BYTE_ENABLE;
+}
+
+// Received data without the RSSI bytes, returns the contiguous length available
+uint32_t radio_rssi_peek(radio_inst_t const *radio, uint8_t const **data) {
+    radio_rssi_t *rssi = get_rssi(radio);
+
+    if (!rssi->enabled)
+        return uart_rx_peek(radio->uart, data);
+
+    if (rssi->out_len == 0) {
+        if (!collect(radio, rssi))
+            return 0;
+
+        // The last byte of the packet is its RSSI
+        radio_rssi_record(radio, rssi->packet[rssi->received - 1]);
+        rssi->out_offset = 0;
+        rssi->out_len = rssi->received - 1;
+        rssi->received = 0;
+    }
+
+    *data = &rssi->packet[rssi->out_offset];
+    return rssi->out_len;
+}
+
+void radio_rssi_consume(radio_inst_t const *radio, uint32_t len) {
+    radio_rssi_t *rssi = get_rssi(radio);
+
+    if (!rssi->enabled) {
+        uart_rx_consume(radio->uart, len);
+        return;
+    }
+
+    rssi->out_offset += len;
+    rssi->out_len -= len;
+}
+
+void radio_rssi_get_stats(radio_inst_t const *radio, radio_rssi_stats_t *stats) {
+    *stats = get_rssi(radio)->stats;
+}
+
+void radio_rssi_reset_stats(radio_inst_t const *radio) {
+    get_rssi(radio)->stats = (radio_rssi_stats_t) {0};
+}
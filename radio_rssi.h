@@ -0,0 +1,43 @@
+#ifndef _LORA_BRIDGE_RADIO_RSSI_H_
+#define _LORA_BRIDGE_RADIO_RSSI_H_
+
+#include "radio.h"
+
+// With RADIO_PARAM_OPT2_RSSI_BYTE_ENABLE the module follows every received
+// packet with a byte holding its RSSI, -(256 - value) dBm. The byte is taken
+// off before the data reaches the host and summed up here.
+
+#define RADIO_RSSI_BINS         16
+#define RADIO_RSSI_BIN_DB       8       ///< Histogram bin width, the first bin starts at RADIO_RSSI_FLOOR_DBM
+#define RADIO_RSSI_FLOOR_DBM    (-128)
+#define RADIO_RSSI_EWMA_SHIFT   3       ///< Average weight of a new sample, 1/8
+
+// A short packet ends once the UART stays quiet this long, the hardware hands
+// over the last bytes of a packet after about three byte times
+#define RADIO_RSSI_IDLE_BYTES   8
+
+/// Link quality of the received packets, readable over HID
+typedef struct {
+    uint32_t packets;
+    int8_t min_dbm;
+    int8_t max_dbm;
+    int16_t average_dbm_16;                 ///< Exponentially weighted average, in 1/16 dBm
+    uint16_t histogram[RADIO_RSSI_BINS];    ///< Packets per bin, saturating
+    int32_t sum_dbm;                        ///< For averages over any span of packets
+} radio_rssi_stats_t;
+
+void radio_rssi_init(radio_inst_t const *radio);
+
+void radio_rssi_configure(radio_inst_t const *radio, parameters_t const *params);
+
+uint32_t radio_rssi_peek(radio_inst_t const *radio, uint8_t const **data);
+
+void radio_rssi_consume(radio_inst_t const *radio, uint32_t len);
+
+void radio_rssi_record(radio_inst_t const *radio, uint8_t value);
+
+void radio_rssi_get_stats(radio_inst_t const *radio, radio_rssi_stats_t *stats);
+
+void radio_rssi_reset_stats(radio_inst_t const *radio);
+
+#endif //_LORA_BRIDGE_RADIO_RSSI_H_
@@ -0,0 +1,125 @@
+#include "radio_sched.h"
+
+// Data is handed to the module in whole packets. The module starts sending
+// once a packet is full, or after a short UART idle gap, so bytes trickling in
+// from USB would otherwise leave as a string of partial packets. A partial
+// packet is held while the host is still writing, and while the air is busy
+// with the previous ones, since it could not leave any earlier.
+typedef struct {
+    uint8_t sped;
+    uint32_t packet_len;
+    uint32_t queued;                ///< Queue length seen on the last call
+    uint64_t last_growth_us;        ///< Last time the queue grew
+    uint64_t air_free_us;           ///< Estimated end of the released air time
+    radio_sched_stats_t stats;
+} radio_sched_t;
+
+static radio_sched_t radio_sched[NUM_UARTS];
+
+static radio_sched_t *get_sched(radio_inst_t const *radio) {
+    return &radio_sched[hal_uart_index(radio->uart)];
+}
+
+// Time for len bytes to cross the UART, 10 bits per byte
+static uint64_t uart_time_us(uint8_t sped, uint32_t len) {
+    return (uint64_t) len * 10 * 1000000 / get_uart_baud(sped);
+}
+
+static void commit(radio_sched_t *sched, uint32_t len, uint64_t now) {
+    uint64_t start = now + uart_time_us(sched->sped, len);
+    if (sched->air_free_us > start)
+        start = sched->air_free_us;
+
+    uint32_t airtime = radio_sched_airtime_us(sched->sped, len);
+    sched->air_free_us = start + airtime;
+    sched->stats.airtime_us += airtime;
+}
+
+void radio_sched_init(radio_inst_t const *radio) {
+    radio_sched_t *sched = get_sched(radio);
+    parameters_t defaults = {
+            .sped = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE | RADIO_DEFAULT_DATA_RATE,
+            .opt1 = RADIO_PARAM_OPT1_PACKET_LEN_200,
+    };
+
+    *sched = (radio_sched_t) {0};
+    radio_sched_configure(radio, &defaults);
+}
+
+void radio_sched_configure(radio_inst_t const *radio, parameters_t const *params) {
+    radio_sched_t *sched = get_sched(radio);
+
+    sched->sped = params->sped;
+    sched->packet_len = get_packet_length(params->opt1);
+    sched->stats.packet_len = sched->packet_len;
+    sched->stats.packet_airtime_us = radio_sched_airtime_us(params->sped, sched->packet_len);
+}
+
+uint32_t radio_sched_airtime_us(uint8_t sped, uint32_t len) {
+    return (uint32_t) ((uint64_t) (len + RADIO_SCHED_AIR_OVERHEAD) * 8 * 1000000 / get_air_data_rate(sped));
+}
+
+// Bytes of the queued data to write to the UART now, at most credits
+uint32_t radio_sched_release(radio_inst_t const *radio, uint32_t queued, uint32_t credits) {
+    radio_sched_t *sched = get_sched(radio);
+    uint64_t now = hal_time_us();
+
+    if (queued > sched->queued)
+        sched->last_growth_us = now;
+
+    sched->queued = queued;
+    if (queued == 0 || credits == 0)
+        return 0;
+
+    // Whole packets go as soon as the module has room for them
+    uint32_t packets = (queued < credits ? queued : credits) / sched->packet_len;
+    if (packets > 0) {
+        for (uint32_t i = 0; i < packets; ++i)
+            commit(sched, sched->packet_len, now);
+
+        sched->stats.packets += packets;
+        sched->queued -= packets * sched->packet_len;
+        return packets * sched->packet_len;
+    }
+
+    // Room for less than a packet, wait for more credits
+    if (queued > credits)
+        return 0;
+
+    if (now - sched->last_growth_us < RADIO_SCHED_GAP_US)
+        return 0;
+
+    // Would reach the air no sooner than when the previous packets are done
+    if (now + uart_time_us(sched->sped, queued) < sched->air_free_us)
+        return 0;
+
+    commit(sched, queued, now);
+    sched->stats.partial_packets++;
+    sched->queued = 0;
+    return queued;
+}
+
+// A packet whose boundaries are set by the caller, released as soon as the
+// module has room for it
+bool radio_sched_release_packet(radio_inst_t const *radio, uint32_t len, uint32_t credits) {
+    radio_sched_t *sched = get_sched(radio);
+
+    if (len == 0 || len > credits)
+        return false;
+
+    commit(sched, len, hal_time_us());
+    if (len < sched->packet_len)
+        sched->stats.partial_packets++;
+    else
+        sched->stats.packets++;
+
+    return true;
+}
+
+void radio_sched_get_stats(radio_inst_t const *radio, radio_sched_stats_t *stats) {
+    radio_sched_t *sched = get_sched(radio);
+    uint64_t now = hal_time_us();
+
+    *stats = sched->stats;
+    stats->backlog_us = sched->air_free_us > now ? (uint32_t) (sched->air_free_us - now) : 0;
+}
@@ -0,0 +1,35 @@
+#ifndef _LORA_BRIDGE_RADIO_SCHED_H_
+#define _LORA_BRIDGE_RADIO_SCHED_H_
+
+#include "radio.h"
+
+// Preamble, header and CRC sent with every packet, in bytes of air time
+#define RADIO_SCHED_AIR_OVERHEAD 10
+
+// A partial packet is held until the host stops writing for this long, about
+// one USB frame for the next CDC packet to arrive
+#define RADIO_SCHED_GAP_US 1500
+
+/// Air time bookkeeping, readable over HID
+typedef struct {
+    uint32_t packet_airtime_us;     ///< Time on air of a full packet at the current settings
+    uint32_t packet_len;            ///< Configured packet length
+    uint32_t packets;               ///< Full packets released to the UART
+    uint32_t partial_packets;       ///< Short packets released once the host went quiet
+    uint64_t airtime_us;            ///< Total air time of the released packets
+    uint32_t backlog_us;            ///< Air time released but not on air yet
+} radio_sched_stats_t;
+
+void radio_sched_init(radio_inst_t const *radio);
+
+void radio_sched_configure(radio_inst_t const *radio, parameters_t const *params);
+
+uint32_t radio_sched_airtime_us(uint8_t sped, uint32_t len);
+
+uint32_t radio_sched_release(radio_inst_t const *radio, uint32_t queued, uint32_t credits);
+
+bool radio_sched_release_packet(radio_inst_t const *radio, uint32_t len, uint32_t credits);
+
+void radio_sched_get_stats(radio_inst_t const *radio, radio_sched_stats_t *stats);
+
+#endif //_LORA_BRIDGE_RADIO_SCHED_H_
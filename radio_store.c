@@ -0,0 +1,114 @@
+#include <memory.h>
+#include <stddef.h>
+
+#include "radio_store.h"
+
+/// Sector contents, checked as a whole
+typedef struct {
+    uint32_t magic;
+    uint32_t valid;                 ///< One bit per UART
+    parameters_t params[NUM_UARTS];
+    uint32_t check;                 ///< FNV-1a over the fields before it
+} radio_store_image_t;
+
+_Static_assert(sizeof(radio_store_image_t) <= HAL_FLASH_STORE_SIZE, "store image must fit the flash sector");
+
+static radio_store_image_t image;
+static bool loaded;
+static volatile uint32_t changes;   ///< Core1, bumped for every change to the image
+static uint32_t written;            ///< Core0, changes as of the last write
+
+static uint32_t checksum(radio_store_image_t const *store) {
+    uint8_t const *bytes = (uint8_t const *) store;
+    uint32_t hash = 2166136261u;
+
+    for (uint32_t i = 0; i < offsetof(radio_store_image_t, check); ++i)
+        hash = (hash ^ bytes[i]) * 16777619u;
+
+    return hash;
+}
+
+// An erased or half written sector holds nothing
+static void load_image(void) {
+    if (loaded)
+        return;
+
+    hal_flash_read(&image, sizeof(image));
+    if (image.magic != RADIO_STORE_MAGIC || image.check != checksum(&image)) {
+        memset(&image, 0, sizeof(image));
+        image.magic = RADIO_STORE_MAGIC;
+    }
+
+    loaded = true;
+}
+
+static void changed(void) {
+    image.check = checksum(&image);
+    hal_barrier();
+    changes++;
+}
+
+bool radio_store_load(radio_inst_t const *radio, parameters_t *params) {
+    uint index = hal_uart_index(radio->uart);
+    load_image();
+
+    if (!(image.valid & (1u << index)))
+        return false;
+
+    *params = image.params[index];
+    return true;
+}
+
+void radio_store_save(radio_inst_t const *radio, parameters_t const *params) {
+    uint index = hal_uart_index(radio->uart);
+    load_image();
+
+    if ((image.valid & (1u << index)) && memcmp(&image.params[index], params, sizeof(*params)) == 0)
+        return;
+
+    image.params[index] = *params;
+    image.valid |= 1u << index;
+    changed();
+}
+
+// Registers saved by a command, those past parameters_t are not kept
+void radio_store_update(radio_inst_t const *radio, uint8_t address, uint8_t const *data, uint32_t len) {
+    uint index = hal_uart_index(radio->uart);
+    load_image();
+
+    if (!(image.valid & (1u << index)))
+        return;
+
+    parameters_t params = image.params[index];
+    uint8_t *registers = (uint8_t *) &params;
+    for (uint32_t i = 0; i < len && address + i < sizeof(parameters_t); i++)
+        registers[address + i] = data[i];
+
+    radio_store_save(radio, &params);
+}
+
+// The next start-up reads the module again
+void radio_store_forget(radio_inst_t const *radio) {
+    uint index = hal_uart_index(radio->uart);
+    load_image();
+
+    if (!(image.valid & (1u << index)))
+        return;
+
+    image.valid &= ~(1u << index);
+    changed();
+}
+
+// Core0, writes the image out when core1 changed it. Changes made while the
+// sector is written are caught by the next call.
+bool radio_store_flush(void) {
+    uint32_t seen = changes;
+    if (seen == written)
+        return false;
+
+    hal_barrier();
+    if (hal_flash_write(&image, sizeof(image)))
+        written = seen;
+
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef _LORA_BRIDGE_RADIO_STORE_H_
+#define _LORA_BRIDGE_RADIO_STORE_H_
+
+#include "radio.h"
+
+// Parameters each module comes up with, kept in the flash sector of the HAL so
+// the next start-up can skip reading them before USB. Kept up to date from the
+// start-up read and from every command saving registers. Core1 changes the
+// copy in RAM, core0 writes it out with radio_store_flush().
+
+#define RADIO_STORE_MAGIC   0x4C425031u     ///< "LBP1"
+
+bool radio_store_load(radio_inst_t const *radio, parameters_t *params);
+
+void radio_store_save(radio_inst_t const *radio, parameters_t const *params);
+
+void radio_store_update(radio_inst_t const *radio, uint8_t address, uint8_t const *data, uint32_t len);
+
+void radio_store_forget(radio_inst_t const *radio);
+
+bool radio_store_flush(void);
+
+#endif //_LORA_BRIDGE_RADIO_STORE_H_
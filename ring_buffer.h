@@ -0,0 +1,152 @@
+#ifndef _LORA_BRIDGE_RING_BUFFER_H_
+#define _LORA_BRIDGE_RING_BUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+
+/// Single-producer/single-consumer byte ring. The size must be a power of two,
+/// head and tail are free-running and wrapped with the mask on access.
+typedef struct {
+    uint8_t *data;
+    uint32_t mask;
+    volatile uint32_t head;     ///< Written by the producer only
+    volatile uint32_t tail;     ///< Written by the consumer only
+} ring_buffer_t;
+
+static inline void ring_buffer_init(ring_buffer_t *ring, uint8_t *data, uint32_t size) {
+    ring->data = data;
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+static inline uint32_t ring_buffer_size(ring_buffer_t const *ring) {
+    return ring->mask + 1;
+}
+
+static inline uint32_t ring_buffer_count(ring_buffer_t const *ring) {
+    return ring->head - ring->tail;
+}
+
+static inline uint32_t ring_buffer_space(ring_buffer_t const *ring) {
+    return ring_buffer_size(ring) - ring_buffer_count(ring);
+}
+
+static inline bool ring_buffer_empty(ring_buffer_t const *ring) {
+    return ring->head == ring->tail;
+}
+
+// Producer side
+
+static inline bool ring_buffer_put(ring_buffer_t *ring, uint8_t value) {
+    uint32_t head = ring->head;
+    if (head - ring->tail > ring->mask)
+        return false;
+
+    ring->data[head & ring->mask] = value;
+    hal_barrier();
+    ring->head = head + 1;
+    return true;
+}
+
+/// Returns the contiguous free span starting at head, to be filled in place
+/// and published with ring_buffer_produce()
+static inline uint32_t ring_buffer_peek_free(ring_buffer_t *ring, uint8_t **data) {
+    uint32_t head = ring->head;
+    uint32_t offset = head & ring->mask;
+    uint32_t space = ring_buffer_size(ring) - (head - ring->tail);
+    uint32_t contiguous = ring_buffer_size(ring) - offset;
+
+    *data = &ring->data[offset];
+    return space < contiguous ? space : contiguous;
+}
+
+static inline void ring_buffer_produce(ring_buffer_t *ring, uint32_t len) {
+    hal_barrier();
+    ring->head += len;
+}
+
+static inline uint32_t ring_buffer_write(ring_buffer_t *ring, uint8_t const *src, uint32_t len) {
+    uint32_t written = 0;
+
+    while (written < len) {
+        uint8_t *dst;
+        uint32_t span = ring_buffer_peek_free(ring, &dst);
+        if (span == 0)
+            break;
+
+        if (span > len - written)
+            span = len - written;
+
+        for (uint32_t i = 0; i < span; ++i)
+            dst[i] = src[written + i];
+
+        ring_buffer_produce(ring, span);
+        written += span;
+    }
+
+    return written;
+}
+
+// Consumer side
+
+/// Returns the contiguous readable span starting at tail, to be released
+/// with ring_buffer_consume()
+static inline uint32_t ring_buffer_peek(ring_buffer_t *ring, uint8_t const **data) {
+    uint32_t tail = ring->tail;
+    uint32_t offset = tail & ring->mask;
+    uint32_t count = ring->head - tail;
+    uint32_t contiguous = ring_buffer_size(ring) - offset;
+
+    hal_barrier();
+    *data = &ring->data[offset];
+    return count < contiguous ? count : contiguous;
+}
+
+/// Byte at offset from the tail, offset must be below ring_buffer_count()
+static inline uint8_t ring_buffer_at(ring_buffer_t const *ring, uint32_t offset) {
+    hal_barrier();
+    return ring->data[(ring->tail + offset) & ring->mask];
+}
+
+static inline void ring_buffer_consume(ring_buffer_t *ring, uint32_t len) {
+    hal_barrier();
+    ring->tail += len;
+}
+
+static inline bool ring_buffer_get(ring_buffer_t *ring, uint8_t *value) {
+    uint32_t tail = ring->tail;
+    if (ring->head == tail)
+        return false;
+
+    hal_barrier();
+    *value = ring->data[tail & ring->mask];
+    hal_barrier();
+    ring->tail = tail + 1;
+    return true;
+}
+
+static inline uint32_t ring_buffer_read(ring_buffer_t *ring, uint8_t *dst, uint32_t len) {
+    uint32_t read = 0;
+
+    while (read < len) {
+        uint8_t const *src;
+        uint32_t span = ring_buffer_peek(ring, &src);
+        if (span == 0)
+            break;
+
+        if (span > len - read)
+            span = len - read;
+
+        for (uint32_t i = 0; i < span; ++i)
+            dst[read + i] = src[i];
+
+        ring_buffer_consume(ring, span);
+        read += span;
+    }
+
+    return read;
+}
+
+#endif //_LORA_BRIDGE_RING_BUFFER_H_
@@ -0,0 +1,239 @@
+# End-to-end throughput and latency benchmark of the LoRa bridge
+#
+# Sweeps UART baud, air data rate and packet length, and for every combination
+# streams data both ways and pings the far end. Results are written as a JSON
+# list, one object per combination.
+#
+# Simulated modules, built with -DLORA_BRIDGE_HOST=ON:
+#   python3 bench.py --sim ../build-sim/sim/lora_bridge_sim
+#
+# Real hardware, two bridges in range of each other. Install python3 HID
+# package https://pypi.org/project/hid/ and pyserial:
+#   python3 bench.py --local /dev/ttyACM0 /dev/hidraw0 --remote /dev/ttyACM1 /dev/hidraw1
+import argparse
+import itertools
+import json
+import subprocess
+import sys
+import threading
+import time
+
+DATA_RATES = {2400: 0x02, 4800: 0x03, 9600: 0x04, 19200: 0x05, 38400: 0x06, 62500: 0x07}
+PACKET_LENS = {200: 0x00, 128: 0x40, 64: 0x80, 32: 0xC0}
+UART_BAUDS = {1200: 0x00, 2400: 0x20, 4800: 0x40, 9600: 0x60, 19200: 0x80, 38400: 0xA0, 57600: 0xC0, 115200: 0xE0}
+
+USB_COMMAND_READ_PARAMS = 0xB0
+USB_COMMAND_WRITE_PARAMS = 0xB1
+USB_COMMAND_SUCCESS = 0x00
+USB_COMMAND_QUEUED = 0x03
+USB_COMMAND_SEQUENCE_INDEX = 63
+USB_COMMAND_READ_REFRESH = 0x01
+
+QUIET_TIMEOUT = 10.0
+PING_TIMEOUT = 10.0
+
+
+def int_list(value):
+    return [int(x, 0) for x in value.split(',')]
+
+
+def percentile(values, percent):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[(len(values) - 1) * percent // 100]
+
+
+def pattern(length):
+    return bytes(((i * 131 + (i >> 8)) & 0xFF) for i in range(length))
+
+
+#--------------------------------------------------------------------+
+# Simulator
+#--------------------------------------------------------------------+
+
+def run_sim(args, baud, data_rate, packet_len):
+    command = [args.sim,
+               '--baud', str(baud),
+               '--data-rate', str(data_rate),
+               '--packet-len', str(packet_len),
+               '--bytes', str(args.bytes),
+               '--pings', str(args.pings),
+               '--ping-len', str(args.ping_len),
+               '--loss', str(args.loss)]
+
+    process = subprocess.run(command, capture_output=True, text=True)
+    if not process.stdout:
+        raise RuntimeError(process.stderr.strip() or 'simulator failed')
+
+    return json.loads(process.stdout)
+
+
+#--------------------------------------------------------------------+
+# Hardware
+#--------------------------------------------------------------------+
+
+class Bridge:
+    def __init__(self, port, hidraw):
+        import hid
+        import serial
+
+        self.serial = serial.Serial(port, timeout=0.05)
+        self.hid = hid.Device(path=hidraw.encode())
+        self.sequence = 0
+
+    # Skips the acknowledgement and waits for the completion with the same sequence number
+    def command(self, request):
+        self.sequence = (self.sequence + 1) & 0xFF
+        report = bytearray(bytes(request).ljust(64, b'\0'))
+        report[USB_COMMAND_SEQUENCE_INDEX] = self.sequence
+        self.hid.write(bytes(report))
+
+        while True:
+            response = self.hid.read(64, 5000)
+            if not response:
+                raise RuntimeError('HID command 0x%02X timed out' % request[0])
+            if response[USB_COMMAND_SEQUENCE_INDEX] == self.sequence and response[1] != USB_COMMAND_QUEUED:
+                break
+
+        if response[0] != request[0] or response[1] != USB_COMMAND_SUCCESS:
+            raise RuntimeError('HID command 0x%02X failed: %s' % (request[0], response[:2].hex()))
+        return response
+
+    def configure(self, baud, data_rate, packet_len):
+        params = bytearray(self.command([USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_REFRESH])[2:8])
+        params[2] = UART_BAUDS[baud] | DATA_RATES[data_rate]
+        params[3] = (params[3] & ~0xC0) | PACKET_LENS[packet_len]
+        self.command([USB_COMMAND_WRITE_PARAMS, 0x00] + list(params))
+        self.serial.reset_input_buffer()
+
+
+def stream(sender, receiver, length):
+    data = pattern(length)
+    received = bytearray()
+
+    writer = threading.Thread(target=sender.serial.write, args=(data,))
+    start = time.monotonic()
+    last = start
+    writer.start()
+
+    while len(received) < length and time.monotonic() - last < QUIET_TIMEOUT:
+        chunk = receiver.serial.read(4096)
+        if chunk:
+            received += chunk
+            last = time.monotonic()
+
+    writer.join()
+    elapsed = last - start
+    errors = sum(1 for a, b in zip(received, data) if a != b)
+
+    return {'sent': length,
+            'received': len(received),
+            'errors': errors,
+            'seconds': elapsed,
+            'goodput_bps': len(received) * 8 / elapsed if elapsed > 0 else 0.0,
+            'loss': 1.0 - len(received) / length if length else 0.0}
+
+
+def ping(local, remote, count, length):
+    latencies = []
+
+    for n in range(count):
+        request = bytes(((n + i) & 0xFF) for i in range(length))
+        local.serial.reset_input_buffer()
+        remote.serial.reset_input_buffer()
+
+        start = time.monotonic()
+        local.serial.write(request)
+
+        # The remote side echoes the ping once it is complete
+        echo = bytearray()
+        while len(echo) < length and time.monotonic() - start < PING_TIMEOUT:
+            echo += remote.serial.read(length - len(echo))
+        if len(echo) < length:
+            continue
+        remote.serial.write(echo)
+
+        response = bytearray()
+        while len(response) < length and time.monotonic() - start < PING_TIMEOUT:
+            response += local.serial.read(length - len(response))
+
+        if bytes(response) == request:
+            latencies.append(int((time.monotonic() - start) * 1e6))
+
+    return {'count': count,
+            'len': length,
+            'answered': len(latencies),
+            'loss': 1.0 - len(latencies) / count if count else 0.0,
+            'p50_us': percentile(latencies, 50),
+            'p99_us': percentile(latencies, 99),
+            'max_us': percentile(latencies, 100)}
+
+
+def run_hardware(args, local, remote, baud, data_rate, packet_len):
+    local.configure(baud, data_rate, packet_len)
+    remote.configure(baud, data_rate, packet_len)
+
+    return {'target': 'hardware',
+            'baud': baud,
+            'data_rate': data_rate,
+            'packet_len': packet_len,
+            'host_to_peer': stream(local, remote, args.bytes),
+            'peer_to_host': stream(remote, local, args.bytes),
+            'ping': ping(local, remote, args.pings, args.ping_len)}
+
+
+#--------------------------------------------------------------------+
+# Main
+#--------------------------------------------------------------------+
+
+def main():
+    parser = argparse.ArgumentParser(description='LoRa bridge throughput and latency benchmark')
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument('--sim', metavar='BINARY', help='lora_bridge_sim executable')
+    target.add_argument('--local', nargs=2, metavar=('PORT', 'HIDRAW'), help='bridge under test')
+    parser.add_argument('--remote', nargs=2, metavar=('PORT', 'HIDRAW'), help='far end bridge')
+    parser.add_argument('--baud', type=int_list, default=[9600, 115200])
+    parser.add_argument('--data-rate', type=int_list, default=sorted(DATA_RATES))
+    parser.add_argument('--packet-len', type=int_list, default=sorted(PACKET_LENS, reverse=True))
+    parser.add_argument('--bytes', type=int, default=4096)
+    parser.add_argument('--pings', type=int, default=20)
+    parser.add_argument('--ping-len', type=int, default=16)
+    parser.add_argument('--loss', type=float, default=0.0, help='packet loss of the simulated channel')
+    parser.add_argument('--output', default='bench_results.json')
+    args = parser.parse_args()
+
+    if args.local and not args.remote:
+        parser.error('--local needs --remote')
+
+    local = remote = None
+    if args.local:
+        local = Bridge(*args.local)
+        remote = Bridge(*args.remote)
+
+    results = []
+    for baud, data_rate, packet_len in itertools.product(args.baud, args.data_rate, args.packet_len):
+        try:
+            if args.sim:
+                result = run_sim(args, baud, data_rate, packet_len)
+            else:
+                result = run_hardware(args, local, remote, baud, data_rate, packet_len)
+        except (RuntimeError, KeyError, ValueError) as e:
+            print('%6d baud %5d bps %3d B: %s' % (baud, data_rate, packet_len, e), file=sys.stderr)
+            continue
+
+        results.append(result)
+        print('%6d baud %5d bps %3d B: %8.0f / %8.0f bit/s, ping p50 %7.1f ms p99 %7.1f ms, loss %.3f'
+              % (baud, data_rate, packet_len,
+                 result['host_to_peer']['goodput_bps'], result['peer_to_host']['goodput_bps'],
+                 result['ping']['p50_us'] / 1000, result['ping']['p99_us'] / 1000,
+                 result['host_to_peer']['loss']))
+
+    with open(args.output, 'w') as f:
+        json.dump(results, f, indent=2)
+
+    print('%d results written to %s' % (len(results), args.output))
+
+
+if __name__ == '__main__':
+    main()
@@ -6,13 +6,31 @@ import sys
 
 USB_VID = 0x2E8A
 
+USB_COMMAND_QUEUED = 0x03
+USB_COMMAND_SEQUENCE_INDEX = 63
+
 print("Opening HID device with VID = 0x%X" % USB_VID)
 
 
+# Commands are acknowledged with 0x03 first, the completion with the same
+# sequence number follows. Module 0, byte 62 is left at zero.
+def command(dev, data):
+    command.sequence = (command.sequence + 1) & 0xFF
+    report = bytearray(bytes(data[:USB_COMMAND_SEQUENCE_INDEX]).ljust(64, b'\0'))
+    report[USB_COMMAND_SEQUENCE_INDEX] = command.sequence
+    dev.write(bytes(report))
+
+    while True:
+        response = dev.read(64)
+        if response[USB_COMMAND_SEQUENCE_INDEX] == command.sequence and response[1] != USB_COMMAND_QUEUED:
+            return response
+
+
+command.sequence = 0
+
+
 def configure(dev):
-    command = bytes([0xB0, 0x00])
-    dev.write(command)
-    data = dev.read(64)
+    data = command(dev, [0xB0, 0x00])
     print("Received from HID Device:")
     print(data, '\n')
 
@@ -25,8 +43,7 @@ def configure(dev):
     data[0], data[1] = [0xB1, 0x01]
     data[4] |= 0b11100000
 
-    dev.write(bytes(data))
-    data = dev.read(64)
+    data = command(dev, data)
     print("Received from HID Device:")
     print(data, '\n')
 
@@ -3,18 +3,41 @@ import hid
 
 USB_VID = 0x2E8A
 
+USB_COMMAND_READ_PARAMS = 0xB0
+USB_COMMAND_READ_CACHED = 0x00
+USB_COMMAND_QUEUED = 0x03
+USB_COMMAND_MODULE_INDEX = 62
+USB_COMMAND_SEQUENCE_INDEX = 63
+
 print("Opening HID device with VID = 0x%X" % USB_VID)
 
+
+# Skips the acknowledgement and waits for the completion with the same sequence number
+def command(dev, request, module, sequence):
+    report = bytearray(bytes(request).ljust(64, b'\0'))
+    report[USB_COMMAND_MODULE_INDEX] = module
+    report[USB_COMMAND_SEQUENCE_INDEX] = sequence
+    dev.write(bytes(report))
+
+    while True:
+        response = dev.read(64, 5000)
+        if not response:
+            return None
+        if response[USB_COMMAND_SEQUENCE_INDEX] == sequence and response[1] != USB_COMMAND_QUEUED:
+            return response
+
+
 for d in hid.enumerate(USB_VID):
     print(d)
     dev = hid.Device(d['vendor_id'], d['product_id'])
     if dev:
+        sequence = 0
         while True:
-            # Get input from console and encode to UTF8 for array of chars.
-            # hid generic inout is single report therefore by HIDAPI requirement
-            # it must be proceeded with 0x00 as dummy reportID
-            str_out = b'\xb0'
-            str_out += input("Send text to HID Device : ").encode('utf-8')
-            dev.write(str_out)
-            str_in = dev.read(64)
-            print("Received from HID Device:", str_in, '\n')
+            # Reads the parameters the bridge keeps for the module typed in
+            module = int(input("Module to read (0 or 1) : "))
+            sequence = (sequence + 1) & 0xFF
+            response = command(dev, [USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_CACHED], module, sequence)
+            if response is None:
+                print("No completion from HID Device\n")
+            else:
+                print("Received from HID Device:", response.hex(), '\n')
@@ -0,0 +1,538 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "e220_sim.h"
+#include "ring_buffer.h"
+
+// Behavioural model of an E220 module: M0/M1 operating modes, AUX busy signal,
+// the C0/C1/C2 configuration protocol at 9600 8N1 in MODE_SLEEP, a transmit
+// buffer cut into packets of the configured length, and air time by data rate.
+// Every module created shares the same air.
+
+#define E220_SIM_OUT_SIZE       1024    // Must be a power of two
+#define E220_SIM_MAX_PACKET     200
+#define E220_SIM_AIR_OVERHEAD   10      // Preamble, header and CRC, in bytes
+#define E220_SIM_IDLE_BYTES     3       // UART idle time closing a packet
+
+#define E220_REG_ADDH   0
+#define E220_REG_ADDL   1
+#define E220_REG_SPED   2
+#define E220_REG_OPT1   3
+#define E220_REG_CHAN   4
+#define E220_REG_OPT2   5
+
+struct e220_sim {
+    bool wired;
+    uint m0_pin;
+    uint m1_pin;
+    uint aux_pin;
+
+    operating_mode_t mode;
+    uint64_t switch_until;          ///< AUX held low after a mode change
+    uint8_t reg[E220_SIM_REGISTERS];
+
+    // Channel model
+    double loss;
+    int8_t rssi_dbm;
+    uint8_t path_loss_db;           ///< Non zero: RSSI and extra loss follow the sender settings
+    bool half_duplex;               ///< Deaf while its own packet is on air
+    double bit_errors;              ///< Chance of every bit received to flip
+    uint32_t rng;
+
+    // Transmit side
+    uint8_t buffer[E220_SIM_BUFFER_SIZE];
+    uint32_t buffer_len;
+    uint64_t last_input_us;
+    bool frame_open;                ///< Bytes received since the last UART idle gap
+    uint8_t target[3];              ///< Fixed transmission ADDH ADDL CHAN of the frame
+    uint32_t target_len;
+
+    bool transmitting;
+    uint64_t tx_start_us;
+    uint64_t tx_end_us;
+    uint8_t packet[E220_SIM_MAX_PACKET];
+    uint32_t packet_len;
+    uint8_t packet_target[3];
+    bool packet_wake_up;
+
+    // Configuration commands in MODE_SLEEP
+    uint8_t command[3 + E220_SIM_REGISTERS];
+    uint32_t command_len;
+
+    // Module TXD
+    e220_sim_output_t output;
+    void *context;
+    ring_buffer_t out;
+    uint8_t out_data[E220_SIM_OUT_SIZE];
+    uint64_t out_busy_until;
+
+    e220_sim_stats_t stats;
+    e220_sim_t *next;
+};
+
+static e220_sim_t *modules;
+
+//--------------------------------------------------------------------+
+// Register decoding
+//--------------------------------------------------------------------+
+
+static uint data_baud(e220_sim_t const *module) {
+    static uint const bauds[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+    return bauds[(module->reg[E220_REG_SPED] & RADIO_PARAM_SPED_UART_BAUD_MASK) >> 5];
+}
+
+static hal_parity_t data_parity(e220_sim_t const *module) {
+    switch (module->reg[E220_REG_SPED] & RADIO_PARAM_SPED_UART_MODE_MASK) {
+        case RADIO_PARAM_SPED_UART_MODE_8E1:
+            return HAL_PARITY_EVEN;
+
+        case RADIO_PARAM_SPED_UART_MODE_8O1:
+            return HAL_PARITY_ODD;
+
+        default:
+            return HAL_PARITY_NONE;
+    }
+}
+
+// Configuration is only accepted at 9600 8N1
+static uint uart_baud(e220_sim_t const *module) {
+    return module->mode == MODE_SLEEP ? 9600 : data_baud(module);
+}
+
+static hal_parity_t uart_parity(e220_sim_t const *module) {
+    return module->mode == MODE_SLEEP ? HAL_PARITY_NONE : data_parity(module);
+}
+
+static uint32_t air_rate_bps(uint8_t sped) {
+    switch (sped & RADIO_PARAM_SPED_DATA_RATE_MASK) {
+        case RADIO_PARAM_SPED_DATA_RATE_4800:
+            return 4800;
+
+        case RADIO_PARAM_SPED_DATA_RATE_9600:
+            return 9600;
+
+        case RADIO_PARAM_SPED_DATA_RATE_19200:
+            return 19200;
+
+        case RADIO_PARAM_SPED_DATA_RATE_38400:
+            return 38400;
+
+        case RADIO_PARAM_SPED_DATA_RATE_62500:
+            return 62500;
+
+        default:
+            return 2400;
+    }
+}
+
+uint64_t e220_sim_airtime_us(uint8_t sped, uint32_t len) {
+    return ((uint64_t) (len + E220_SIM_AIR_OVERHEAD) * 8 * 1000000) / air_rate_bps(sped);
+}
+
+static uint64_t wor_period_us(e220_sim_t const *module) {
+    return 500 * 1000 * (uint64_t) ((module->reg[E220_REG_OPT2] & RADIO_PARAM_OPT2_WOR_CYCLE_MASK) + 1);
+}
+
+static uint32_t packet_length(e220_sim_t const *module) {
+    return get_packet_length(module->reg[E220_REG_OPT1]);
+}
+
+static bool fixed_mode(e220_sim_t const *module) {
+    return (module->reg[E220_REG_OPT2] & RADIO_PARAM_OPT2_TX_METHOD_MASK) == RADIO_PARAM_OPT2_TX_METHOD_FIXED;
+}
+
+//--------------------------------------------------------------------+
+// Helpers
+//--------------------------------------------------------------------+
+
+// xorshift32, deterministic per seed
+static double next_random(e220_sim_t *module) {
+    uint32_t x = module->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    module->rng = x;
+    return (double) x / 4294967296.0;
+}
+
+static void emit(e220_sim_t *module, uint8_t const *data, uint32_t len) {
+    ring_buffer_write(&module->out, data, len);
+}
+
+static operating_mode_t pin_mode(e220_sim_t const *module) {
+    bool m0 = sim_gpio_level(module->m0_pin);
+    bool m1 = sim_gpio_level(module->m1_pin);
+
+    if (m0 && m1)
+        return MODE_SLEEP;
+
+    if (m1)
+        return MODE_POWER_SAVING;
+
+    return m0 ? MODE_WAKE_UP : MODE_NORMAL;
+}
+
+static void enter_mode(e220_sim_t *module, operating_mode_t mode) {
+    if (mode == module->mode)
+        return;
+
+    module->mode = mode;
+    module->switch_until = sim_now_us + E220_SIM_SWITCH_US;
+    module->command_len = 0;
+}
+
+//--------------------------------------------------------------------+
+// Configuration protocol
+//--------------------------------------------------------------------+
+
+static void reject_command(e220_sim_t *module) {
+    uint8_t const error[] = {0xFF, 0xFF, 0xFF};
+
+    emit(module, error, sizeof(error));
+    module->command_len = 0;
+}
+
+static void command_input(e220_sim_t *module, uint8_t byte) {
+    module->command[module->command_len++] = byte;
+    if (module->command_len < 3)
+        return;
+
+    uint8_t head = module->command[0];
+    uint8_t address = module->command[1];
+    uint8_t len = module->command[2];
+
+    if ((head != RADIO_COMMAND_READ_PARAMS &&
+         head != RADIO_COMMAND_WRITE_PARAMS_SAVE &&
+         head != RADIO_COMMAND_WRITE_PARAMS_NOSAVE) ||
+        len == 0 || address + len > E220_SIM_REGISTERS) {
+        reject_command(module);
+        return;
+    }
+
+    if (head != RADIO_COMMAND_READ_PARAMS) {
+        if (module->command_len < 3u + len)
+            return;
+
+        memcpy(&module->reg[address], &module->command[3], len);
+    }
+
+    uint8_t response[3 + E220_SIM_REGISTERS] = {RADIO_COMMAND_READ_PARAMS, address, len};
+    memcpy(&response[3], &module->reg[address], len);
+
+    // Encryption key registers are write only
+    for (uint i = address; i < address + len; ++i) {
+        if (i >= 6)
+            response[3 + i - address] = 0;
+    }
+
+    emit(module, response, 3 + len);
+    module->command_len = 0;
+    module->stats.commands++;
+}
+
+//--------------------------------------------------------------------+
+// Air
+//--------------------------------------------------------------------+
+
+static bool receives(e220_sim_t const *sender, e220_sim_t const *receiver) {
+    if (receiver == sender || receiver->switch_until > sim_now_us)
+        return false;
+
+    // Power saving receivers only hear packets sent with the wake-up preamble
+    if (receiver->mode == MODE_SLEEP ||
+        (receiver->mode == MODE_POWER_SAVING && !sender->packet_wake_up))
+        return false;
+
+    uint8_t sender_rate = sender->reg[E220_REG_SPED] & RADIO_PARAM_SPED_DATA_RATE_MASK;
+    uint8_t receiver_rate = receiver->reg[E220_REG_SPED] & RADIO_PARAM_SPED_DATA_RATE_MASK;
+    if (sender_rate != receiver_rate)
+        return false;
+
+    uint16_t receiver_address = receiver->reg[E220_REG_ADDH] << 8 | receiver->reg[E220_REG_ADDL];
+    uint16_t address;
+    uint8_t channel;
+
+    if (fixed_mode(sender)) {
+        address = sender->packet_target[0] << 8 | sender->packet_target[1];
+        channel = sender->packet_target[2];
+    } else {
+        address = sender->reg[E220_REG_ADDH] << 8 | sender->reg[E220_REG_ADDL];
+        channel = sender->reg[E220_REG_CHAN];
+    }
+
+    if (channel != receiver->reg[E220_REG_CHAN])
+        return false;
+
+    return address == 0xFFFF || receiver_address == 0xFFFF || address == receiver_address;
+}
+
+// Packets fade out within 3 dB either side of the sensitivity of the data rate
+static double fade_loss(e220_sim_t const *sender, int rssi_dbm) {
+    static int const sensitivity_dbm[] = {-129, -129, -129, -126, -123, -120, -117, -114};
+
+    int margin = rssi_dbm - sensitivity_dbm[sender->reg[E220_REG_SPED] & RADIO_PARAM_SPED_DATA_RATE_MASK];
+    if (margin >= 3)
+        return 0;
+    if (margin <= -3)
+        return 1;
+
+    return (3 - margin) / 6.0;
+}
+
+static int received_dbm(e220_sim_t const *sender, e220_sim_t const *receiver) {
+    static int const power_dbm[] = {22, 17, 13, 10};
+
+    int rssi = receiver->path_loss_db == 0
+               ? receiver->rssi_dbm
+               : power_dbm[sender->reg[E220_REG_OPT1] & RADIO_PARAM_OPT1_TX_POWER_MASK] - receiver->path_loss_db;
+
+    // The trailer byte is 256 + dBm, from -128 to -1
+    if (rssi < -128)
+        return -128;
+    return rssi > -1 ? -1 : rssi;
+}
+
+// Received as sent unless bit errors are modelled
+static void emit_packet(e220_sim_t *receiver, uint8_t const *data, uint32_t len) {
+    uint8_t packet[E220_SIM_MAX_PACKET];
+    bool corrupted = false;
+
+    if (receiver->bit_errors <= 0) {
+        emit(receiver, data, len);
+        return;
+    }
+
+    memcpy(packet, data, len);
+    for (uint32_t bit = 0; bit < len * 8; ++bit) {
+        if (next_random(receiver) < receiver->bit_errors) {
+            packet[bit / 8] ^= 1 << bit % 8;
+            corrupted = true;
+        }
+    }
+
+    receiver->stats.corrupted += corrupted;
+    emit(receiver, packet, len);
+}
+
+static void deliver(e220_sim_t *sender) {
+    for (e220_sim_t *receiver = modules; receiver; receiver = receiver->next) {
+        if (!receives(sender, receiver))
+            continue;
+
+        // Its own packet overlapped this one on air
+        if (receiver->half_duplex && receiver->tx_end_us > sender->tx_start_us) {
+            receiver->stats.deaf++;
+            continue;
+        }
+
+        int rssi_dbm = received_dbm(sender, receiver);
+        double loss = receiver->loss;
+        if (receiver->path_loss_db)
+            loss = 1 - (1 - loss) * (1 - fade_loss(sender, rssi_dbm));
+
+        if (next_random(receiver) < loss) {
+            receiver->stats.packets_lost++;
+            continue;
+        }
+
+        receiver->stats.packets_received++;
+        emit_packet(receiver, sender->packet, sender->packet_len);
+
+        if (receiver->reg[E220_REG_OPT2] & RADIO_PARAM_OPT2_RSSI_BYTE_ENABLE) {
+            uint8_t rssi = (uint8_t) (256 + rssi_dbm);
+            emit(receiver, &rssi, 1);
+        }
+    }
+}
+
+static void start_packet(e220_sim_t *module) {
+    uint32_t len = module->buffer_len < packet_length(module) ? module->buffer_len : packet_length(module);
+
+    memcpy(module->packet, module->buffer, len);
+    memmove(module->buffer, &module->buffer[len], module->buffer_len - len);
+    module->buffer_len -= len;
+
+    module->packet_len = len;
+    memcpy(module->packet_target, module->target, sizeof(module->target));
+    module->packet_wake_up = module->mode == MODE_WAKE_UP;
+
+    // The wake-up preamble lasts a whole WOR period of the receivers
+    uint64_t airtime = e220_sim_airtime_us(module->reg[E220_REG_SPED], len);
+    if (module->packet_wake_up)
+        airtime += wor_period_us(module);
+
+    module->transmitting = true;
+    module->tx_start_us = sim_now_us;
+    module->tx_end_us = sim_now_us + airtime;
+    module->stats.airtime_us += airtime;
+}
+
+static void transmit_tick(e220_sim_t *module) {
+    if (module->transmitting && sim_now_us >= module->tx_end_us) {
+        module->transmitting = false;
+        module->stats.packets_sent++;
+        deliver(module);
+    }
+
+    if (module->transmitting || module->buffer_len == 0)
+        return;
+
+    if (module->mode != MODE_NORMAL && module->mode != MODE_WAKE_UP)
+        return;
+
+    uint64_t idle = E220_SIM_IDLE_BYTES * sim_byte_time_us(data_baud(module), data_parity(module));
+    if (module->buffer_len >= packet_length(module) || sim_now_us - module->last_input_us >= idle)
+        start_packet(module);
+}
+
+//--------------------------------------------------------------------+
+// Public
+//--------------------------------------------------------------------+
+
+e220_sim_t *e220_sim_create(e220_sim_output_t output, void *context) {
+    e220_sim_t *module = calloc(1, sizeof(e220_sim_t));
+
+    module->output = output;
+    module->context = context;
+    module->mode = MODE_NORMAL;
+    module->rng = 0x2545F491;
+    ring_buffer_init(&module->out, module->out_data, E220_SIM_OUT_SIZE);
+
+    // Factory defaults
+    module->reg[E220_REG_ADDH] = 0x00;
+    module->reg[E220_REG_ADDL] = 0x00;
+    module->reg[E220_REG_SPED] = RADIO_DEFAULT_UART_BAUD | RADIO_DEFAULT_UART_MODE | RADIO_DEFAULT_DATA_RATE;
+    module->reg[E220_REG_OPT1] = RADIO_PARAM_OPT1_PACKET_LEN_200 | RADIO_PARAM_OPT1_TX_POWER_22;
+    module->reg[E220_REG_CHAN] = RADIO_DEFAULT_CHANNEL;
+    module->reg[E220_REG_OPT2] = RADIO_DEFAULT_WOR_CYCLE;
+
+    module->next = modules;
+    modules = module;
+    return module;
+}
+
+// M0 and M1 driven by the firmware, AUX read back by it
+void e220_sim_wire(e220_sim_t *module, uint m0_pin, uint m1_pin, uint aux_pin) {
+    module->wired = true;
+    module->m0_pin = m0_pin;
+    module->m1_pin = m1_pin;
+    module->aux_pin = aux_pin;
+    sim_gpio_drive(aux_pin, true);
+}
+
+// Mode of a module not wired to the firmware
+void e220_sim_set_mode(e220_sim_t *module, operating_mode_t mode) {
+    enter_mode(module, mode);
+}
+
+void e220_sim_set_parameters(e220_sim_t *module, parameters_t const *params) {
+    memcpy(module->reg, params, sizeof(parameters_t));
+}
+
+void e220_sim_get_parameters(e220_sim_t const *module, parameters_t *params) {
+    memcpy(params, module->reg, sizeof(parameters_t));
+}
+
+void e220_sim_set_channel_model(e220_sim_t *module, double loss, int8_t rssi_dbm, uint32_t seed) {
+    module->loss = loss;
+    module->rssi_dbm = rssi_dbm;
+    module->rng = seed ? seed : 0x2545F491;
+}
+
+// Received strength from the TX power of the sender, 0 goes back to the fixed RSSI
+void e220_sim_set_path_loss(e220_sim_t *module, uint8_t path_loss_db) {
+    module->path_loss_db = path_loss_db;
+}
+
+void e220_sim_set_half_duplex(e220_sim_t *module, bool half_duplex) {
+    module->half_duplex = half_duplex;
+}
+
+// The module passes errors on, as if its CRC check was off
+void e220_sim_set_bit_errors(e220_sim_t *module, double rate) {
+    module->bit_errors = rate;
+}
+
+// Byte arriving on the module RXD pin
+void e220_sim_input(e220_sim_t *module, uint8_t byte, uint baud, hal_parity_t parity) {
+    if (baud != uart_baud(module) || parity != uart_parity(module)) {
+        module->stats.garbled++;
+        return;
+    }
+
+    uint64_t idle = E220_SIM_IDLE_BYTES * sim_byte_time_us(baud, parity);
+    if (sim_now_us - module->last_input_us >= idle)
+        module->frame_open = false;
+
+    module->last_input_us = sim_now_us;
+
+    switch (module->mode) {
+        case MODE_SLEEP:
+            command_input(module, byte);
+            break;
+
+        case MODE_NORMAL:
+        case MODE_WAKE_UP:
+            // Fixed transmission takes the target from the first bytes of a frame
+            if (!module->frame_open) {
+                module->frame_open = true;
+                module->target_len = 0;
+            }
+
+            if (fixed_mode(module) && module->target_len < sizeof(module->target)) {
+                module->target[module->target_len++] = byte;
+                break;
+            }
+
+            if (module->buffer_len == E220_SIM_BUFFER_SIZE) {
+                module->stats.overflows++;
+                break;
+            }
+
+            module->buffer[module->buffer_len++] = byte;
+            break;
+
+        default:
+            // No transmission while power saving
+            break;
+    }
+}
+
+bool e220_sim_aux(e220_sim_t const *module) {
+    return module->switch_until <= sim_now_us &&
+           !module->transmitting &&
+           module->buffer_len == 0 &&
+           ring_buffer_empty(&module->out);
+}
+
+void e220_sim_get_stats(e220_sim_t const *module, e220_sim_stats_t *stats) {
+    *stats = module->stats;
+}
+
+static void module_tick(e220_sim_t *module) {
+    if (module->wired)
+        enter_mode(module, pin_mode(module));
+
+    transmit_tick(module);
+
+    // Module TXD at the settings of the current mode
+    uint baud = uart_baud(module);
+    hal_parity_t parity = uart_parity(module);
+    uint8_t byte;
+
+    while (module->out_busy_until <= sim_now_us && ring_buffer_get(&module->out, &byte)) {
+        uint64_t start = module->out_busy_until > sim_now_us - SIM_TICK_US ? module->out_busy_until : sim_now_us;
+        module->out_busy_until = start + sim_byte_time_us(baud, parity);
+
+        if (module->output)
+            module->output(module->context, byte, baud, parity);
+    }
+
+    if (module->wired)
+        sim_gpio_drive(module->aux_pin, e220_sim_aux(module));
+}
+
+void e220_sim_tick_all(void) {
+    for (e220_sim_t *module = modules; module; module = module->next)
+        module_tick(module);
+}
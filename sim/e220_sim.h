@@ -0,0 +1,54 @@
+#ifndef _LORA_BRIDGE_E220_SIM_H_
+#define _LORA_BRIDGE_E220_SIM_H_
+
+#include "radio.h"
+#include "sim.h"
+
+#define E220_SIM_REGISTERS      8       ///< ADDH ADDL REG0 REG1 REG2 REG3 CRYPT_H CRYPT_L
+#define E220_SIM_BUFFER_SIZE    400     ///< Transmit buffer of the module
+#define E220_SIM_SWITCH_US      (2 * 1000)
+
+/// Receives a byte on the module TXD pin, with the UART settings it was sent at
+typedef void (*e220_sim_output_t)(void *context, uint8_t byte, uint baud, hal_parity_t parity);
+
+typedef struct {
+    uint32_t packets_sent;
+    uint32_t packets_received;
+    uint32_t packets_lost;      ///< Dropped by the channel model
+    uint32_t deaf;              ///< Missed while transmitting, with half duplex
+    uint32_t corrupted;         ///< Received with bits flipped by the channel model
+    uint32_t overflows;         ///< Bytes dropped, transmit buffer full
+    uint32_t garbled;           ///< Bytes received with the wrong UART settings
+    uint32_t commands;          ///< Configuration commands handled
+    uint64_t airtime_us;
+} e220_sim_stats_t;
+
+e220_sim_t *e220_sim_create(e220_sim_output_t output, void *context);
+
+void e220_sim_wire(e220_sim_t *module, uint m0_pin, uint m1_pin, uint aux_pin);
+
+void e220_sim_set_mode(e220_sim_t *module, operating_mode_t mode);
+
+void e220_sim_set_parameters(e220_sim_t *module, parameters_t const *params);
+
+void e220_sim_get_parameters(e220_sim_t const *module, parameters_t *params);
+
+void e220_sim_set_channel_model(e220_sim_t *module, double loss, int8_t rssi_dbm, uint32_t seed);
+
+void e220_sim_set_path_loss(e220_sim_t *module, uint8_t path_loss_db);
+
+void e220_sim_set_half_duplex(e220_sim_t *module, bool half_duplex);
+
+void e220_sim_set_bit_errors(e220_sim_t *module, double rate);
+
+void e220_sim_input(e220_sim_t *module, uint8_t byte, uint baud, hal_parity_t parity);
+
+bool e220_sim_aux(e220_sim_t const *module);
+
+void e220_sim_get_stats(e220_sim_t const *module, e220_sim_stats_t *stats);
+
+uint64_t e220_sim_airtime_us(uint8_t sped, uint32_t len);
+
+void e220_sim_tick_all(void);
+
+#endif //_LORA_BRIDGE_E220_SIM_H_
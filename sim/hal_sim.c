@@ -0,0 +1,229 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "e220_sim.h"
+#include "ring_buffer.h"
+#include "sim.h"
+
+#define SIM_MAX_ALARMS 16
+#define SIM_FIFO_SIZE 8
+
+typedef struct {
+    hal_alarm_t id;
+    uint64_t due_us;
+    hal_alarm_cb_t callback;
+    void *user_data;
+} sim_alarm_t;
+
+uint64_t sim_now_us;
+uint sim_core;
+uart_inst_t sim_uart_inst[NUM_UARTS] = {{.index = 0}, {.index = 1}};
+uint32_t sim_flash_writes;
+
+static sim_alarm_t alarms[SIM_MAX_ALARMS];
+static hal_alarm_t next_alarm_id = 1;
+
+static bool gpio_level[SIM_NUM_GPIOS];
+static hal_gpio_cb_t gpio_callbacks[SIM_NUM_GPIOS];
+
+// One inbox per core, like the RP2040 SIO FIFOs
+static uint8_t fifo_data[2][SIM_FIFO_SIZE * sizeof(uint32_t)];
+static ring_buffer_t fifo[2];
+static bool fifo_ready;
+
+static uint8_t flash[HAL_FLASH_STORE_SIZE];
+static bool flash_ready;
+
+//--------------------------------------------------------------------+
+// World
+//--------------------------------------------------------------------+
+
+static void alarm_tick(void) {
+    for (uint i = 0; i < SIM_MAX_ALARMS; ++i) {
+        sim_alarm_t *alarm = &alarms[i];
+
+        if (alarm->callback == NULL || alarm->due_us > sim_now_us)
+            continue;
+
+        hal_alarm_cb_t callback = alarm->callback;
+        alarm->callback = NULL;
+
+        int64_t again = callback(alarm->id, alarm->user_data);
+        if (again > 0) {
+            alarm->callback = callback;
+            alarm->due_us = sim_now_us + (uint64_t) again;
+        }
+    }
+}
+
+// Advances the world by one tick, the firmware tasks are run by the caller
+void sim_step(void) {
+    sim_now_us += SIM_TICK_US;
+
+    alarm_tick();
+    sim_uart_tick();
+    e220_sim_tick_all();
+}
+
+//--------------------------------------------------------------------+
+// UART
+//--------------------------------------------------------------------+
+
+uint hal_uart_index(uart_inst_t *uart) {
+    return uart->index;
+}
+
+void hal_uart_init_pins(uart_inst_t *uart, uint tx_pin, uint rx_pin) {
+    (void) uart;
+    (void) tx_pin;
+    (void) rx_pin;
+}
+
+void hal_uart_configure(uart_inst_t *uart, uint baud, hal_parity_t parity) {
+    sim_uart_configure(uart, baud, parity);
+}
+
+//--------------------------------------------------------------------+
+// GPIO
+//--------------------------------------------------------------------+
+
+void hal_gpio_init(uint pin, bool output) {
+    (void) output;
+    gpio_callbacks[pin] = NULL;
+}
+
+void hal_gpio_put(uint pin, bool value) {
+    gpio_level[pin] = value;
+}
+
+bool hal_gpio_get(uint pin) {
+    return gpio_level[pin];
+}
+
+void hal_gpio_set_callback(uint pin, hal_gpio_cb_t callback) {
+    gpio_callbacks[pin] = callback;
+}
+
+// Input driven by a model, edges call back like the GPIO interrupt would
+void sim_gpio_drive(uint pin, bool level) {
+    if (gpio_level[pin] == level)
+        return;
+
+    gpio_level[pin] = level;
+    if (gpio_callbacks[pin])
+        gpio_callbacks[pin](pin, level ? HAL_GPIO_EDGE_RISE : HAL_GPIO_EDGE_FALL);
+}
+
+bool sim_gpio_level(uint pin) {
+    return gpio_level[pin];
+}
+
+//--------------------------------------------------------------------+
+// Time
+//--------------------------------------------------------------------+
+
+uint64_t hal_time_us(void) {
+    return sim_now_us;
+}
+
+hal_alarm_t hal_alarm_in_us(uint64_t us, hal_alarm_cb_t callback, void *user_data) {
+    for (uint i = 0; i < SIM_MAX_ALARMS; ++i) {
+        sim_alarm_t *alarm = &alarms[i];
+
+        if (alarm->callback != NULL)
+            continue;
+
+        alarm->id = next_alarm_id++;
+        alarm->due_us = sim_now_us + us;
+        alarm->callback = callback;
+        alarm->user_data = user_data;
+        return alarm->id;
+    }
+
+    return -1;
+}
+
+void hal_alarm_cancel(hal_alarm_t id) {
+    for (uint i = 0; i < SIM_MAX_ALARMS; ++i) {
+        if (alarms[i].callback != NULL && alarms[i].id == id)
+            alarms[i].callback = NULL;
+    }
+}
+
+// Firmware busy-waiting lets the world move on
+void hal_idle(void) {
+    sim_step();
+}
+
+//--------------------------------------------------------------------+
+// Cores
+//--------------------------------------------------------------------+
+
+static void fifo_init(void) {
+    if (fifo_ready)
+        return;
+
+    ring_buffer_init(&fifo[0], fifo_data[0], sizeof(fifo_data[0]));
+    ring_buffer_init(&fifo[1], fifo_data[1], sizeof(fifo_data[1]));
+    fifo_ready = true;
+}
+
+// The simulator runs both cores from its own loop
+void hal_core_launch(void (*entry)(void)) {
+    (void) entry;
+    fifo_init();
+}
+
+void hal_core_push(uint32_t msg) {
+    fifo_init();
+
+    ring_buffer_t *inbox = &fifo[sim_core ^ 1];
+    while (ring_buffer_space(inbox) < sizeof(msg))
+        sim_step();
+
+    ring_buffer_write(inbox, (uint8_t const *) &msg, sizeof(msg));
+}
+
+bool hal_core_pop(uint32_t *msg) {
+    fifo_init();
+
+    ring_buffer_t *inbox = &fifo[sim_core];
+    if (ring_buffer_count(inbox) < sizeof(*msg))
+        return false;
+
+    ring_buffer_read(inbox, (uint8_t *) msg, sizeof(*msg));
+    return true;
+}
+
+//--------------------------------------------------------------------+
+// Flash
+//--------------------------------------------------------------------+
+
+// Erased until the first write, survives radio_core_setup() being run again
+static void flash_init(void) {
+    if (flash_ready)
+        return;
+
+    memset(flash, 0xFF, sizeof(flash));
+    flash_ready = true;
+}
+
+void hal_flash_read(void *data, uint32_t len) {
+    flash_init();
+    memcpy(data, flash, len);
+}
+
+bool hal_flash_write(void const *data, uint32_t len) {
+    if (len > sizeof(flash))
+        return false;
+
+    memset(flash, 0xFF, sizeof(flash));
+    memcpy(flash, data, len);
+    flash_ready = true;
+    sim_flash_writes++;
+    return true;
+}
+
+// Both cores run from the simulator loop, nothing to wait for
+void hal_flash_park(void) {
+}
@@ -0,0 +1,45 @@
+#ifndef _LORA_BRIDGE_SIM_H_
+#define _LORA_BRIDGE_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+// Simulated time advances in fixed ticks, shorter than a byte at 115200 baud
+#define SIM_TICK_US 20
+
+#define SIM_NUM_GPIOS 30
+
+typedef struct e220_sim e220_sim_t;
+
+/// Virtual clock shared by the firmware and the models
+extern uint64_t sim_now_us;
+
+/// Core the firmware code being run belongs to, selects the FIFO direction
+extern uint sim_core;
+
+/// Sector writes through hal_flash_write()
+extern uint32_t sim_flash_writes;
+
+void sim_step(void);
+
+// GPIO
+
+void sim_gpio_drive(uint pin, bool level);
+
+bool sim_gpio_level(uint pin);
+
+// UART wiring between the firmware and a module model
+
+void sim_uart_attach(uart_inst_t *uart, e220_sim_t *module);
+
+void sim_uart_configure(uart_inst_t *uart, uint baud, hal_parity_t parity);
+
+void sim_uart_deliver(uint index, uint8_t byte, uint baud, hal_parity_t parity);
+
+void sim_uart_tick(void);
+
+uint64_t sim_byte_time_us(uint baud, hal_parity_t parity);
+
+#endif //_LORA_BRIDGE_SIM_H_
@@ -0,0 +1,1508 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "e220_sim.h"
+#include "radio_adapt.h"
+#include "radio_arq.h"
+#include "radio_fec.h"
+#include "radio_core.h"
+#include "radio_dest.h"
+#include "radio_frame.h"
+#include "radio_power.h"
+#include "radio_rssi.h"
+#include "sim.h"
+#include "uart_rx.h"
+#include "usb_command.h"
+#include "tusb_config.h"
+
+// Runs the bridge firmware against two simulated E220 modules: module A wired
+// to uart0 as on the board, module B standing for the remote end of the link.
+// Core1 runs radio_core_task(), this loop plays core0 and the USB host.
+//
+// Every run streams data both ways and then pings the far end, which echoes
+// each ping back. The result is printed as one JSON object, see
+// scripts/bench.py for the sweep over the radio settings.
+//
+// With --targets the bridge then switches to fixed transmission and addressed
+// framing: one node gets a bulk transfer while the others are polled every
+// second, showing how long the polls wait behind the bulk data.
+//
+// With --adapt the bridge adjusts the data rate and the TX power while it
+// pings, the peer accepts every change it asks for. --path-loss makes the RSSI
+// and the packet loss follow the settings.
+//
+// With --dual a second module on uart1 talks to a peer of its own on the next
+// channel, and both links stream to their peers at the same time.
+//
+// Every run starts the bridge twice, first reading the modules and then on the
+// parameters cached in flash. --stale-cache changes the settings of the module
+// in between, the background read back has to notice.
+//
+// With --wor the bridge duty-cycles at the given latency target against a peer
+// that does too. A ping each way starts with the receiving end asleep, then
+// the bridge is left suspended by the host.
+//
+// With --arq the module on uart1 moves to the channel of uart0 and both go
+// half duplex. Datagrams then cross from one host to the other, first sent
+// plain and then in reliable mode, which has to deliver all of them in order.
+//
+// With --fec the same two modules carry the datagrams without and then with
+// that many parity bytes per packet, over a channel flipping bits at the
+// --ber rate both ways. Coded, none may arrive corrupted and no fewer arrive.
+
+#define SIM_DEFAULT_BYTES       4096
+#define SIM_DEFAULT_PINGS       20
+#define SIM_DEFAULT_PING_LEN    16
+#define SIM_MAX_PING_LEN        200
+
+#define SIM_SETUP_TIMEOUT_US    (10ull * 1000 * 1000)
+#define SIM_QUIET_TIMEOUT_US    (10ull * 1000 * 1000)   ///< Stream over once nothing arrives for this long
+#define SIM_PING_TIMEOUT_US     (10ull * 1000 * 1000)
+#define SIM_USB_FRAME_US        1000    ///< Full speed frame, one CDC packet per frame
+#define SIM_SETTLE_US           (1000ull * 1000)
+
+#define SIM_BULK_LEN            200     ///< Datagrams to the first node with --targets
+#define SIM_POLL_LEN            32      ///< Datagrams to the other nodes
+#define SIM_POLL_INTERVAL_US    (1000ull * 1000)
+#define SIM_MAX_POLLS           512
+
+#define SIM_SUSPEND_US          (200ull * 1000)     ///< Time allowed to fall asleep once suspended
+
+#define SIM_DATAGRAM_LEN        150
+#define SIM_DEFAULT_BER         0.001
+#define SIM_DATAGRAM_QUIET_US   (4ull * RADIO_ARQ_MAX_RTO_US)   ///< Room for a few backed off timeouts in a row
+
+typedef struct {
+    uint baud;
+    uint data_rate;
+    uint packet_len;
+    uint32_t bytes;
+    uint32_t pings;
+    uint32_t ping_len;
+    double loss;
+    uint32_t seed;
+    bool framed;
+    bool compress;
+    bool text;
+    uint32_t targets;
+    bool rssi;
+    bool adapt;
+    uint32_t path_loss;
+    bool dual;
+    uint32_t wor;                   ///< Latency target in ms, 0 keeps both ends awake
+    bool stale_cache;
+    bool arq;
+    uint32_t fec;                   ///< Parity bytes per packet, 0 skips the run
+    double ber;                     ///< Bit error rate of the run with --fec
+} sim_options_t;
+
+/// Far end, talks to module B at the UART settings of its registers
+typedef struct {
+    e220_sim_t *module;
+    uint8_t const *tx;
+    uint32_t tx_len;
+    uint32_t tx_sent;
+    uint64_t tx_busy_until;
+    uint32_t burst;                 ///< Bytes left to send before waiting for AUX
+    uint32_t rx_len;
+    uint32_t rx_errors;
+    uint64_t rx_last_us;
+    uint8_t const *expect;
+
+    // Echo mode, every packet received is sent back once the module goes quiet
+    bool echo;
+    uint32_t echo_len;
+    uint8_t echo_rx[2 * SIM_MAX_PING_LEN];
+    uint8_t echo_tx[2 * SIM_MAX_PING_LEN];
+    uint32_t fragment_end;          ///< Echoed framed fragments go out as packets of their own
+    bool switch_pending;            ///< Take the settings below once the echo is on air
+    uint8_t switch_rate;
+    uint8_t switch_power;
+} sim_peer_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t received;
+    uint32_t errors;
+    uint64_t elapsed_us;            ///< First byte queued to last byte received
+} sim_stream_t;
+
+/// Node reached with fixed transmission, counts the fragments reaching it
+typedef struct {
+    e220_sim_t *module;
+    uint32_t rx_len;
+    uint32_t polls_answered;
+} sim_node_t;
+
+typedef struct {
+    uint32_t bulk_datagrams;
+    uint32_t bulk_received;         ///< Fragment bytes at the first node, headers included
+    uint32_t bulk_dropped;
+    uint64_t bulk_elapsed_us;
+    uint32_t polls;
+    uint32_t polls_answered;
+    uint64_t latency_us[SIM_MAX_POLLS];
+} sim_targets_t;
+
+typedef struct {
+    uint64_t cold_us;               ///< Start-up to the first module in use, reading it first
+    uint64_t warm_us;               ///< Same on the cached parameters
+    uint64_t check_us;              ///< From the warm start-up to the end of the read back
+    uint8_t check;                  ///< radio_boot_t of the module on uart0
+} sim_boot_t;
+
+typedef struct {
+    uint64_t to_peer_us;            ///< Host write to the sleeping peer, through the sleeping bridge
+    uint64_t to_host_us;            ///< Peer write to the host, the bridge asleep
+    bool suspend_sleeps;            ///< Asleep within SIM_SUSPEND_US of the USB suspend
+    radio_power_stats_t stats;
+} sim_duty_cycle_t;
+
+typedef struct {
+    uint32_t datagrams;
+    uint32_t delivered;             ///< Intact, in order or not
+    uint32_t out_of_order;
+    uint32_t corrupted;
+    uint64_t elapsed_us;            ///< First datagram queued to the last one received
+} sim_datagram_run_t;
+
+typedef struct {
+    sim_datagram_run_t plain;
+    sim_datagram_run_t reliable;
+    radio_arq_stats_t sender;
+    radio_arq_stats_t receiver;
+    uint32_t deaf;                  ///< Packets the modules missed while transmitting
+} sim_arq_t;
+
+typedef struct {
+    sim_datagram_run_t plain;
+    sim_datagram_run_t coded;
+    radio_fec_stats_t sender;
+    radio_fec_stats_t receiver;
+    uint32_t corrupted;             ///< Packets the channel flipped bits in, both runs
+} sim_fec_t;
+
+static sim_peer_t peer;
+static sim_peer_t second_peer;      ///< Far end of the module on uart1, with --dual
+static uint64_t usb_next_frame_us[RADIO_CORE_MODULES];
+
+static uint const uart_bauds[] = {1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200};
+
+//--------------------------------------------------------------------+
+// World
+//--------------------------------------------------------------------+
+
+// The context is the UART the module is wired to
+static void bridge_output(void *context, uint8_t byte, uint baud, hal_parity_t parity) {
+    sim_uart_deliver(hal_uart_index(context), byte, baud, parity);
+}
+
+static void peer_output(void *context, uint8_t byte, uint baud, hal_parity_t parity) {
+    sim_peer_t *p = context;
+    (void) baud;
+    (void) parity;
+
+    if (p->echo) {
+        if (p->echo_len < sizeof(p->echo_rx))
+            p->echo_rx[p->echo_len++] = byte;
+
+        p->rx_last_us = sim_now_us;
+        return;
+    }
+
+    if (p->expect && (p->rx_len >= p->tx_len || p->expect[p->rx_len] != byte))
+        p->rx_errors++;
+
+    p->rx_len++;
+    p->rx_last_us = sim_now_us;
+}
+
+static void node_output(void *context, uint8_t byte, uint baud, hal_parity_t parity) {
+    sim_node_t *node = context;
+    (void) byte;
+    (void) baud;
+    (void) parity;
+
+    node->rx_len++;
+}
+
+static bool valid_header(uint8_t const *data, uint32_t len) {
+    radio_frame_header_t const *header = (radio_frame_header_t const *) data;
+
+    return len >= RADIO_FRAME_HEADER_SIZE && (header->flags & RADIO_FRAME_MAGIC_MASK) == RADIO_FRAME_MAGIC &&
+           header->check == (uint8_t) ~(header->flags ^ header->seq ^ header->index ^ header->len);
+}
+
+// Turns a reflected RATE_REQUEST into its RATE_ACK, the header check does not
+// cover the payload
+static void answer_rate_request(sim_peer_t *p, uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i + RADIO_FRAME_HEADER_SIZE + 3 <= len; ++i) {
+        uint8_t *control = &data[i + RADIO_FRAME_HEADER_SIZE];
+
+        if (!valid_header(&data[i], len - i) || !(data[i] & RADIO_FRAME_FLAG_CONTROL) ||
+            control[0] != RADIO_FRAME_CONTROL_RATE_REQUEST)
+            continue;
+
+        control[0] = RADIO_FRAME_CONTROL_RATE_ACK;
+        p->switch_pending = true;
+        p->switch_rate = control[1];
+        p->switch_power = control[2];
+    }
+}
+
+static void peer_task(sim_peer_t *p) {
+    parameters_t params;
+    e220_sim_get_parameters(p->module, &params);
+
+    uint baud = uart_bauds[(params.sped & RADIO_PARAM_SPED_UART_BAUD_MASK) >> 5];
+
+    // Packets go back as they came, which keeps framed fragments whole
+    if (p->echo && p->echo_len > 0 && p->tx_sent == p->tx_len &&
+        sim_now_us - p->rx_last_us >= 3 * sim_byte_time_us(baud, HAL_PARITY_NONE)) {
+        memcpy(p->echo_tx, p->echo_rx, p->echo_len);
+        answer_rate_request(p, p->echo_tx, p->echo_len);
+        p->tx = p->echo_tx;
+        p->tx_len = p->echo_len;
+        p->tx_sent = 0;
+        p->fragment_end = 0;
+        p->echo_len = 0;
+    }
+
+    if (p->switch_pending && p->tx_sent == p->tx_len && p->tx_busy_until <= sim_now_us && e220_sim_aux(p->module)) {
+        params.sped = (params.sped & ~RADIO_PARAM_SPED_DATA_RATE_MASK) | p->switch_rate;
+        params.opt1 = (params.opt1 & ~RADIO_PARAM_OPT1_TX_POWER_MASK) | p->switch_power;
+        e220_sim_set_parameters(p->module, &params);
+        p->switch_pending = false;
+    }
+
+    if (p->tx_sent == p->tx_len || p->tx_busy_until > sim_now_us)
+        return;
+
+    // Module B has no flow control beyond AUX, fill its buffer then wait for it to drain
+    if (p->burst == 0) {
+        if (!e220_sim_aux(p->module))
+            return;
+
+        p->burst = p->tx_len - p->tx_sent < E220_SIM_BUFFER_SIZE ? p->tx_len - p->tx_sent : E220_SIM_BUFFER_SIZE;
+    }
+
+    // A short pause makes the module close its packet, the RSSI byte of the
+    // receiving bridge has to follow each fragment
+    if (p->tx == p->echo_tx && p->tx_sent == p->fragment_end &&
+        valid_header(&p->tx[p->tx_sent], p->tx_len - p->tx_sent)) {
+        p->fragment_end = p->tx_sent + RADIO_FRAME_HEADER_SIZE + p->tx[p->tx_sent + 3];
+        if (p->tx_sent > 0) {
+            p->tx_busy_until = sim_now_us + RADIO_FRAME_GAP_BYTES * sim_byte_time_us(baud, HAL_PARITY_NONE);
+            return;
+        }
+    }
+
+    p->burst--;
+    e220_sim_input(p->module, p->tx[p->tx_sent++], baud, HAL_PARITY_NONE);
+    p->tx_busy_until = sim_now_us + sim_byte_time_us(baud, HAL_PARITY_NONE);
+}
+
+static void run_tasks(void) {
+    sim_core = 1;
+    radio_core_task();
+    sim_core = 0;
+    radio_core_store_task();
+    peer_task(&peer);
+    if (second_peer.module)
+        peer_task(&second_peer);
+    sim_step();
+}
+
+// Host writes reach a CDC queue one bulk packet per USB frame
+static uint32_t host_write(uint32_t module, uint8_t const *data, uint32_t len) {
+    if (sim_now_us < usb_next_frame_us[module])
+        return 0;
+
+    usb_next_frame_us[module] = sim_now_us + SIM_USB_FRAME_US;
+    return ring_buffer_write(radio_core_tx_queue(module), data,
+                             len < CFG_TUD_CDC_EP_BUFSIZE ? len : CFG_TUD_CDC_EP_BUFSIZE);
+}
+
+// Sends a HID report to core1 and waits for its response
+static bool hid_command(uint8_t const *request, uint8_t *response) {
+    uint64_t start = sim_now_us;
+
+    while (!radio_core_post_command(request, CFG_TUD_HID_EP_BUFSIZE)) {
+        if (sim_now_us - start > SIM_SETUP_TIMEOUT_US)
+            return false;
+
+        run_tasks();
+    }
+
+    while (true) {
+        sim_core = 0;
+        if (radio_core_poll_response(response))
+            return response[1] == USB_COMMAND_SUCCESS;
+
+        run_tasks();
+    }
+}
+
+//--------------------------------------------------------------------+
+// Scenarios
+//--------------------------------------------------------------------+
+
+// Core1 start-up as after a reset of the bridge, the modules keep their
+// settings. Measures until the module on uart0 can be used.
+static bool start_up(uint64_t *elapsed_us) {
+    uint64_t start = sim_now_us;
+
+    sim_core = 1;
+    bool ready = radio_core_setup();
+    sim_core = 0;
+    if (!radio_core_launch() || !ready)
+        return false;
+
+    while (!radio_core_present(0)) {
+        if (sim_now_us - start > SIM_SETUP_TIMEOUT_US)
+            return false;
+
+        run_tasks();
+    }
+
+    *elapsed_us = sim_now_us - start;
+    return true;
+}
+
+/// Starts the bridge again once the cache is in flash, then waits for the
+/// module to be read back. Succeeds when the check found what it should.
+static bool restart(sim_options_t const *options, e220_sim_t *bridge, sim_boot_t *result) {
+    radio_core_stats_t stats;
+    uint64_t start = sim_now_us;
+
+    // Missing modules have to give up first, a reset does not interrupt them here
+    do {
+        if (sim_now_us - start > SIM_SETUP_TIMEOUT_US)
+            return false;
+
+        run_tasks();
+        radio_core_get_stats(&stats);
+    } while (sim_flash_writes == 0 || stats.modules[0].boot == RADIO_BOOT_READING ||
+             stats.modules[1].boot == RADIO_BOOT_READING);
+
+    if (options->stale_cache) {
+        parameters_t params;
+        e220_sim_get_parameters(bridge, &params);
+        params.chan++;
+        e220_sim_set_parameters(bridge, &params);
+    }
+
+    if (!start_up(&result->warm_us))
+        return false;
+
+    // Counters published before the start-up still show the first one
+    start = sim_now_us;
+
+    do {
+        if (sim_now_us - start > SIM_SETUP_TIMEOUT_US)
+            return false;
+
+        run_tasks();
+        radio_core_get_stats(&stats);
+    } while (stats.modules[0].boot <= RADIO_BOOT_VERIFYING);
+
+    result->check_us = sim_now_us - start;
+    result->check = stats.modules[0].boot;
+    return result->check == (options->stale_cache ? RADIO_BOOT_MISMATCH : RADIO_BOOT_VERIFIED);
+}
+
+/// Posts RADIO_CORE_COMMAND_SLOTS commands at once, module reads among them,
+/// and checks they complete in order with their sequence numbers
+static bool pipeline(uint64_t *elapsed_us) {
+    static uint8_t const commands[] = {USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_UART_STATS,
+                                       USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_AIRTIME};
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {0};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    uint64_t start = sim_now_us;
+
+    for (uint32_t i = 0; i < sizeof(commands); ++i) {
+        request[0] = commands[i];
+        request[1] = USB_COMMAND_READ_REFRESH;
+        request[USB_COMMAND_SEQUENCE_INDEX] = (uint8_t) (0x40 + i);
+        if (!radio_core_post_command(request, sizeof(request)))
+            return false;
+    }
+
+    // One more has to wait for a free slot
+    if (radio_core_post_command(request, sizeof(request)))
+        return false;
+
+    for (uint32_t i = 0; i < sizeof(commands); ++i) {
+        while (!radio_core_poll_response(response)) {
+            if (sim_now_us - start > SIM_SETUP_TIMEOUT_US)
+                return false;
+
+            run_tasks();
+        }
+
+        if (response[0] != commands[i] || response[USB_COMMAND_SEQUENCE_INDEX] != 0x40 + i ||
+            response[1] != USB_COMMAND_SUCCESS)
+            return false;
+    }
+
+    *elapsed_us = sim_now_us - start;
+    return true;
+}
+
+// Counters as published once core1 caught up with everything before the call
+static void settled_stats(radio_core_stats_t *stats) {
+    uint64_t until = sim_now_us + 2 * RADIO_CORE_STATS_INTERVAL_US;
+    while (sim_now_us < until)
+        run_tasks();
+
+    radio_core_get_stats(stats);
+}
+
+/// Rewrites CHAN and OPT1 with their current values and reads SPED back, all
+/// three in one MODE_SLEEP window
+static bool batch(uint32_t *switches, uint64_t *elapsed_us) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_CACHED};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    if (!hid_command(request, response))
+        return false;
+
+    parameters_t params;
+    memcpy(&params, &response[2], sizeof(params));
+
+    uint8_t const commands[] = {
+            3,
+            USB_COMMAND_BATCH_WRITE, 4, 1, params.chan,
+            USB_COMMAND_BATCH_WRITE, 3, 1, params.opt1,
+            USB_COMMAND_BATCH_READ, 2, 1,
+    };
+    uint8_t const results[] = {3, 4, 1, params.chan, 3, 1, params.opt1, 2, 1, params.sped};
+
+    memset(request, 0, sizeof(request));
+    request[0] = USB_COMMAND_BATCH;
+    memcpy(&request[1], commands, sizeof(commands));
+
+    radio_core_stats_t before;
+    radio_core_stats_t after;
+    settled_stats(&before);
+
+    uint64_t start = sim_now_us;
+    if (!hid_command(request, response) || memcmp(&response[2], results, sizeof(results)) != 0)
+        return false;
+
+    *elapsed_us = sim_now_us - start;
+    settled_stats(&after);
+    *switches = after.modules[0].radio.switches - before.modules[0].radio.switches;
+    return true;
+}
+
+// Applies the radio settings to a bridge module through the HID path, as the
+// host would, and straight to its peer. Each module gets a channel of its own.
+static bool configure(sim_options_t const *options, uint32_t module, sim_peer_t *p) {
+    uint8_t sped;
+    uint8_t opt1;
+
+    switch (options->data_rate) {
+        case 2400: sped = RADIO_PARAM_SPED_DATA_RATE_2400; break;
+        case 4800: sped = RADIO_PARAM_SPED_DATA_RATE_4800; break;
+        case 9600: sped = RADIO_PARAM_SPED_DATA_RATE_9600; break;
+        case 19200: sped = RADIO_PARAM_SPED_DATA_RATE_19200; break;
+        case 38400: sped = RADIO_PARAM_SPED_DATA_RATE_38400; break;
+        case 62500: sped = RADIO_PARAM_SPED_DATA_RATE_62500; break;
+        default: return false;
+    }
+
+    switch (options->packet_len) {
+        case 200: opt1 = RADIO_PARAM_OPT1_PACKET_LEN_200; break;
+        case 128: opt1 = RADIO_PARAM_OPT1_PACKET_LEN_128; break;
+        case 64: opt1 = RADIO_PARAM_OPT1_PACKET_LEN_64; break;
+        case 32: opt1 = RADIO_PARAM_OPT1_PACKET_LEN_32; break;
+        default: return false;
+    }
+
+    uint i = 0;
+    while (i < sizeof(uart_bauds) / sizeof(uart_bauds[0]) && uart_bauds[i] != options->baud)
+        i++;
+
+    if (i == sizeof(uart_bauds) / sizeof(uart_bauds[0]))
+        return false;
+
+    sped |= (uint8_t) (i << 5) | RADIO_PARAM_SPED_UART_MODE_8N1;
+
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_REFRESH};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    request[USB_COMMAND_MODULE_INDEX] = (uint8_t) module;
+    if (!hid_command(request, response))
+        return false;
+
+    parameters_t params;
+    memcpy(&params, &response[2], sizeof(params));
+    params.sped = sped;
+    params.chan = (uint8_t) (RADIO_DEFAULT_CHANNEL + module);
+    params.opt1 = (params.opt1 & ~RADIO_PARAM_OPT1_PACKET_LEN_MASK) | opt1;
+    if (options->rssi)
+        params.opt2 |= RADIO_PARAM_OPT2_RSSI_BYTE_ENABLE;
+
+    request[0] = USB_COMMAND_WRITE_PARAMS;
+    request[1] = 0;
+    memcpy(&request[2], &params, sizeof(params));
+    if (!hid_command(request, response) || memcmp(&response[2], &params, sizeof(params)) != 0)
+        return false;
+
+    // The far end reads its data raw, without the RSSI byte
+    params.opt2 &= ~RADIO_PARAM_OPT2_RSSI_BYTE_MASK;
+    e220_sim_set_parameters(p->module, &params);
+    return true;
+}
+
+// Turns compression on and waits for the echoing peer to answer the handshake,
+// it reflects the bridge HELLO so the bridge negotiates with itself
+static bool negotiate_compression(void) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_SET_COMPRESSION, USB_COMMAND_COMPRESSION_ON};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    uint64_t start = sim_now_us;
+
+    peer.echo = true;
+    if (!hid_command(request, response))
+        return false;
+
+    request[1] = USB_COMMAND_COMPRESSION_QUERY;
+    while (response[2] != RADIO_FRAME_COMPRESS_ACTIVE) {
+        if (sim_now_us - start > RADIO_FRAME_HELLO_ATTEMPTS * RADIO_FRAME_HELLO_INTERVAL_US + SIM_SETUP_TIMEOUT_US ||
+            response[2] != RADIO_FRAME_COMPRESS_NEGOTIATING || !hid_command(request, response))
+            return false;
+    }
+
+    // Let the reflected HELLO_ACK come back before the pings start
+    uint64_t settle = sim_now_us + SIM_SETTLE_US;
+    while (sim_now_us < settle)
+        run_tasks();
+
+    peer.echo = false;
+    return true;
+}
+
+static void stream_to_peer(uint8_t const *pattern, uint32_t len, sim_stream_t *result) {
+    uint64_t start = sim_now_us;
+    uint32_t queued = 0;
+
+    peer.expect = pattern;
+    peer.tx_len = len;
+    peer.tx_sent = len;
+    peer.rx_len = 0;
+    peer.rx_errors = 0;
+    peer.rx_last_us = start;
+
+    // Written at once, the bridge holds the host off through the queue
+    while (peer.rx_len < len && sim_now_us - peer.rx_last_us < SIM_QUIET_TIMEOUT_US) {
+        queued += host_write(0, &pattern[queued], len - queued);
+        run_tasks();
+    }
+
+    result->sent = len;
+    result->received = peer.rx_len;
+    result->errors = peer.rx_errors;
+    result->elapsed_us = peer.rx_last_us - start;
+    peer.expect = NULL;
+}
+
+// Both modules stream to their peers at once, each link on its own channel
+static void stream_dual(uint8_t const *pattern, uint32_t len, sim_stream_t *results) {
+    sim_peer_t *peers[RADIO_CORE_MODULES] = {&peer, &second_peer};
+    uint32_t queued[RADIO_CORE_MODULES] = {0};
+    uint64_t start = sim_now_us;
+    bool running = true;
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        sim_peer_t *p = peers[module];
+        p->expect = pattern;
+        p->tx_len = len;
+        p->tx_sent = len;
+        p->rx_len = 0;
+        p->rx_errors = 0;
+        p->rx_last_us = start;
+    }
+
+    while (running) {
+        running = false;
+        for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+            sim_peer_t *p = peers[module];
+            if (p->rx_len < len && sim_now_us - p->rx_last_us < SIM_QUIET_TIMEOUT_US)
+                running = true;
+
+            queued[module] += host_write(module, &pattern[queued[module]], len - queued[module]);
+        }
+
+        run_tasks();
+    }
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        sim_peer_t *p = peers[module];
+        results[module] = (sim_stream_t) {
+                .sent = len,
+                .received = p->rx_len,
+                .errors = p->rx_errors,
+                .elapsed_us = p->rx_last_us - start,
+        };
+        p->expect = NULL;
+    }
+}
+
+static void stream_to_host(uint8_t const *pattern, uint32_t len, sim_stream_t *result) {
+    ring_buffer_t *rx_queue = radio_core_rx_queue(0);
+    uint64_t start = sim_now_us;
+    uint64_t last = start;
+
+    peer.tx = pattern;
+    peer.tx_len = len;
+    peer.tx_sent = 0;
+
+    *result = (sim_stream_t) {.sent = len};
+
+    while (result->received < len && sim_now_us - last < SIM_QUIET_TIMEOUT_US) {
+        uint8_t byte;
+        while (ring_buffer_get(rx_queue, &byte)) {
+            if (pattern[result->received] != byte)
+                result->errors++;
+
+            result->received++;
+            last = sim_now_us;
+        }
+
+        run_tasks();
+    }
+
+    result->elapsed_us = last - start;
+
+    // Whatever was lost leaves the peer waiting on nothing
+    peer.tx_sent = peer.tx_len;
+    peer.burst = 0;
+}
+
+static int compare_u64(void const *a, void const *b) {
+    uint64_t x = *(uint64_t const *) a;
+    uint64_t y = *(uint64_t const *) b;
+    return x < y ? -1 : x > y;
+}
+
+// Telemetry-like text for --text, redundant as our sensor reports are
+static void fill_text(uint8_t *dst, uint32_t len, uint32_t n) {
+    char line[64];
+    uint32_t i = 0;
+
+    while (i < len) {
+        int line_len = snprintf(line, sizeof(line), "{\"node\":%u,\"temp\":%u.%u,\"hum\":%u}\n",
+                                7, 20 + n % 5, (n + i) % 10, 40 + (i / 32) % 3);
+
+        for (int j = 0; j < line_len && i < len; ++j)
+            dst[i++] = line[j];
+    }
+}
+
+/// Round trips through the bridge and the echoing peer, returns the number
+/// answered and their latencies sorted. Framed pings are single datagrams.
+static uint32_t ping(sim_options_t const *options, uint64_t *latency_us) {
+    ring_buffer_t *rx_queue = radio_core_rx_queue(0);
+    uint8_t request[RADIO_FRAME_PREFIX_SIZE + SIM_MAX_PING_LEN];
+    uint32_t payload = options->ping_len;
+    uint32_t offset = 0;
+    uint32_t len = payload;
+    uint32_t answered = 0;
+
+    if (options->framed) {
+        request[0] = payload & 0xFF;
+        request[1] = payload >> 8;
+        offset = RADIO_FRAME_PREFIX_SIZE;
+        len = offset + payload;
+    }
+
+    peer.echo = true;
+
+    for (uint32_t n = 0; n < options->pings; ++n) {
+        if (options->text) {
+            fill_text(&request[offset], payload, n);
+        } else {
+            for (uint32_t i = 0; i < payload; ++i)
+                request[offset + i] = (uint8_t) (n + i);
+        }
+
+        // Start from a clean slate after a lost ping
+        uint8_t byte;
+        while (ring_buffer_get(rx_queue, &byte));
+
+        uint64_t start = sim_now_us;
+        uint32_t queued = 0;
+        uint32_t received = 0;
+        bool match = true;
+
+        while (received < len && sim_now_us - start < SIM_PING_TIMEOUT_US) {
+            queued += host_write(0, &request[queued], len - queued);
+
+            while (received < len && ring_buffer_get(rx_queue, &byte))
+                match &= byte == request[received++];
+
+            run_tasks();
+        }
+
+        if (received == len && match)
+            latency_us[answered++] = sim_now_us - start;
+    }
+
+    peer.echo = false;
+    qsort(latency_us, answered, sizeof(uint64_t), compare_u64);
+    return answered;
+}
+
+static uint32_t address_datagram(uint8_t *datagram, uint16_t address, uint8_t chan, uint32_t len, uint8_t fill) {
+    uint32_t total = RADIO_DEST_ADDRESS_SIZE + len;
+
+    datagram[0] = total & 0xFF;
+    datagram[1] = total >> 8;
+    datagram[2] = address >> 8;
+    datagram[3] = address & 0xFF;
+    datagram[4] = chan;
+    memset(&datagram[RADIO_FRAME_PREFIX_SIZE + RADIO_DEST_ADDRESS_SIZE], fill, len);
+    return RADIO_FRAME_PREFIX_SIZE + total;
+}
+
+/// Bulk datagrams to node 1 with polls to the other nodes in between, the
+/// latencies of the answered polls are sorted
+static bool fixed_targets(sim_options_t const *options, sim_targets_t *result) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_CACHED};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    if (!hid_command(request, response))
+        return false;
+
+    parameters_t params;
+    memcpy(&params, &response[2], sizeof(params));
+    params.opt2 = (params.opt2 & ~RADIO_PARAM_OPT2_TX_METHOD_MASK) | RADIO_PARAM_OPT2_TX_METHOD_FIXED;
+
+    request[0] = USB_COMMAND_WRITE_PARAMS;
+    request[1] = 0;
+    memcpy(&request[2], &params, sizeof(params));
+    if (!hid_command(request, response))
+        return false;
+
+    request[0] = USB_COMMAND_SET_FRAMING;
+    request[1] = USB_COMMAND_FRAMING_ADDRESSED;
+    if (!hid_command(request, response))
+        return false;
+
+    static sim_node_t nodes[RADIO_DEST_MAX];
+    for (uint32_t i = 0; i < options->targets; ++i) {
+        parameters_t node_params = params;
+        node_params.addh = 0;
+        node_params.addl = i + 1;
+        node_params.opt2 &= ~RADIO_PARAM_OPT2_TX_METHOD_MASK;
+
+        nodes[i].module = e220_sim_create(node_output, &nodes[i]);
+        e220_sim_set_parameters(nodes[i].module, &node_params);
+        e220_sim_set_channel_model(nodes[i].module, options->loss, -60, options->seed + i);
+    }
+
+    uint8_t datagram[RADIO_FRAME_PREFIX_SIZE + RADIO_DEST_ADDRESS_SIZE + SIM_BULK_LEN];
+    uint32_t len = 0;
+    uint32_t written = 0;
+    uint32_t bulk_left = options->bytes / SIM_BULK_LEN ? options->bytes / SIM_BULK_LEN : 1;
+    uint32_t polls_due = 0;
+    uint64_t poll_us[SIM_MAX_POLLS / (RADIO_DEST_MAX - 1) + 1];
+    uint32_t rounds = 0;
+    uint32_t bulk_len = 0;
+    uint64_t start = sim_now_us;
+    uint64_t next_poll_us = start + SIM_POLL_INTERVAL_US;
+    uint64_t last_rx_us = start;
+
+    *result = (sim_targets_t) {.bulk_datagrams = bulk_left};
+
+    while (sim_now_us - last_rx_us < SIM_QUIET_TIMEOUT_US) {
+        if (written == len && polls_due > 0) {
+            uint32_t node = options->targets - polls_due--;
+            len = address_datagram(datagram, node + 1, params.chan, SIM_POLL_LEN, (uint8_t) rounds);
+            written = 0;
+            result->polls++;
+        } else if (written == len && bulk_left > 0) {
+            len = address_datagram(datagram, 1, params.chan, SIM_BULK_LEN, (uint8_t) bulk_left--);
+            written = 0;
+        }
+
+        written += host_write(0, &datagram[written], len - written);
+
+        // Polls go out while the bulk transfer lasts
+        if (bulk_left > 0 && sim_now_us >= next_poll_us && rounds < sizeof(poll_us) / sizeof(poll_us[0])) {
+            poll_us[rounds++] = sim_now_us;
+            polls_due = options->targets - 1;
+            next_poll_us += SIM_POLL_INTERVAL_US;
+        }
+
+        for (uint32_t i = 0; i < options->targets; ++i) {
+            sim_node_t *node = &nodes[i];
+
+            if (i == 0 && node->rx_len != bulk_len) {
+                bulk_len = node->rx_len;
+                result->bulk_elapsed_us = sim_now_us - start;
+                last_rx_us = sim_now_us;
+            }
+
+            while (i > 0 && node->polls_answered < node->rx_len / (RADIO_FRAME_HEADER_SIZE + SIM_POLL_LEN)) {
+                result->latency_us[result->polls_answered++] = sim_now_us - poll_us[node->polls_answered++];
+                last_rx_us = sim_now_us;
+            }
+        }
+
+        run_tasks();
+    }
+
+    result->bulk_received = bulk_len;
+    qsort(result->latency_us, result->polls_answered, sizeof(uint64_t), compare_u64);
+
+    // Queues are assigned in order of the first datagram, bulk went first
+    request[0] = USB_COMMAND_READ_DESTINATION;
+    request[1] = 0;
+    if (hid_command(request, response)) {
+        radio_dest_stats_t stats;
+        memcpy(&stats, &response[2], sizeof(stats));
+        result->bulk_dropped = stats.dropped;
+    }
+
+    return true;
+}
+
+static bool query_power(radio_power_stats_t *stats) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_SET_POWER, USB_COMMAND_POWER_QUERY};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    if (!hid_command(request, response))
+        return false;
+
+    memcpy(stats, &response[2], sizeof(*stats));
+    return true;
+}
+
+// Runs until the bridge went back to sleep, true if it did
+static bool wait_asleep(uint64_t timeout_us) {
+    radio_power_stats_t stats;
+    uint64_t until = sim_now_us + timeout_us;
+
+    while (sim_now_us < until)
+        run_tasks();
+
+    return query_power(&stats) && stats.state == RADIO_POWER_SAVING;
+}
+
+/// Both ends on the same WOR cycle, the bridge sending with the preamble and
+/// the peer answering with it. Each ping waits out the idle time first.
+static bool duty_cycle(sim_options_t const *options, sim_duty_cycle_t *result) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_SET_POWER, USB_COMMAND_POWER_ON,
+                                               options->wor & 0xFF, options->wor >> 8, 0x01};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    if (!hid_command(request, response))
+        return false;
+
+    radio_power_stats_t stats;
+    memcpy(&stats, &response[2], sizeof(stats));
+
+    parameters_t params;
+    e220_sim_get_parameters(peer.module, &params);
+    params.opt2 = (params.opt2 & ~RADIO_PARAM_OPT2_WOR_CYCLE_MASK) | stats.wor_cycle;
+    e220_sim_set_parameters(peer.module, &params);
+    e220_sim_set_mode(peer.module, MODE_POWER_SAVING);
+
+    uint8_t data[SIM_MAX_PING_LEN];
+    uint32_t len = options->ping_len;
+    for (uint32_t i = 0; i < len; ++i)
+        data[i] = (uint8_t) (i * 37);
+
+    *result = (sim_duty_cycle_t) {0};
+
+    // Host to peer, both asleep
+    if (!wait_asleep(RADIO_POWER_IDLE_US + SIM_SETTLE_US))
+        return false;
+
+    uint64_t start = sim_now_us;
+    uint32_t queued = 0;
+
+    peer.expect = data;
+    peer.tx_len = len;
+    peer.tx_sent = len;
+    peer.rx_len = 0;
+    peer.rx_errors = 0;
+
+    while (peer.rx_len < len && sim_now_us - start < SIM_PING_TIMEOUT_US) {
+        queued += host_write(0, &data[queued], len - queued);
+        run_tasks();
+    }
+
+    peer.expect = NULL;
+    if (peer.rx_len < len || peer.rx_errors > 0)
+        return false;
+
+    result->to_peer_us = sim_now_us - start;
+
+    // Peer to host, the peer now awake and sending with the preamble
+    e220_sim_set_mode(peer.module, MODE_WAKE_UP);
+    if (!wait_asleep(RADIO_POWER_IDLE_US + SIM_SETTLE_US))
+        return false;
+
+    ring_buffer_t *rx_queue = radio_core_rx_queue(0);
+    uint32_t received = 0;
+    uint8_t byte;
+
+    start = sim_now_us;
+    peer.tx = data;
+    peer.tx_len = len;
+    peer.tx_sent = 0;
+    peer.burst = 0;
+
+    while (received < len && sim_now_us - start < SIM_PING_TIMEOUT_US) {
+        while (received < len && ring_buffer_get(rx_queue, &byte)) {
+            if (byte != data[received++])
+                return false;
+        }
+
+        run_tasks();
+    }
+
+    if (received < len)
+        return false;
+
+    result->to_host_us = sim_now_us - start;
+
+    // A suspended host does not wait for the idle time
+    radio_core_suspend(true);
+    result->suspend_sleeps = wait_asleep(SIM_SUSPEND_US);
+    radio_core_suspend(false);
+
+    if (!query_power(&result->stats))
+        return false;
+
+    request[1] = USB_COMMAND_POWER_OFF;
+    request[4] = 0x00;
+    e220_sim_set_mode(peer.module, MODE_NORMAL);
+    return hid_command(request, response);
+}
+
+// Datagrams from the host of uart0 to the host of uart1 over the air, each
+// carrying its run and number. Those arriving intact are counted, in order or
+// not, late ones of an earlier run are not.
+static void datagram_stream(uint32_t count, sim_datagram_run_t *result) {
+    static uint8_t run;
+    uint32_t size = RADIO_FRAME_PREFIX_SIZE + SIM_DATAGRAM_LEN;
+    uint8_t *data = malloc(count * size);
+    ring_buffer_t *rx_queue = radio_core_rx_queue(1);
+    uint8_t datagram[RADIO_FRAME_PREFIX_SIZE + SIM_DATAGRAM_LEN];
+    uint32_t queued = 0;
+    uint32_t next = 0;
+
+    run++;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t *out = &data[i * size];
+        out[0] = SIM_DATAGRAM_LEN & 0xFF;
+        out[1] = SIM_DATAGRAM_LEN >> 8;
+        out[2] = i & 0xFF;
+        out[3] = i >> 8;
+        out[4] = run;
+        for (uint32_t j = 5; j < size; ++j)
+            out[j] = (uint8_t) (i * 7 + j * 13);
+    }
+
+    ring_buffer_consume(rx_queue, ring_buffer_count(rx_queue));
+    *result = (sim_datagram_run_t) {.datagrams = count};
+
+    uint64_t start = sim_now_us;
+    uint64_t last = start;
+
+    while (next < count && sim_now_us - last < SIM_DATAGRAM_QUIET_US) {
+        queued += host_write(0, &data[queued], count * size - queued);
+        run_tasks();
+
+        while (ring_buffer_count(rx_queue) >= RADIO_FRAME_PREFIX_SIZE) {
+            uint32_t len = ring_buffer_at(rx_queue, 0) | ring_buffer_at(rx_queue, 1) << 8;
+            if (ring_buffer_count(rx_queue) < RADIO_FRAME_PREFIX_SIZE + len)
+                break;
+
+            last = sim_now_us;
+            if (len != SIM_DATAGRAM_LEN) {
+                ring_buffer_consume(rx_queue, RADIO_FRAME_PREFIX_SIZE + len);
+                result->corrupted++;
+                continue;
+            }
+
+            ring_buffer_read(rx_queue, datagram, size);
+            uint32_t index = datagram[2] | datagram[3] << 8;
+            if (datagram[4] != run && index < count &&
+                memcmp(&datagram[5], &data[index * size + 5], size - 5) == 0)
+                continue;
+
+            if (index >= count || memcmp(datagram, &data[index * size], size) != 0) {
+                result->corrupted++;
+                continue;
+            }
+
+            result->delivered++;
+            if (index < next)
+                result->out_of_order++;
+            else
+                next = index + 1;
+        }
+    }
+
+    // A datagram cut off would run into the first one of the next run
+    uint64_t stop = sim_now_us;
+    while (queued % size != 0 && sim_now_us - stop < SIM_DATAGRAM_QUIET_US) {
+        queued += host_write(0, &data[queued], size - queued % size);
+        run_tasks();
+    }
+
+    result->elapsed_us = last - start;
+    free(data);
+}
+
+/// Module 1 joins module 0 on its channel, both framed and half duplex
+static bool join(e220_sim_t *const *modules) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_READ_PARAMS, USB_COMMAND_READ_CACHED};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    parameters_t params;
+
+    request[USB_COMMAND_MODULE_INDEX] = 1;
+    if (!hid_command(request, response))
+        return false;
+
+    memcpy(&params, &response[2], sizeof(params));
+    params.chan = RADIO_DEFAULT_CHANNEL;
+    request[0] = USB_COMMAND_WRITE_PARAMS;
+    request[1] = 0;
+    memcpy(&request[2], &params, sizeof(params));
+    if (!hid_command(request, response))
+        return false;
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        request[0] = USB_COMMAND_SET_FRAMING;
+        request[1] = USB_COMMAND_FRAMING_FRAMED;
+        request[USB_COMMAND_MODULE_INDEX] = (uint8_t) module;
+        if (!hid_command(request, response))
+            return false;
+
+        e220_sim_set_half_duplex(modules[module], true);
+    }
+
+    return true;
+}
+
+/// The same datagrams go across without and then with reliable mode
+static bool reliable(sim_options_t const *options, e220_sim_t *const *modules, sim_arq_t *result) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE];
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    uint32_t count = options->bytes / SIM_DATAGRAM_LEN;
+    if (count == 0)
+        count = 1;
+
+    if (!join(modules))
+        return false;
+
+    *result = (sim_arq_t) {0};
+    datagram_stream(count, &result->plain);
+
+    // Waits for the receiving bridge to answer the sync
+    uint64_t start = sim_now_us;
+    request[0] = USB_COMMAND_SET_ARQ;
+    request[1] = USB_COMMAND_ARQ_ON;
+    request[USB_COMMAND_MODULE_INDEX] = 0;
+    if (!hid_command(request, response))
+        return false;
+
+    request[1] = USB_COMMAND_ARQ_QUERY;
+    while (response[2] != RADIO_ARQ_ACTIVE) {
+        if (sim_now_us - start > RADIO_ARQ_SYNC_ATTEMPTS * RADIO_ARQ_SYNC_INTERVAL_US + SIM_SETUP_TIMEOUT_US ||
+            response[2] != RADIO_ARQ_SYNCING || !hid_command(request, response))
+            return false;
+    }
+
+    datagram_stream(count, &result->reliable);
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        e220_sim_stats_t stats;
+        e220_sim_get_stats(modules[module], &stats);
+        result->deaf += stats.deaf;
+
+        request[USB_COMMAND_MODULE_INDEX] = (uint8_t) module;
+        if (!hid_command(request, response))
+            return false;
+
+        memcpy(module == 0 ? &result->sender : &result->receiver, &response[2], sizeof(radio_arq_stats_t));
+    }
+
+    return result->reliable.delivered == count && result->reliable.out_of_order == 0 &&
+           result->reliable.corrupted == 0;
+}
+
+/// The same datagrams go across without and then with parity, reliable mode
+/// stays on after --arq
+static bool coded(sim_options_t const *options, e220_sim_t *const *modules, sim_fec_t *result) {
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_SET_FEC, (uint8_t) options->fec};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    uint32_t count = options->bytes / SIM_DATAGRAM_LEN;
+    if (count == 0)
+        count = 1;
+
+    if (!join(modules))
+        return false;
+
+    *result = (sim_fec_t) {0};
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module)
+        e220_sim_set_bit_errors(modules[module], options->ber);
+
+    datagram_stream(count, &result->plain);
+
+    request[USB_COMMAND_MODULE_INDEX] = 0;
+    if (!hid_command(request, response))
+        return false;
+
+    datagram_stream(count, &result->coded);
+
+    request[1] = USB_COMMAND_FEC_QUERY;
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        e220_sim_stats_t stats;
+        e220_sim_get_stats(modules[module], &stats);
+        e220_sim_set_bit_errors(modules[module], 0);
+        result->corrupted += stats.corrupted;
+
+        request[USB_COMMAND_MODULE_INDEX] = (uint8_t) module;
+        if (!hid_command(request, response))
+            return false;
+
+        memcpy(module == 0 ? &result->sender : &result->receiver, &response[2], sizeof(radio_fec_stats_t));
+    }
+
+    return result->coded.corrupted == 0 && result->coded.delivered >= result->plain.delivered;
+}
+
+//--------------------------------------------------------------------+
+// Main
+//--------------------------------------------------------------------+
+
+static void print_stream(char const *name, sim_stream_t const *stream) {
+    double seconds = (double) stream->elapsed_us / 1e6;
+
+    printf("  \"%s\": {\"sent\": %u, \"received\": %u, \"errors\": %u, \"seconds\": %.6f, "
+           "\"goodput_bps\": %.1f, \"loss\": %.4f},\n",
+           name, stream->sent, stream->received, stream->errors, seconds,
+           seconds > 0 ? stream->received * 8 / seconds : 0.0,
+           stream->sent ? 1.0 - (double) stream->received / stream->sent : 0.0);
+}
+
+static uint64_t percentile(uint64_t const *sorted, uint32_t count, uint percent) {
+    return count ? sorted[(count - 1) * percent / 100] : 0;
+}
+
+static void usage(char const *name) {
+    fprintf(stderr,
+            "Usage: %s [--baud 9600] [--data-rate 2400] [--packet-len 200] [--bytes 4096]\n"
+            "          [--pings 20] [--ping-len 16] [--loss 0.0] [--seed 1] [--framed]\n"
+            "          [--compress] [--text] [--targets 0] [--rssi] [--adapt] [--path-loss 0]\n"
+            "          [--dual] [--wor 0] [--stale-cache] [--arq] [--fec 0] [--ber 0.001]\n", name);
+}
+
+int main(int argc, char **argv) {
+    sim_options_t options = {
+            .baud = 9600,
+            .data_rate = 2400,
+            .packet_len = 200,
+            .bytes = SIM_DEFAULT_BYTES,
+            .pings = SIM_DEFAULT_PINGS,
+            .ping_len = SIM_DEFAULT_PING_LEN,
+            .loss = 0.0,
+            .seed = 1,
+            .ber = SIM_DEFAULT_BER,
+    };
+
+    static struct option const long_options[] = {
+            {"baud", required_argument, NULL, 'b'},
+            {"data-rate", required_argument, NULL, 'r'},
+            {"packet-len", required_argument, NULL, 'p'},
+            {"bytes", required_argument, NULL, 'n'},
+            {"pings", required_argument, NULL, 'c'},
+            {"ping-len", required_argument, NULL, 'l'},
+            {"loss", required_argument, NULL, 'x'},
+            {"seed", required_argument, NULL, 's'},
+            {"framed", no_argument, NULL, 'f'},
+            {"compress", no_argument, NULL, 'z'},
+            {"text", no_argument, NULL, 't'},
+            {"targets", required_argument, NULL, 'a'},
+            {"rssi", no_argument, NULL, 'i'},
+            {"adapt", no_argument, NULL, 'd'},
+            {"path-loss", required_argument, NULL, 'o'},
+            {"dual", no_argument, NULL, 'u'},
+            {"wor", required_argument, NULL, 'w'},
+            {"stale-cache", no_argument, NULL, 'k'},
+            {"arq", no_argument, NULL, 'q'},
+            {"fec", required_argument, NULL, 'e'},
+            {"ber", required_argument, NULL, 'y'},
+            {NULL, 0, NULL, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'b': options.baud = strtoul(optarg, NULL, 0); break;
+            case 'r': options.data_rate = strtoul(optarg, NULL, 0); break;
+            case 'p': options.packet_len = strtoul(optarg, NULL, 0); break;
+            case 'n': options.bytes = strtoul(optarg, NULL, 0); break;
+            case 'c': options.pings = strtoul(optarg, NULL, 0); break;
+            case 'l': options.ping_len = strtoul(optarg, NULL, 0); break;
+            case 'x': options.loss = strtod(optarg, NULL); break;
+            case 's': options.seed = strtoul(optarg, NULL, 0); break;
+            case 'f': options.framed = true; break;
+            case 'z': options.compress = options.framed = true; break;
+            case 't': options.text = true; break;
+            case 'a': options.targets = strtoul(optarg, NULL, 0); break;
+            case 'i': options.rssi = true; break;
+            case 'd': options.adapt = options.rssi = options.framed = true; break;
+            case 'o': options.path_loss = strtoul(optarg, NULL, 0); break;
+            case 'u': options.dual = true; break;
+            case 'w': options.wor = strtoul(optarg, NULL, 0); break;
+            case 'k': options.stale_cache = true; break;
+            case 'q': options.arq = options.dual = true; break;
+            case 'e': options.fec = strtoul(optarg, NULL, 0); options.dual = true; break;
+            case 'y': options.ber = strtod(optarg, NULL); break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+
+    if (options.ping_len == 0 || options.ping_len > SIM_MAX_PING_LEN || options.targets == 1 ||
+        options.targets > RADIO_DEST_MAX || options.path_loss > 255 || (options.arq && options.targets > 0) ||
+        (options.fec != 0 && (!radio_fec_valid_parity(options.fec) || options.targets > 0)) ||
+        options.ber < 0 || options.ber >= 1 ||
+        (options.wor != 0 && (options.wor < RADIO_POWER_MIN_LATENCY_MS || options.wor > UINT16_MAX ||
+                              options.framed || options.targets > 0))) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    e220_sim_t *bridge = e220_sim_create(bridge_output, uart0);
+    e220_sim_wire(bridge, 2, 3, 6);
+    sim_uart_attach(uart0, bridge);
+
+    peer.module = e220_sim_create(peer_output, &peer);
+
+    e220_sim_set_channel_model(bridge, options.loss, -60, options.seed);
+    e220_sim_set_channel_model(peer.module, options.loss, -60, options.seed * 7919);
+    e220_sim_set_path_loss(bridge, options.path_loss);
+    e220_sim_set_path_loss(peer.module, options.path_loss);
+
+    // Without it the firmware finds nothing on uart1 and carries on with uart0
+    e220_sim_t *second = NULL;
+    if (options.dual) {
+        second = e220_sim_create(bridge_output, uart1);
+        e220_sim_wire(second, 7, 8, 9);
+        sim_uart_attach(uart1, second);
+
+        second_peer.module = e220_sim_create(peer_output, &second_peer);
+
+        e220_sim_set_channel_model(second, options.loss, -60, options.seed * 31);
+        e220_sim_set_channel_model(second_peer.module, options.loss, -60, options.seed * 7907);
+        e220_sim_set_path_loss(second, options.path_loss);
+        e220_sim_set_path_loss(second_peer.module, options.path_loss);
+    }
+
+    sim_boot_t boot = {0};
+    if (!start_up(&boot.cold_us)) {
+        fprintf(stderr, "radio_init() failed\n");
+        return 1;
+    }
+
+    if (!restart(&options, bridge, &boot)) {
+        fprintf(stderr, "start-up on the cached parameters failed\n");
+        return 1;
+    }
+
+    uint64_t pipeline_us = 0;
+    if (!pipeline(&pipeline_us)) {
+        fprintf(stderr, "pipelined HID commands failed\n");
+        return 1;
+    }
+
+    if (!configure(&options, 0, &peer) || (options.dual && !configure(&options, 1, &second_peer))) {
+        fprintf(stderr, "could not apply the radio settings\n");
+        return 1;
+    }
+
+    uint32_t batch_switches = 0;
+    uint64_t batch_us = 0;
+    if (!batch(&batch_switches, &batch_us)) {
+        fprintf(stderr, "batched register commands failed\n");
+        return 1;
+    }
+
+    uint8_t *pattern = malloc(options.bytes);
+    uint64_t *latency_us = malloc(sizeof(uint64_t) * (options.pings + 1));
+    for (uint32_t i = 0; i < options.bytes; ++i)
+        pattern[i] = (uint8_t) (i * 131 + (i >> 8));
+
+    sim_stream_t to_peer;
+    sim_stream_t to_host;
+    stream_to_peer(pattern, options.bytes, &to_peer);
+    stream_to_host(pattern, options.bytes, &to_host);
+    uint32_t answered = 0;
+
+    sim_stream_t dual[RADIO_CORE_MODULES] = {0};
+    if (options.dual)
+        stream_dual(pattern, options.bytes, dual);
+
+    // Framing only applies to the pings, streams stay raw
+    uint8_t request[CFG_TUD_HID_EP_BUFSIZE] = {USB_COMMAND_SET_FRAMING, USB_COMMAND_FRAMING_FRAMED};
+    uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+    if (!options.framed || (hid_command(request, response) && (!options.compress || negotiate_compression()))) {
+        request[0] = USB_COMMAND_SET_ADAPT;
+        request[1] = USB_COMMAND_ADAPT_ON;
+        if (!options.adapt || hid_command(request, response))
+            answered = ping(&options, latency_us);
+    }
+
+    request[0] = USB_COMMAND_SET_ADAPT;
+    request[1] = USB_COMMAND_ADAPT_QUERY;
+    radio_adapt_stats_t adapt_stats = {0};
+    if (hid_command(request, response))
+        memcpy(&adapt_stats, &response[2], sizeof(adapt_stats));
+
+    request[0] = USB_COMMAND_SET_COMPRESSION;
+    request[1] = USB_COMMAND_COMPRESSION_QUERY;
+    radio_frame_compress_stats_t compress_stats = {0};
+    uint8_t compress_state = 0;
+    if (hid_command(request, response)) {
+        compress_state = response[2];
+        memcpy(&compress_stats, &response[3], sizeof(compress_stats));
+    }
+
+    request[0] = USB_COMMAND_READ_RSSI;
+    request[1] = USB_COMMAND_RSSI_KEEP;
+    radio_rssi_stats_t rssi_stats = {0};
+    if (hid_command(request, response))
+        memcpy(&rssi_stats, &response[2], sizeof(rssi_stats));
+
+    static sim_targets_t targets;
+    bool targets_ok = options.targets == 0 || fixed_targets(&options, &targets);
+
+    // Raw pings, the stream data has to be through first
+    sim_duty_cycle_t duty = {0};
+    bool duty_ok = options.wor == 0 || duty_cycle(&options, &duty);
+
+    // Moves module 1 over, after everything else
+    sim_arq_t arq = {0};
+    e220_sim_t *const bridges[RADIO_CORE_MODULES] = {bridge, second};
+    bool arq_ok = !options.arq || reliable(&options, bridges, &arq);
+
+    sim_fec_t fec = {0};
+    bool fec_ok = options.fec == 0 || coded(&options, bridges, &fec);
+
+    e220_sim_stats_t stats;
+    e220_sim_get_stats(bridge, &stats);
+    uart_rx_stats_t rx_stats;
+    uart_rx_get_stats(uart0, &rx_stats);
+    radio_core_stats_t core_stats;
+    radio_core_get_stats(&core_stats);
+
+    printf("{\n");
+    printf("  \"target\": \"sim\", \"baud\": %u, \"data_rate\": %u, \"packet_len\": %u, \"loss_model\": %.4f, "
+           "\"framed\": %s,\n",
+           options.baud, options.data_rate, options.packet_len, options.loss, options.framed ? "true" : "false");
+    print_stream("host_to_peer", &to_peer);
+    print_stream("peer_to_host", &to_host);
+    if (options.dual) {
+        print_stream("dual_host_to_peer_0", &dual[0]);
+        print_stream("dual_host_to_peer_1", &dual[1]);
+    }
+    printf("  \"ping\": {\"count\": %u, \"len\": %u, \"answered\": %u, \"loss\": %.4f, "
+           "\"p50_us\": %llu, \"p99_us\": %llu, \"max_us\": %llu},\n",
+           options.pings, options.ping_len, answered,
+           options.pings ? 1.0 - (double) answered / options.pings : 0.0,
+           (unsigned long long) percentile(latency_us, answered, 50),
+           (unsigned long long) percentile(latency_us, answered, 99),
+           (unsigned long long) percentile(latency_us, answered, 100));
+    printf("  \"compression\": {\"state\": %u, \"tx_plain\": %u, \"tx_coded\": %u, \"rx_coded\": %u, "
+           "\"rx_plain\": %u, \"incompressible\": %u, \"errors\": %u},\n",
+           compress_state, compress_stats.tx_plain, compress_stats.tx_coded, compress_stats.rx_coded,
+           compress_stats.rx_plain, compress_stats.incompressible, compress_stats.errors);
+    printf("  \"rssi\": {\"packets\": %u, \"min_dbm\": %d, \"max_dbm\": %d, \"average_dbm\": %.2f},\n",
+           rssi_stats.packets, rssi_stats.min_dbm, rssi_stats.max_dbm, rssi_stats.average_dbm_16 / 16.0);
+    if (options.adapt) {
+        printf("  \"adapt\": {\"state\": %u, \"data_rate\": %u, \"tx_power\": %u, \"margin_db\": %d, "
+               "\"loss_permille\": %u, \"steps_up\": %u, \"steps_down\": %u, \"unanswered\": %u, "
+               "\"reverts\": %u},\n",
+               adapt_stats.state, adapt_stats.data_rate, adapt_stats.tx_power, adapt_stats.margin_db,
+               adapt_stats.loss_permille, adapt_stats.steps_up, adapt_stats.steps_down, adapt_stats.unanswered,
+               adapt_stats.reverts);
+    }
+    if (options.wor > 0) {
+        printf("  \"duty_cycle\": {\"latency_target_ms\": %u, \"wor_cycle\": %u, \"to_peer_us\": %llu, "
+               "\"to_host_us\": %llu, \"suspend_sleeps\": %s, \"normal_ms\": %u, \"saving_ms\": %u, "
+               "\"wake_up_ms\": %u, \"wakeups\": %u},\n",
+               options.wor, duty.stats.wor_cycle, (unsigned long long) duty.to_peer_us,
+               (unsigned long long) duty.to_host_us, duty.suspend_sleeps ? "true" : "false", duty.stats.normal_ms,
+               duty.stats.saving_ms, duty.stats.wake_up_ms, duty.stats.wakeups);
+    }
+    if (options.arq) {
+        printf("  \"arq\": {\"datagrams\": %u, \"plain_delivered\": %u, \"plain_seconds\": %.6f, "
+               "\"delivered\": %u, \"out_of_order\": %u, \"corrupted\": %u, \"seconds\": %.6f, "
+               "\"window\": %u, \"packets_sent\": %u, \"retransmits\": %u, \"timeouts\": %u, "
+               "\"given_up\": %u, \"acks_sent\": %u, \"acks_received\": %u, \"rx_duplicates\": %u, "
+               "\"rx_crc_errors\": %u, \"srtt_ms\": %u, \"rttvar_ms\": %u, \"rto_ms\": %u, "
+               "\"rtt_samples\": %u, \"deaf\": %u},\n",
+               arq.reliable.datagrams, arq.plain.delivered, (double) arq.plain.elapsed_us / 1e6,
+               arq.reliable.delivered, arq.reliable.out_of_order, arq.reliable.corrupted,
+               (double) arq.reliable.elapsed_us / 1e6, arq.sender.window, arq.sender.packets_sent,
+               arq.sender.retransmits, arq.sender.timeouts, arq.sender.given_up, arq.receiver.acks_sent,
+               arq.sender.acks_received, arq.receiver.rx_duplicates, arq.receiver.rx_crc_errors,
+               arq.sender.srtt_ms, arq.sender.rttvar_ms, arq.sender.rto_ms, arq.sender.rtt_samples, arq.deaf);
+    }
+    if (options.fec) {
+        printf("  \"fec\": {\"parity\": %u, \"ber\": %g, \"datagrams\": %u, \"plain_delivered\": %u, "
+               "\"plain_corrupted\": %u, \"plain_seconds\": %.6f, \"delivered\": %u, \"corrupted\": %u, "
+               "\"seconds\": %.6f, \"packets_coded\": %u, \"packets_decoded\": %u, \"packets_corrected\": %u, "
+               "\"bytes_corrected\": %u, \"uncorrectable\": %u, \"packets_hit\": %u},\n",
+               fec.sender.parity, options.ber, fec.coded.datagrams, fec.plain.delivered, fec.plain.corrupted,
+               (double) fec.plain.elapsed_us / 1e6, fec.coded.delivered, fec.coded.corrupted,
+               (double) fec.coded.elapsed_us / 1e6, fec.sender.packets_coded, fec.receiver.packets_decoded,
+               fec.receiver.packets_corrected, fec.receiver.bytes_corrected, fec.receiver.uncorrectable,
+               fec.corrupted);
+    }
+    if (options.targets > 0) {
+        printf("  \"targets\": {\"count\": %u, \"bulk_datagrams\": %u, \"bulk_received\": %u, "
+               "\"bulk_dropped\": %u, \"bulk_seconds\": %.6f, \"polls\": %u, \"polls_answered\": %u, "
+               "\"poll_p50_us\": %llu, \"poll_max_us\": %llu},\n",
+               options.targets, targets.bulk_datagrams, targets.bulk_received, targets.bulk_dropped,
+               (double) targets.bulk_elapsed_us / 1e6, targets.polls, targets.polls_answered,
+               (unsigned long long) percentile(targets.latency_us, targets.polls_answered, 50),
+               (unsigned long long) percentile(targets.latency_us, targets.polls_answered, 100));
+    }
+    printf("  \"module\": {\"packets_sent\": %u, \"packets_received\": %u, \"packets_lost\": %u, "
+           "\"overflows\": %u, \"garbled\": %u, \"airtime_us\": %llu},\n",
+           stats.packets_sent, stats.packets_received, stats.packets_lost, stats.overflows, stats.garbled,
+           (unsigned long long) stats.airtime_us);
+    printf("  \"hid_pipeline\": {\"commands\": %u, \"seconds\": %.6f},\n", RADIO_CORE_COMMAND_SLOTS,
+           (double) pipeline_us / 1e6);
+    printf("  \"boot\": {\"cold_us\": %llu, \"warm_us\": %llu, \"check_us\": %llu, \"check\": %u, "
+           "\"flash_writes\": %u},\n",
+           (unsigned long long) boot.cold_us, (unsigned long long) boot.warm_us,
+           (unsigned long long) boot.check_us, boot.check, sim_flash_writes);
+    printf("  \"hid_batch\": {\"commands\": 3, \"switches\": %u, \"seconds\": %.6f},\n", batch_switches,
+           (double) batch_us / 1e6);
+    printf("  \"core1\": {\"uart_tx_bytes\": %u, \"aux_low_us\": %llu, \"switches\": %u, "
+           "\"switch_max_us\": %u, \"rx_queue_high_water\": %u, \"loop\": [%u, %u, %u, %u, %u]},\n",
+           core_stats.modules[0].uart_tx_bytes, (unsigned long long) core_stats.modules[0].aux_low_us,
+           core_stats.modules[0].radio.switches, core_stats.modules[0].radio.switch_max_us,
+           core_stats.modules[0].rx_queue_high_water, core_stats.loop_histogram[0], core_stats.loop_histogram[1],
+           core_stats.loop_histogram[2], core_stats.loop_histogram[3], core_stats.loop_histogram[4]);
+    printf("  \"uart_rx\": {\"received\": %u, \"overflows\": %u, \"errors\": %u, \"high_water\": %u}\n",
+           rx_stats.received, rx_stats.overflows, rx_stats.errors, rx_stats.high_water);
+    printf("}\n");
+
+    free(latency_us);
+    free(pattern);
+
+    // Bytes out of place only mean corruption when the channel drops nothing
+    bool ok = targets_ok && duty_ok && arq_ok && fec_ok && stats.overflows == 0 &&
+              (options.loss > 0 || (to_peer.errors == 0 && to_host.errors == 0));
+    return ok ? 0 : 1;
+}
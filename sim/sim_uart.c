@@ -0,0 +1,160 @@
+#include <stddef.h>
+
+#include "e220_sim.h"
+#include "ring_buffer.h"
+#include "sim.h"
+#include "uart_rx.h"
+#include "uart_tx.h"
+
+// Simulated UART behind uart_rx.h and uart_tx.h. Bytes leave the TX queue at
+// the configured baud rate, a byte sent or received with settings differing
+// from the other end arrives garbled and is counted as a receive error.
+
+typedef struct {
+    e220_sim_t *module;
+    uint baud;
+    hal_parity_t parity;
+
+    ring_buffer_t rx_ring;
+    uart_rx_stats_t rx_stats;
+    uint8_t rx_data[UART_RX_BUFFER_SIZE];
+    bool rx_ready;
+
+    ring_buffer_t tx_ring;
+    uint64_t tx_busy_until;         ///< End of the byte in the shift register
+    uint8_t tx_data[UART_TX_BUFFER_SIZE];
+    bool tx_ready;
+} sim_uart_t;
+
+static sim_uart_t sim_uart[NUM_UARTS];
+
+uint64_t sim_byte_time_us(uint baud, hal_parity_t parity) {
+    uint bits = parity == HAL_PARITY_NONE ? 10 : 11;
+    return (bits * 1000000ull + baud - 1) / baud;
+}
+
+void sim_uart_attach(uart_inst_t *uart, e220_sim_t *module) {
+    sim_uart[uart->index].module = module;
+}
+
+void sim_uart_configure(uart_inst_t *uart, uint baud, hal_parity_t parity) {
+    sim_uart_t *port = &sim_uart[uart->index];
+
+    port->baud = baud;
+    port->parity = parity;
+}
+
+// Byte from the module RXD pin
+void sim_uart_deliver(uint index, uint8_t byte, uint baud, hal_parity_t parity) {
+    sim_uart_t *port = &sim_uart[index];
+
+    if (!port->rx_ready)
+        return;
+
+    if (baud != port->baud || parity != port->parity) {
+        port->rx_stats.errors++;
+        return;
+    }
+
+    if (!ring_buffer_put(&port->rx_ring, byte)) {
+        port->rx_stats.overflows++;
+        return;
+    }
+
+    port->rx_stats.received++;
+
+    uint32_t count = ring_buffer_count(&port->rx_ring);
+    if (count > port->rx_stats.high_water)
+        port->rx_stats.high_water = count;
+}
+
+void sim_uart_tick(void) {
+    for (uint i = 0; i < NUM_UARTS; ++i) {
+        sim_uart_t *port = &sim_uart[i];
+        uint8_t byte;
+
+        if (!port->tx_ready || port->baud == 0)
+            continue;
+
+        while (port->tx_busy_until <= sim_now_us && ring_buffer_get(&port->tx_ring, &byte)) {
+            uint64_t start = port->tx_busy_until > sim_now_us - SIM_TICK_US ? port->tx_busy_until : sim_now_us;
+            port->tx_busy_until = start + sim_byte_time_us(port->baud, port->parity);
+
+            if (port->module)
+                e220_sim_input(port->module, byte, port->baud, port->parity);
+        }
+    }
+}
+
+//--------------------------------------------------------------------+
+// uart_rx.h
+//--------------------------------------------------------------------+
+
+void uart_rx_init(uart_inst_t *uart) {
+    sim_uart_t *port = &sim_uart[uart->index];
+
+    if (port->rx_ready)
+        return;
+
+    ring_buffer_init(&port->rx_ring, port->rx_data, UART_RX_BUFFER_SIZE);
+    port->rx_ready = true;
+}
+
+uint32_t uart_rx_available(uart_inst_t *uart) {
+    return ring_buffer_count(&sim_uart[uart->index].rx_ring);
+}
+
+uint32_t uart_rx_peek(uart_inst_t *uart, uint8_t const **data) {
+    return ring_buffer_peek(&sim_uart[uart->index].rx_ring, data);
+}
+
+void uart_rx_consume(uart_inst_t *uart, uint32_t len) {
+    ring_buffer_consume(&sim_uart[uart->index].rx_ring, len);
+}
+
+uint32_t uart_rx_read(uart_inst_t *uart, uint8_t *dst, uint32_t len) {
+    return ring_buffer_read(&sim_uart[uart->index].rx_ring, dst, len);
+}
+
+void uart_rx_get_stats(uart_inst_t *uart, uart_rx_stats_t *stats) {
+    *stats = sim_uart[uart->index].rx_stats;
+}
+
+//--------------------------------------------------------------------+
+// uart_tx.h
+//--------------------------------------------------------------------+
+
+void uart_tx_init(uart_inst_t *uart) {
+    sim_uart_t *port = &sim_uart[uart->index];
+
+    if (port->tx_ready)
+        return;
+
+    ring_buffer_init(&port->tx_ring, port->tx_data, UART_TX_BUFFER_SIZE);
+    port->tx_ready = true;
+}
+
+uint32_t uart_tx_write(uart_inst_t *uart, uint8_t const *src, uint32_t len) {
+    return ring_buffer_write(&sim_uart[uart->index].tx_ring, src, len);
+}
+
+uint32_t uart_tx_space(uart_inst_t *uart) {
+    return ring_buffer_space(&sim_uart[uart->index].tx_ring);
+}
+
+uint32_t uart_tx_pending(uart_inst_t *uart) {
+    return ring_buffer_count(&sim_uart[uart->index].tx_ring);
+}
+
+bool uart_tx_idle(uart_inst_t *uart) {
+    sim_uart_t *port = &sim_uart[uart->index];
+    return ring_buffer_empty(&port->tx_ring) && port->tx_busy_until <= sim_now_us;
+}
+
+void uart_tx_flush_blocking(uart_inst_t *uart) {
+    if (!sim_uart[uart->index].tx_ready)
+        return;
+
+    while (!uart_tx_idle(uart))
+        sim_step();
+}
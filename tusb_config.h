@@ -7,13 +7,24 @@
 // DEVICE CONFIGURATION
 //--------------------------------------------------------------------
 
-#define CFG_TUD_CDC 1
+#define CFG_TUD_CDC 2      // One for each module
 #define CFG_TUD_HID 1
 
+// Bulk streaming for libusb hosts, see usb_vendor.h
+#ifdef LORA_BRIDGE_VENDOR
+#define CFG_TUD_VENDOR 1
+#else
+#define CFG_TUD_VENDOR 0
+#endif
+
 #define CFG_TUD_CDC_RX_BUFSIZE 64
-#define CFG_TUD_CDC_TX_BUFSIZE 64
+#define CFG_TUD_CDC_TX_BUFSIZE 1024   // Holds a whole framed datagram
 
 #define CFG_TUD_HID_EP_BUFSIZE 64
 #define CFG_TUD_CDC_EP_BUFSIZE 64
 
+#define CFG_TUD_VENDOR_EPSIZE 64
+#define CFG_TUD_VENDOR_RX_BUFSIZE 1024
+#define CFG_TUD_VENDOR_TX_BUFSIZE 2048  // A full DATA message and a response
+
 #endif /* _TUSB_CONFIG_H_ */
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include <hardware/irq.h>
+
+#include "ring_buffer.h"
+#include "uart_rx.h"
+
+typedef struct {
+    uart_inst_t *uart;
+    ring_buffer_t ring;
+    uart_rx_stats_t stats;
+    uint8_t data[UART_RX_BUFFER_SIZE];
+} uart_rx_t;
+
+static uart_rx_t uart_rx[NUM_UARTS];
+
+// In RAM with the inline ring helpers, it keeps running while core1 is parked
+// for a flash write
+static void __not_in_flash_func(uart_rx_irq)(uart_rx_t *rx) {
+    uart_hw_t *hw = uart_get_hw(rx->uart);
+
+    // Drain the hardware FIFO, this also clears the RX and RX timeout interrupts
+    while (!(hw->fr & UART_UARTFR_RXFE_BITS)) {
+        uint32_t dr = hw->dr;
+
+        if (dr & UART_UARTDR_OE_BITS)
+            rx->stats.overruns++;
+
+        if (dr & (UART_UARTDR_BE_BITS | UART_UARTDR_PE_BITS | UART_UARTDR_FE_BITS)) {
+            rx->stats.errors++;
+            continue;
+        }
+
+        if (!ring_buffer_put(&rx->ring, (uint8_t) dr)) {
+            rx->stats.overflows++;
+            continue;
+        }
+
+        rx->stats.received++;
+    }
+
+    uint32_t count = ring_buffer_count(&rx->ring);
+    if (count > rx->stats.high_water)
+        rx->stats.high_water = count;
+}
+
+static void __not_in_flash_func(uart0_rx_irq)(void) {
+    uart_rx_irq(&uart_rx[0]);
+}
+
+static void __not_in_flash_func(uart1_rx_irq)(void) {
+    uart_rx_irq(&uart_rx[1]);
+}
+
+// Safe to call again after uart_init(), which resets the interrupt mask
+void uart_rx_init(uart_inst_t *uart) {
+    uint index = uart_get_index(uart);
+    uart_rx_t *rx = &uart_rx[index];
+
+    if (rx->uart == NULL) {
+        rx->uart = uart;
+        ring_buffer_init(&rx->ring, rx->data, UART_RX_BUFFER_SIZE);
+
+        uint irq = index == 0 ? UART0_IRQ : UART1_IRQ;
+        irq_set_exclusive_handler(irq, index == 0 ? uart0_rx_irq : uart1_rx_irq);
+        irq_set_enabled(irq, true);
+    }
+
+    // RX FIFO level and RX timeout interrupts
+    uart_set_irq_enables(uart, true, false);
+}
+
+uint32_t uart_rx_available(uart_inst_t *uart) {
+    return ring_buffer_count(&uart_rx[uart_get_index(uart)].ring);
+}
+
+uint32_t uart_rx_peek(uart_inst_t *uart, uint8_t const **data) {
+    return ring_buffer_peek(&uart_rx[uart_get_index(uart)].ring, data);
+}
+
+void uart_rx_consume(uart_inst_t *uart, uint32_t len) {
+    ring_buffer_consume(&uart_rx[uart_get_index(uart)].ring, len);
+}
+
+uint32_t uart_rx_read(uart_inst_t *uart, uint8_t *dst, uint32_t len) {
+    return ring_buffer_read(&uart_rx[uart_get_index(uart)].ring, dst, len);
+}
+
+void uart_rx_get_stats(uart_inst_t *uart, uart_rx_stats_t *stats) {
+    *stats = uart_rx[uart_get_index(uart)].stats;
+}
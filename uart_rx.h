@@ -0,0 +1,30 @@
+#ifndef _LORA_BRIDGE_UART_RX_H_
+#define _LORA_BRIDGE_UART_RX_H_
+
+#include "hal.h"
+
+// Must be a power of two
+#define UART_RX_BUFFER_SIZE 1024
+
+/// Receive counters, updated from the UART interrupt
+typedef struct {
+    uint32_t received;      ///< Bytes stored in the ring
+    uint32_t overflows;     ///< Bytes dropped because the ring was full
+    uint32_t overruns;      ///< Hardware FIFO overruns (bytes lost before the interrupt ran)
+    uint32_t errors;        ///< Bytes received with framing, parity or break errors
+    uint32_t high_water;    ///< Maximum ring occupancy seen
+} uart_rx_stats_t;
+
+void uart_rx_init(uart_inst_t *uart);
+
+uint32_t uart_rx_available(uart_inst_t *uart);
+
+uint32_t uart_rx_peek(uart_inst_t *uart, uint8_t const **data);
+
+void uart_rx_consume(uart_inst_t *uart, uint32_t len);
+
+uint32_t uart_rx_read(uart_inst_t *uart, uint8_t *dst, uint32_t len);
+
+void uart_rx_get_stats(uart_inst_t *uart, uart_rx_stats_t *stats);
+
+#endif //_LORA_BRIDGE_UART_RX_H_
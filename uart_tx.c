@@ -0,0 +1,107 @@
+#include <hardware/dma.h>
+#include <hardware/irq.h>
+#include <hardware/sync.h>
+
+#include "ring_buffer.h"
+#include "uart_tx.h"
+
+typedef struct {
+    uart_inst_t *uart;
+    ring_buffer_t ring;
+    int channel;
+    volatile uint32_t in_flight;    ///< Length of the span being transferred, 0 if idle
+    uint8_t data[UART_TX_BUFFER_SIZE];
+} uart_tx_t;
+
+static uart_tx_t uart_tx[NUM_UARTS];
+static bool irq_handler_added;  ///< One handler serves the channels of both UARTs
+
+// Must be called with interrupts disabled or from the DMA interrupt
+static void uart_tx_start(uart_tx_t *tx) {
+    uint8_t const *data;
+
+    if (tx->in_flight)
+        return;
+
+    tx->in_flight = ring_buffer_peek(&tx->ring, &data);
+    if (tx->in_flight)
+        dma_channel_transfer_from_buffer_now(tx->channel, data, tx->in_flight);
+}
+
+static void uart_tx_dma_irq(void) {
+    for (uint i = 0; i < NUM_UARTS; ++i) {
+        uart_tx_t *tx = &uart_tx[i];
+
+        if (tx->uart == NULL || !dma_channel_get_irq0_status(tx->channel))
+            continue;
+
+        dma_channel_acknowledge_irq0(tx->channel);
+
+        ring_buffer_consume(&tx->ring, tx->in_flight);
+        tx->in_flight = 0;
+        uart_tx_start(tx);
+    }
+}
+
+void uart_tx_init(uart_inst_t *uart) {
+    uart_tx_t *tx = &uart_tx[uart_get_index(uart)];
+
+    if (tx->uart != NULL)
+        return;
+
+    ring_buffer_init(&tx->ring, tx->data, UART_TX_BUFFER_SIZE);
+    tx->channel = dma_claim_unused_channel(true);
+
+    dma_channel_config config = dma_channel_get_default_config(tx->channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_dreq(&config, uart_get_dreq(uart, true));
+    dma_channel_configure(tx->channel, &config, &uart_get_hw(uart)->dr, NULL, 0, false);
+
+    dma_channel_set_irq0_enabled(tx->channel, true);
+    if (!irq_handler_added) {
+        irq_add_shared_handler(DMA_IRQ_0, uart_tx_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_0, true);
+        irq_handler_added = true;
+    }
+
+    tx->uart = uart;
+}
+
+// Queues as much as fits and returns at once, the DMA clocks it out
+uint32_t uart_tx_write(uart_inst_t *uart, uint8_t const *src, uint32_t len) {
+    uart_tx_t *tx = &uart_tx[uart_get_index(uart)];
+    uint32_t written = ring_buffer_write(&tx->ring, src, len);
+
+    uint32_t status = save_and_disable_interrupts();
+    uart_tx_start(tx);
+    restore_interrupts(status);
+
+    return written;
+}
+
+uint32_t uart_tx_space(uart_inst_t *uart) {
+    return ring_buffer_space(&uart_tx[uart_get_index(uart)].ring);
+}
+
+// Bytes queued or being transferred, not counting the UART hardware FIFO
+uint32_t uart_tx_pending(uart_inst_t *uart) {
+    return ring_buffer_count(&uart_tx[uart_get_index(uart)].ring);
+}
+
+// True once the queue is empty and the last byte has left the UART
+bool uart_tx_idle(uart_inst_t *uart) {
+    return uart_tx_pending(uart) == 0 && !(uart_get_hw(uart)->fr & UART_UARTFR_BUSY_BITS);
+}
+
+// Waits until every queued byte has left the UART
+void uart_tx_flush_blocking(uart_inst_t *uart) {
+    if (uart_tx[uart_get_index(uart)].uart == NULL)
+        return;
+
+    while (uart_tx_pending(uart) > 0)
+        tight_loop_contents();
+
+    uart_tx_wait_blocking(uart);
+}
@@ -0,0 +1,21 @@
+#ifndef _LORA_BRIDGE_UART_TX_H_
+#define _LORA_BRIDGE_UART_TX_H_
+
+#include "hal.h"
+
+// Must be a power of two
+#define UART_TX_BUFFER_SIZE 1024
+
+void uart_tx_init(uart_inst_t *uart);
+
+uint32_t uart_tx_write(uart_inst_t *uart, uint8_t const *src, uint32_t len);
+
+uint32_t uart_tx_space(uart_inst_t *uart);
+
+uint32_t uart_tx_pending(uart_inst_t *uart);
+
+bool uart_tx_idle(uart_inst_t *uart);
+
+void uart_tx_flush_blocking(uart_inst_t *uart);
+
+#endif //_LORA_BRIDGE_UART_TX_H_
@@ -1,5 +1,31 @@
 #include <memory.h>
+#include "tusb_config.h"
 #include "usb_command.h"
+#include "uart_rx.h"
+#include "radio_adapt.h"
+#include "radio_arq.h"
+#include "radio_fec.h"
+#include "radio_core.h"
+#include "radio_dest.h"
+#include "radio_frame.h"
+#include "radio_power.h"
+#include "radio_rssi.h"
+#include "radio_sched.h"
+
+// Response of the radio operation in progress, sent on completion
+static uint8_t pending_response[CFG_TUD_HID_EP_BUFSIZE];
+
+static void params_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    (void) radio;
+    (void) user_data;
+
+    memset(&pending_response[1], 0, sizeof(pending_response) - 1);
+    pending_response[1] = success ? USB_COMMAND_SUCCESS : USB_COMMAND_FAILED;
+    if (params)
+        memcpy(&pending_response[2], params, sizeof(parameters_t));
+
+    usb_command_complete_cb(pending_response);
+}
 
 // Command structure:
 // +---------+---------------------+-------------+-------------------------------------------+
@@ -7,7 +33,14 @@
 // +---------+---------------------+-------------+-------------------------------------------+
 // | 0       | -                   | 0xB0        | Read radio parameters                     |
 // +---------+---------------------+-------------+-------------------------------------------+
-// | 1-63    | Don't care          | Any Value   | -                                         |
+// | 1       | Where to read from  | 0x00        | Snapshot kept in RAM, if any              |
+// |         |                     | 0x01        | Read back from the module                 |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
 // +---------+---------------------+-------------+-------------------------------------------+
 //
 // Command response:
@@ -18,6 +51,7 @@
 // +---------+---------------------+-------------+-------------------------------------------+
 // | 1       | -                   | 0x00        | Command completed successfully            |
 // |         |                     | 0x01        | Command not completed successfully        |
+// |         |                     | 0x02        | Radio busy, retry later                   |
 // +---------+---------------------+-------------+-------------------------------------------+
 // | 2       | High address byte   | -           | -                                         |
 // +---------+---------------------+-------------+-------------------------------------------+
@@ -37,21 +71,20 @@
 // | 8-63    | Don't care          | Any Value   | -                                         |
 // +---------+---------------------+-------------+-------------------------------------------+
 bool usb_command_read_params(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
-    (void) bufsize;
-    (void) buffer;
+    bool refresh = bufsize >= 2 && buffer[1] == USB_COMMAND_READ_REFRESH;
 
-    parameters_t *params = (parameters_t *) &response[2];
-
-    set_radio_uart_config_mode(radio);
-    if (!read_parameters(radio, params)) {
-        response[1] = USB_COMMAND_FAILED;
+    // Served from RAM, the snapshot follows every successful read and write
+    if (!refresh && get_parameters(radio, (parameters_t *) &response[2])) {
+        response[1] = USB_COMMAND_SUCCESS;
         return false;
     }
 
-    response[1] = USB_COMMAND_SUCCESS;
+    if (!read_parameters_async(radio, params_done, NULL)) {
+        response[1] = USB_COMMAND_BUSY;
+        return false;
+    }
 
-    // Adjust UART
-    set_radio_uart(radio, params->sped);
+    pending_response[0] = USB_COMMAND_READ_PARAMS;
     return true;
 }
 
@@ -79,7 +112,11 @@ bool usb_command_read_params(radio_inst_t const *radio, uint8_t *response, uint8
 // | 7       | Various control     | -           | -                                         |
 // |         | options             |             |                                           |
 // +---------+---------------------+-------------+-------------------------------------------+
-// | 8-63    | Don't care          | Any Value   | -                                         |
+// | 8-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
 // +---------+---------------------+-------------+-------------------------------------------+
 //
 // Command response:
@@ -90,6 +127,7 @@ bool usb_command_read_params(radio_inst_t const *radio, uint8_t *response, uint8
 // +---------+---------------------+-------------+-------------------------------------------+
 // | 1       | -                   | 0x00        | Command completed successfully            |
 // |         |                     | 0x01        | Command not completed successfully        |
+// |         |                     | 0x02        | Radio busy, retry later                   |
 // +---------+---------------------+-------------+-------------------------------------------+
 // | 2       | High address byte   | -           | -                                         |
 // +---------+---------------------+-------------+-------------------------------------------+
@@ -115,19 +153,964 @@ bool usb_command_write_params(radio_inst_t const *radio, uint8_t *response, uint
         return false;
     }
 
-    parameters_t const *params = (parameters_t const *) &buffer[2];
+    parameters_t params;
+    memcpy(&params, &buffer[2], sizeof(parameters_t));
     bool save = buffer[1];
 
-    set_radio_uart_config_mode(radio);
-    if (!write_parameters(radio, params, save)) {
-        response[1] = USB_COMMAND_FAILED;
+    if (!write_parameters_async(radio, &params, save, params_done, NULL)) {
+        response[1] = USB_COMMAND_BUSY;
         return false;
     }
 
+    pending_response[0] = USB_COMMAND_WRITE_PARAMS;
+    return true;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB2        | Read UART receive counters                |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB2        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-5     | Received bytes      | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Ring overflows      | -           | Bytes dropped, ring buffer full           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | FIFO overruns       | -           | Bytes lost in the hardware FIFO           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Receive errors      | -           | Framing, parity and break errors          |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-21   | Ring high water     | -           | Maximum ring occupancy in bytes           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 22-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+bool usb_command_read_uart_stats(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    (void) bufsize;
+    (void) buffer;
+
+    uart_rx_stats_t stats;
+    uart_rx_get_stats(radio->uart, &stats);
+
     response[1] = USB_COMMAND_SUCCESS;
-    memcpy(&response[2], params, sizeof(parameters_t));
+    memcpy(&response[2], &stats, sizeof(stats));
+    return true;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB4        | Read air time budget                      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (values are little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB4        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-5     | Packet air time     | -           | Full packet time on air in us             |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Packet length       | -           | Configured packet length in bytes         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | Full packets        | -           | Packets released to the module            |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Partial packets     | -           | Short packets released on host idle       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-25   | Total air time      | -           | Air time of released packets in us        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 26-29   | Backlog             | -           | Air time released, not on air yet, in us  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 30-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+bool usb_command_read_airtime(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    (void) bufsize;
+    (void) buffer;
+
+    radio_sched_stats_t stats;
+    radio_sched_get_stats(radio, &stats);
+
+    response[1] = USB_COMMAND_SUCCESS;
+    memcpy(&response[2], &stats, sizeof(stats));
+    return true;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB5        | Set CDC framing                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Framing             | 0x00        | Raw byte stream                           |
+// |         |                     | 0x01        | Length prefixed datagrams                 |
+// |         |                     | 0x02        | Datagrams led by their fixed target       |
+// |         |                     | 0xFF        | Leave unchanged, read counters only       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB5        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | Framing             | -           | Active framing                            |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3-6     | Datagrams sent      | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 7-10    | Datagrams received  | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 11-14   | Fragments sent      | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 15-18   | Fragments received  | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 19-22   | Oversized           | -           | Host datagrams dropped, too long          |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 23-26   | Incomplete          | -           | Datagrams dropped, fragment missing       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 27-30   | Resync bytes        | -           | Bytes skipped looking for a header        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 31-34   | Lost                | -           | Datagrams never seen, from the sequence   |
+// |         |                     |             | numbers                                   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 35-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Framed mode: the host writes each datagram as a 16-bit little endian length
+// followed by up to 1000 bytes of payload, and reads received datagrams in the
+// same format, one datagram per USB transfer. Both bridges must be framed.
+//
+// Addressed mode: host datagrams start with the ADDH, ADDL and CHAN of their
+// target, counted in the length, and the module must be set to fixed
+// transmission. Each target has its own queue and the queues take turns, see
+// USB_COMMAND_READ_DESTINATION. Received datagrams come without an address.
+bool usb_command_set_framing(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    bool success = bufsize >= 2 && buffer[1] <= USB_COMMAND_FRAMING_ADDRESSED;
+
+    if (success && buffer[1] == USB_COMMAND_FRAMING_ADDRESSED)
+        radio_frame_set_addressed(radio, true);
+    else if (success)
+        radio_frame_set_enabled(radio, buffer[1] == USB_COMMAND_FRAMING_FRAMED);
+
+    radio_frame_stats_t stats;
+    radio_frame_get_stats(radio, &stats);
+
+    response[1] = success || (bufsize >= 2 && buffer[1] == USB_COMMAND_FRAMING_QUERY) ? USB_COMMAND_SUCCESS
+                                                                                     : USB_COMMAND_FAILED;
+    response[2] = radio_frame_addressed(radio) ? USB_COMMAND_FRAMING_ADDRESSED
+                  : radio_frame_enabled(radio) ? USB_COMMAND_FRAMING_FRAMED
+                  : USB_COMMAND_FRAMING_RAW;
+    memcpy(&response[3], &stats, sizeof(stats));
+    return success;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB6        | Set datagram compression                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Compression         | 0x00        | Send datagrams as they are                |
+// |         |                     | 0x01        | Compress once the peer confirms it can    |
+// |         |                     | 0xFF        | Leave unchanged, read counters only       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB6        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | State               | 0x00        | Off                                       |
+// |         |                     | 0x01        | Waiting for the peer to answer            |
+// |         |                     | 0x02        | Active                                    |
+// |         |                     | 0x03        | The peer does not support it              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3-6     | TX plain bytes      | -           | Datagram bytes from the host              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 7-10    | TX coded bytes      | -           | The same datagrams as sent over the air   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 11-14   | RX coded bytes      | -           | Datagram bytes received over the air      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 15-18   | RX plain bytes      | -           | The same datagrams as handed to the host  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 19-22   | Incompressible      | -           | Datagrams sent as is                      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 23-26   | Errors              | -           | Received datagrams failing to decompress  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 27-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Compression applies to framed mode only. Each datagram is compressed on its
+// own, so a lost datagram does not affect the following ones.
+bool usb_command_set_compression(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer,
+                                 uint32_t bufsize) {
+    bool success = bufsize >= 2 && buffer[1] <= USB_COMMAND_COMPRESSION_ON;
 
-    // Adjust UART
-    set_radio_uart(radio, params->sped);
+    if (success)
+        radio_frame_set_compression(radio, buffer[1] == USB_COMMAND_COMPRESSION_ON);
+
+    radio_frame_compress_stats_t stats;
+    radio_frame_get_compress_stats(radio, &stats);
+
+    response[1] = success || (bufsize >= 2 && buffer[1] == USB_COMMAND_COMPRESSION_QUERY) ? USB_COMMAND_SUCCESS
+                                                                                         : USB_COMMAND_FAILED;
+    response[2] = radio_frame_compression(radio);
+    memcpy(&response[3], &stats, sizeof(stats));
+    return success;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB7        | Read addressed mode destination queue     |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Queue               | 0x00-0x07   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB7        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | In use              | 0x00        | Queue free, the rest is meaningless       |
+// |         |                     | 0x01        | Queue assigned to the target below        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3-5     | Target              | -           | ADDH, ADDL and CHAN                       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Queued bytes        | -           | Waiting, length prefixes included         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | Datagrams sent      | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Bytes sent          | -           | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-21   | Dropped             | -           | Queue full while other targets waited     |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 22-25   | Unroutable          | -           | Dropped by any queue, all 8 were busy     |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 26-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+bool usb_command_read_destination(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer,
+                                  uint32_t bufsize) {
+    radio_dest_stats_t stats;
+    bool success = bufsize >= 2 && radio_dest_get_stats(radio, buffer[1], &stats);
+
+    response[1] = success ? USB_COMMAND_SUCCESS : USB_COMMAND_FAILED;
+    if (!success)
+        return false;
+
+    uint32_t unroutable = radio_dest_unroutable(radio);
+    memcpy(&response[2], &stats, sizeof(stats));
+    memcpy(&response[2 + sizeof(stats)], &unroutable, sizeof(unroutable));
     return true;
-}
\ No newline at end of file
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB8        | Read received signal strength             |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Reset               | 0x00        | Keep counting                             |
+// |         |                     | 0x01        | Start over once read                      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB8        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-5     | Packets             | -           | Packets received with an RSSI byte        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6       | Minimum             | -           | Signed, dBm                               |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 7       | Maximum             | -           | Signed, dBm                               |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 8-9     | Average             | -           | Signed, 1/16 dBm, recent packets weigh    |
+// |         |                     |             | the most                                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-41   | Histogram           | -           | 16 bins of 16 bits, 8 dB wide from        |
+// |         |                     |             | -128 dBm, the last one open ended         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 42-45   | Sum                 | -           | Signed, dBm of all the packets            |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 46-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Requires the RSSI byte to be enabled in OPT2, the module cannot tell who sent
+// a packet so the numbers cover everything this module receives.
+bool usb_command_read_rssi(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    radio_rssi_stats_t stats;
+    radio_rssi_get_stats(radio, &stats);
+
+    if (bufsize >= 2 && buffer[1] == USB_COMMAND_RSSI_RESET)
+        radio_rssi_reset_stats(radio);
+
+    response[1] = USB_COMMAND_SUCCESS;
+    memcpy(&response[2], &stats, sizeof(stats));
+    return true;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB9        | Set adaptive data rate and TX power       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Adapt               | 0x00        | Keep the settings as they are             |
+// |         |                     | 0x01        | Adjust them to the link                   |
+// |         |                     | 0xFF        | Leave unchanged, read counters only       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB9        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | State               | 0x00        | Off                                       |
+// |         |                     | 0x01        | Watching the link                         |
+// |         |                     | 0x02        | Waiting for the peer to accept a change   |
+// |         |                     | 0x03        | Writing the new settings to the module    |
+// |         |                     | 0x04        | Waiting to hear the peer after a change   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3       | Air data rate       | 0x02-0x07   | As in SPED, 2.4k to 62.5k                 |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 4       | TX power            | 0x00-0x03   | As in OPT1, 22 dBm to 10 dBm              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 5       | Margin              | -           | Signed, dB over the sensitivity, last     |
+// |         |                     |             | window                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Loss                | -           | Per mille of the datagrams, last window   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | Steps up            | -           | Faster rate or lower power                |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Steps down          | -           | Slower rate or higher power               |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-21   | Unanswered          | -           | Changes the peer never accepted           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 22-25   | Reverts             | -           | Changes undone, the ends lost each other  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 26-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Requires framed mode and the RSSI byte enabled in OPT2, on both bridges. The
+// bridge it is enabled on decides, the other one follows its requests. Changes
+// are not saved, a power cycle brings back the saved settings.
+bool usb_command_set_adapt(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    bool success = bufsize >= 2 && buffer[1] <= USB_COMMAND_ADAPT_ON;
+
+    if (success)
+        success = radio_adapt_set_enabled(radio, buffer[1] == USB_COMMAND_ADAPT_ON);
+
+    radio_adapt_stats_t stats;
+    radio_adapt_get_stats(radio, &stats);
+
+    response[1] = success || (bufsize >= 2 && buffer[1] == USB_COMMAND_ADAPT_QUERY) ? USB_COMMAND_SUCCESS
+                                                                                   : USB_COMMAND_FAILED;
+    memcpy(&response[2], &stats, sizeof(stats));
+    return success;
+}
+
+// Register commands of the batch in progress
+static radio_register_op_t batch_ops[USB_COMMAND_BATCH_MAX];
+static uint32_t batch_count;
+
+static void batch_done(radio_inst_t const *radio, bool success, parameters_t const *params, void *user_data) {
+    (void) radio;
+    (void) params;
+    (void) user_data;
+
+    memset(&pending_response[1], 0, sizeof(pending_response) - 1);
+    pending_response[1] = success ? USB_COMMAND_SUCCESS : USB_COMMAND_FAILED;
+
+    // What the module reported for each command it applied, in request order
+    uint32_t index = 3;
+    uint32_t done = 0;
+    while (done < batch_count && batch_ops[done].done) {
+        radio_register_op_t const *op = &batch_ops[done++];
+
+        pending_response[index++] = op->address;
+        pending_response[index++] = op->len;
+        memcpy(&pending_response[index], op->data, op->len);
+        index += op->len;
+    }
+
+    pending_response[2] = done;
+    usb_command_complete_cb(pending_response);
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBA        | Run register commands in one sleep window |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Number of commands  | 0x01-0x08   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Commands            | -           | Back to back, see below                   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Each command:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Offset  | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | Kind                | 0x00        | Read registers                            |
+// |         |                     | 0x01        | Write registers, temporary                |
+// |         |                     | 0x02        | Write registers, permanent                |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | First register      | 0x00-0x07   | ADDH, ADDL, SPED, OPT1, CHAN, OPT2,       |
+// |         |                     |             | CRYPT_H, CRYPT_L                          |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | Register count      | 0x01-0x08   | Up to the last register                   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3-      | Values              | -           | Writes only, one byte per register        |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBA        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// |         |                     | 0x02        | Radio busy, retry later                   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | Commands applied    | -           | The batch stops at the first rejected one |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3-61    | Results             | -           | First register, register count and the    |
+// |         |                     |             | values the module reported, per command   |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// The module enters MODE_SLEEP once for the whole batch, instead of once per
+// command. A request whose results would not fit in the response fails
+// without touching the module.
+bool usb_command_batch(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    uint32_t count = bufsize >= 2 ? buffer[1] : 0;
+    uint32_t end = bufsize < USB_COMMAND_MODULE_INDEX ? bufsize : USB_COMMAND_MODULE_INDEX;
+    uint32_t index = 2;
+    uint32_t results = 3;
+
+    // The previous batch may still own batch_ops
+    if (radio_is_busy(radio)) {
+        response[1] = USB_COMMAND_BUSY;
+        return false;
+    }
+
+    response[1] = USB_COMMAND_FAILED;
+    if (count == 0 || count > USB_COMMAND_BATCH_MAX)
+        return false;
+
+    // Parse the whole request before the radio is touched
+    for (uint32_t i = 0; i < count; i++) {
+        if (index + 3 > end)
+            return false;
+
+        uint8_t kind = buffer[index];
+        radio_register_op_t *op = &batch_ops[i];
+        op->address = buffer[index + 1];
+        op->len = buffer[index + 2];
+        index += 3;
+
+        if (kind > USB_COMMAND_BATCH_SAVE || op->len == 0 || op->address + op->len > RADIO_REGISTERS)
+            return false;
+
+        results += 2 + op->len;
+        if (results > USB_COMMAND_MODULE_INDEX)
+            return false;
+
+        if (kind == USB_COMMAND_BATCH_READ) {
+            op->command = RADIO_COMMAND_READ_PARAMS;
+            continue;
+        }
+
+        if (index + op->len > end)
+            return false;
+
+        op->command = kind == USB_COMMAND_BATCH_SAVE ? RADIO_COMMAND_WRITE_PARAMS_SAVE
+                                                     : RADIO_COMMAND_WRITE_PARAMS_NOSAVE;
+        memcpy(op->data, &buffer[index], op->len);
+        index += op->len;
+    }
+
+    batch_count = count;
+
+    if (!radio_batch_async(radio, batch_ops, batch_count, batch_done, NULL)) {
+        response[1] = USB_COMMAND_BUSY;
+        return false;
+    }
+
+    pending_response[0] = USB_COMMAND_BATCH;
+    return true;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBB        | Set duty cycling                          |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Power saving        | 0x00        | Keep the module awake                     |
+// |         |                     | 0x01        | Sleep in WOR receive when traffic is idle |
+// |         |                     | 0xFF        | Leave unchanged, read counters only       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-3     | Latency target      | 500-65535   | Milliseconds, 16-bit little endian, picks |
+// |         |                     |             | the longest WOR cycle not above it        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 4       | Peer                | 0x00        | Always awake                              |
+// |         |                     | 0x01        | Duty-cycled, send with wake-up preamble   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 5-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (times and counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBB        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | State               | 0x00        | Neither end duty-cycles                   |
+// |         |                     | 0x01        | Awake                                     |
+// |         |                     | 0x02        | Sleeping in WOR receive                   |
+// |         |                     | 0x03        | Sending with the wake-up preamble         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3       | WOR cycle           | 0x00-0x07   | As in OPT2, 500 ms to 4000 ms             |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 4-5     | Latency target      | -           | Milliseconds, 16-bit little endian        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Awake               | -           | Milliseconds in MODE_NORMAL               |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | Sleeping            | -           | Milliseconds in MODE_POWER_SAVING         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Waking the peer     | -           | Milliseconds in MODE_WAKE_UP              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-21   | Wake-ups            | -           | Times data ended a sleep                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 22-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Both bridges need the same latency target. Times in each mode and the UART
+// byte counters of GET_REPORT give the energy per delivered byte with the
+// supply currents of the module. The WOR cycle is not saved, a power cycle
+// brings back the saved one.
+bool usb_command_set_power(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    bool success = bufsize >= 5 && buffer[1] <= USB_COMMAND_POWER_ON && buffer[4] <= 0x01;
+
+    if (success)
+        success = radio_power_set(radio, buffer[1] == USB_COMMAND_POWER_ON, buffer[2] | buffer[3] << 8,
+                                  buffer[4] == 0x01);
+
+    radio_power_stats_t stats;
+    radio_power_get_stats(radio, &stats);
+
+    response[1] = success || (bufsize >= 2 && buffer[1] == USB_COMMAND_POWER_QUERY) ? USB_COMMAND_SUCCESS
+                                                                                   : USB_COMMAND_FAILED;
+    memcpy(&response[2], &stats, sizeof(stats));
+    return success;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBC        | Set reliable mode                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Reliable mode       | 0x00        | Send fragments unacknowledged             |
+// |         |                     | 0x01        | Number, check and retransmit fragments    |
+// |         |                     | 0xFF        | Leave unchanged, read counters only       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian, times 16-bit):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBC        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | State               | 0x00        | Off                                       |
+// |         |                     | 0x01        | Waiting for the peer to sync              |
+// |         |                     | 0x02        | Active                                    |
+// |         |                     | 0x03        | The peer never answered, sending plain    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3       | Window              | 2-16        | Packets in flight at most, from the       |
+// |         |                     |             | packet length and the air data rate       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 4       | In flight           | -           | Packets sent, not acknowledged yet        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 5       | Held                | -           | Packets received after a gap              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Packets sent        | -           | Retransmissions excluded                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | Retransmits         | -           |                                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Timeouts            | -           | Polls left unanswered                     |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-21   | Given up            | -           | Packets dropped after 8 retransmissions   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 22-25   | Acks sent           | -           |                                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 26-29   | Acks received       | -           |                                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 30-33   | Packets received    | -           | Good CRC, duplicates included             |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 34-37   | Duplicates          | -           | Received twice, an ack went missing       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 38-41   | CRC errors          | -           | Received packets dropped                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 42-45   | Skipped             | -           | Never received, the sender gave up        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 46-47   | RTT                 | -           | Milliseconds, last poll to its ack        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 48-49   | Smoothed RTT        | -           | Milliseconds                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 50-51   | RTT variation       | -           | Milliseconds, of the ack turnaround       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 52-53   | Retransmit timeout  | -           | Milliseconds past the poll on air         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 54-57   | RTT samples         | -           |                                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 58-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Requires framed mode without targets. The peer must run framed mode as well
+// and answers on its own, reliable mode only needs enabling on the sending
+// end. Each fragment then loses 4 bytes to the sequence number and CRC.
+bool usb_command_set_arq(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    bool success = bufsize >= 2 && buffer[1] <= USB_COMMAND_ARQ_ON;
+
+    if (success)
+        success = radio_arq_set_enabled(radio, buffer[1] == USB_COMMAND_ARQ_ON);
+
+    radio_arq_stats_t stats;
+    radio_arq_get_stats(radio, &stats);
+
+    response[1] = success || (bufsize >= 2 && buffer[1] == USB_COMMAND_ARQ_QUERY) ? USB_COMMAND_SUCCESS
+                                                                                 : USB_COMMAND_FAILED;
+    memcpy(&response[2], &stats, sizeof(stats));
+    return success;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBD        | Set forward error correction              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Parity bytes        | 0x00        | Send packets without parity               |
+// |         |                     | 2-64        | Even, corrects half as many byte errors   |
+// |         |                     |             | in every packet                           |
+// |         |                     | 0xFF        | Leave unchanged, read counters only       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response (counters are 32-bit little endian):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xBD        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | Parity in use       | 0-64        | Parity bytes added to every packet        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3       | Parity requested    | 0-64        | Last set, capped for short packets        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 4       | Parity limit        | -           | Most the packet length leaves room for    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 5       | Last errors         | -           | Byte errors corrected in the last packet  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 6-9     | Packets coded       | -           | Sent with parity                          |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 10-13   | Packets decoded     | -           | Received with parity                      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 14-17   | Packets corrected   | -           | Received with errors, all corrected       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 18-21   | Bytes corrected     | -           |                                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 22-25   | Uncorrectable       | -           | Received packets dropped                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 26-63   | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Requires framed mode, reliable or not. Parity is refused in raw mode and
+// turned off when the module leaves framed mode. The peer decodes on its own,
+// the parity only needs setting on the sending end. Fragments get shorter by
+// the parity and one byte for its count.
+bool usb_command_set_fec(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize) {
+    bool success = bufsize >= 2 && buffer[1] != USB_COMMAND_FEC_QUERY;
+
+    if (success)
+        success = radio_fec_set_parity(radio, buffer[1]);
+
+    radio_fec_stats_t stats;
+    radio_fec_get_stats(radio, &stats);
+
+    response[1] = success || (bufsize >= 2 && buffer[1] == USB_COMMAND_FEC_QUERY) ? USB_COMMAND_SUCCESS
+                                                                                 : USB_COMMAND_FAILED;
+    memcpy(&response[2], &stats, sizeof(stats));
+    return success;
+}
+
+// Command structure:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB3        | Set CDC latency timer                     |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | Latency in ms       | 0x00        | Flush every received byte at once         |
+// |         |                     | 0x01-0xFF   | Flush partial packets after this delay    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2-61    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62      | Module              | 0x00-0x01   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 63      | Sequence number     | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Command response:
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0       | -                   | 0xB3        | Command echo                              |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 1       | -                   | 0x00        | Command completed successfully            |
+// |         |                     | 0x01        | Command not completed successfully        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 2       | Latency in ms       | -           | Active latency timer                      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 3-6     | HID drops           | -           | Commands dropped with the report queue    |
+// |         |                     |             | full, 32-bit little endian                |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 7-63    | Don't care          | Any Value   | -                                         |
+// +---------+---------------------+-------------+-------------------------------------------+
+bool usb_command_set_latency(uint8_t *latency_ms, usb_command_stats_t const *stats, uint8_t *response,
+                             uint8_t const *buffer, uint32_t bufsize) {
+    memcpy(&response[3], &stats->hid_commands_dropped, sizeof(stats->hid_commands_dropped));
+
+    // No enough bytes in the request
+    if (bufsize < 2) {
+        response[1] = USB_COMMAND_FAILED;
+        response[2] = *latency_ms;
+        return false;
+    }
+
+    *latency_ms = buffer[1];
+
+    response[1] = USB_COMMAND_SUCCESS;
+    response[2] = *latency_ms;
+    return true;
+}
+
+/// GET_REPORT layout, naturally aligned so it needs no packing
+typedef struct {
+    uint32_t cdc_rx_bytes;
+    uint32_t cdc_tx_bytes;
+    uint32_t uart_tx_bytes;
+    uint32_t uart_rx_bytes;
+    uint32_t aux_low_ms;
+    uint32_t switch_ms;
+    uint16_t uart_overruns;
+    uint16_t uart_errors;
+    uint16_t uart_overflows;
+    uint16_t switches;
+    uint16_t switch_max_ms;
+    uint16_t cdc_rx_high_water;
+    uint16_t cdc_tx_high_water;
+    uint16_t tx_queue_high_water;
+    uint16_t rx_queue_high_water;
+    uint16_t core0_loop[LOOP_TIMER_BINS];
+    uint16_t core1_loop[LOOP_TIMER_BINS];
+    uint8_t boot[RADIO_CORE_MODULES];
+} usb_command_report_t;
+
+// GET_REPORT response (little endian, 16-bit counters wrap):
+// +---------+---------------------+-------------+-------------------------------------------+
+// | Index   | Description         | Value       | Effect                                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 0-3     | CDC bytes in        | -           | Read from the host                        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 4-7     | CDC bytes out       | -           | Written to the host                       |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 8-11    | UART bytes out      | -           | Handed to the module, commands excluded   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 12-15   | UART bytes in       | -           | Received from the module                  |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 16-19   | AUX low             | -           | Total ms with the module busy             |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 20-23   | Switch time         | -           | Total ms spent in mode switches           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 24-25   | UART overruns       | -           | Hardware FIFO overruns                    |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 26-27   | UART errors         | -           | Framing, parity or break errors           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 28-29   | UART overflows      | -           | Bytes dropped, RX ring full               |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 30-31   | Switches            | -           | Mode switches, two per configuration      |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 32-33   | Longest switch      | -           | ms                                        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 34-35   | CDC RX high water   | -           | Bytes waiting in the CDC FIFOs            |
+// | 36-37   | CDC TX high water   |             |                                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 38-39   | TX queue high water | -           | Bytes waiting between the cores, host to  |
+// | 40-41   | RX queue high water |             | radio and radio to host                   |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 42-51   | Core0 loop times    | -           | Iterations under 16 us, 64 us, 256 us,    |
+// |         |                     |             | 1 ms and longer                           |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 52-61   | Core1 loop times    | -           | Same bins as core0                        |
+// +---------+---------------------+-------------+-------------------------------------------+
+// | 62-63   | Start-up check      | 0x00        | Nothing cached, reading the module        |
+// |         |                     | 0x01        | Nothing cached, read from the module      |
+// |         |                     | 0x02        | Cached parameters in use, being read back |
+// |         |                     | 0x03        | The module holds the cached ones          |
+// |         |                     | 0x04        | It held others, now in use and cached     |
+// |         |                     | 0x05        | It did not answer the read back           |
+// |         |                     | 0x06        | Nothing cached and no answer, no module   |
+// +---------+---------------------+-------------+-------------------------------------------+
+//
+// Answered on core0 without waiting for the radio, the core1 counters are at
+// most RADIO_CORE_STATS_INTERVAL_US old. Counters add up over the modules and
+// the CDC interfaces, high water marks and the longest switch take the largest.
+// The start-up check has a byte per module. Returns the length of the report.
+uint16_t usb_command_get_report(usb_command_stats_t const *stats, uint8_t *buffer, uint16_t reqlen) {
+    radio_core_stats_t core;
+    radio_core_get_stats(&core);
+
+    usb_command_report_t report = {
+            .cdc_rx_bytes = stats->cdc_rx_bytes,
+            .cdc_tx_bytes = stats->cdc_tx_bytes,
+            .cdc_rx_high_water = stats->cdc_rx_high_water,
+            .cdc_tx_high_water = stats->cdc_tx_high_water,
+            .tx_queue_high_water = stats->tx_queue_high_water,
+    };
+
+    uint64_t aux_low_us = 0;
+    uint64_t switch_us = 0;
+    for (uint32_t i = 0; i < RADIO_CORE_MODULES; ++i) {
+        radio_core_module_stats_t const *module = &core.modules[i];
+        uint16_t switch_max_ms = (uint16_t) (module->radio.switch_max_us / 1000);
+
+        report.uart_tx_bytes += module->uart_tx_bytes;
+        report.uart_rx_bytes += module->uart_rx_bytes;
+        report.uart_overruns += (uint16_t) module->uart_overruns;
+        report.uart_errors += (uint16_t) module->uart_errors;
+        report.uart_overflows += (uint16_t) module->uart_overflows;
+        report.switches += (uint16_t) module->radio.switches;
+        report.boot[i] = module->boot;
+        aux_low_us += module->aux_low_us;
+        switch_us += module->radio.switch_us;
+
+        if (switch_max_ms > report.switch_max_ms)
+            report.switch_max_ms = switch_max_ms;
+
+        if (module->rx_queue_high_water > report.rx_queue_high_water)
+            report.rx_queue_high_water = (uint16_t) module->rx_queue_high_water;
+    }
+
+    report.aux_low_ms = (uint32_t) (aux_low_us / 1000);
+    report.switch_ms = (uint32_t) (switch_us / 1000);
+
+    memcpy(report.core0_loop, stats->loop.histogram, sizeof(report.core0_loop));
+    memcpy(report.core1_loop, core.loop_histogram, sizeof(report.core1_loop));
+
+    uint16_t len = reqlen < sizeof(report) ? reqlen : sizeof(report);
+    memcpy(buffer, &report, len);
+    return len;
+}
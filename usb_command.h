@@ -1,16 +1,130 @@
 #ifndef _LORA_BRIDGE_USB_COMMAND_H_
 #define _LORA_BRIDGE_USB_COMMAND_H_
 
+#include "loop_timer.h"
 #include "radio.h"
 
-#define USB_COMMAND_READ_PARAMS   0xB0
-#define USB_COMMAND_WRITE_PARAMS  0xB1
+#define USB_COMMAND_READ_PARAMS      0xB0
+#define USB_COMMAND_WRITE_PARAMS     0xB1
+#define USB_COMMAND_READ_UART_STATS  0xB2
+#define USB_COMMAND_SET_LATENCY      0xB3
+#define USB_COMMAND_READ_AIRTIME     0xB4
+#define USB_COMMAND_SET_FRAMING      0xB5
+#define USB_COMMAND_SET_COMPRESSION  0xB6
+#define USB_COMMAND_READ_DESTINATION 0xB7
+#define USB_COMMAND_READ_RSSI        0xB8
+#define USB_COMMAND_SET_ADAPT        0xB9
+#define USB_COMMAND_BATCH            0xBA
+#define USB_COMMAND_SET_POWER        0xBB
+#define USB_COMMAND_SET_ARQ          0xBC
+#define USB_COMMAND_SET_FEC          0xBD
 
 #define USB_COMMAND_SUCCESS  0x00
 #define USB_COMMAND_FAILED   0x01
+#define USB_COMMAND_BUSY     0x02
+#define USB_COMMAND_QUEUED   0x03
 
+// Commands are acknowledged at once with USB_COMMAND_QUEUED, or BUSY when too
+// many are in flight, and run in order on the radio core. Each one then
+// completes with a report of its own. Both reports echo the command byte and
+// the sequence number the host put in the last byte of the request.
+#define USB_COMMAND_SEQUENCE_INDEX  63
+
+// HID reports wait in a queue with room for the acknowledgements and
+// completions of RADIO_CORE_COMMAND_SLOTS commands. A host keeping more than
+// that outstanding over HID can fill it, a command arriving then is dropped
+// without running or being acknowledged and the host has to resend it after
+// its timeout. The drops are counted in the USB_COMMAND_SET_LATENCY response.
+
+// The byte before it selects the module, 0 on uart0 and 1 on uart1. Both
+// reports echo it as well, commands for a missing module fail.
+#define USB_COMMAND_MODULE_INDEX    62
+
+#define USB_COMMAND_READ_CACHED   0x00
+#define USB_COMMAND_READ_REFRESH  0x01
+
+#define USB_COMMAND_FRAMING_RAW     0x00
+#define USB_COMMAND_FRAMING_FRAMED  0x01
+#define USB_COMMAND_FRAMING_ADDRESSED 0x02
+#define USB_COMMAND_FRAMING_QUERY   0xFF
+
+#define USB_COMMAND_COMPRESSION_OFF    0x00
+#define USB_COMMAND_COMPRESSION_ON     0x01
+#define USB_COMMAND_COMPRESSION_QUERY  0xFF
+
+#define USB_COMMAND_RSSI_KEEP   0x00
+#define USB_COMMAND_RSSI_RESET  0x01
+
+#define USB_COMMAND_ADAPT_OFF    0x00
+#define USB_COMMAND_ADAPT_ON     0x01
+#define USB_COMMAND_ADAPT_QUERY  0xFF
+
+#define USB_COMMAND_BATCH_READ   0x00
+#define USB_COMMAND_BATCH_WRITE  0x01
+#define USB_COMMAND_BATCH_SAVE   0x02
+#define USB_COMMAND_BATCH_MAX    8
+
+#define USB_COMMAND_POWER_OFF    0x00
+#define USB_COMMAND_POWER_ON     0x01
+#define USB_COMMAND_POWER_QUERY  0xFF
+
+#define USB_COMMAND_ARQ_OFF      0x00
+#define USB_COMMAND_ARQ_ON       0x01
+#define USB_COMMAND_ARQ_QUERY    0xFF
+
+#define USB_COMMAND_FEC_OFF      0x00
+#define USB_COMMAND_FEC_QUERY    0xFF
+
+// Idle time before a partial CDC packet is flushed, 0 flushes immediately
+#define USB_COMMAND_DEFAULT_LATENCY_MS  4
+
+/// Counters kept by core0, reported with the core1 ones by usb_command_get_report()
+typedef struct {
+    uint32_t cdc_rx_bytes;          ///< Read from the host
+    uint32_t cdc_tx_bytes;          ///< Written to the host
+    uint16_t cdc_rx_high_water;     ///< CDC FIFO occupancy
+    uint16_t cdc_tx_high_water;
+    uint16_t tx_queue_high_water;   ///< Host to radio queue
+    uint32_t hid_commands_dropped;  ///< HID report queue full, see USB_COMMAND_SEQUENCE_INDEX
+    loop_timer_t loop;
+} usb_command_stats_t;
+
+// Implemented by the application, receives the response of a command completing
+// asynchronously
+void usb_command_complete_cb(uint8_t const *response);
+
+// Return true once the radio operation is started, its response is sent on completion
 bool usb_command_read_params(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
 
 bool usb_command_write_params(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
 
+bool usb_command_read_uart_stats(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_read_airtime(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_framing(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_compression(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer,
+                                 uint32_t bufsize);
+
+bool usb_command_read_destination(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer,
+                                  uint32_t bufsize);
+
+bool usb_command_read_rssi(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_adapt(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_batch(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_power(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_arq(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_fec(radio_inst_t const *radio, uint8_t *response, uint8_t const *buffer, uint32_t bufsize);
+
+bool usb_command_set_latency(uint8_t *latency_ms, usb_command_stats_t const *stats, uint8_t *response,
+                             uint8_t const *buffer, uint32_t bufsize);
+
+uint16_t usb_command_get_report(usb_command_stats_t const *stats, uint8_t *buffer, uint16_t reqlen);
+
 #endif //_LORA_BRIDGE_USB_COMMAND_H_
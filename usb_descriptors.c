@@ -1,24 +1,32 @@
+#include <pico/unique_id.h>
 #include <tusb.h>
 
-#define USBD_VID 0x2E8A /* Raspberry Pi */
-#define USBD_PID 0x000A /* Raspberry Pi Pico SDK CDC */
+#include "usb_descriptors.h"
 
 #define USBD_MAX_POWER_MA 250
 
 #define USBD_CDC_0_EP_CMD 0x81
 #define USBD_CDC_0_EP_OUT 0x02
 #define USBD_CDC_0_EP_IN 0x82
+#define USBD_CDC_1_EP_CMD 0x84
+#define USBD_CDC_1_EP_OUT 0x05
+#define USBD_CDC_1_EP_IN 0x85
 #define USBD_CDC_EP_CMD_SIZE 8
 
 #define USBD_HID_0_EP_OUT 0x03
 #define USBD_HID_0_EP_IN 0x83
 
+#define USBD_VENDOR_EP_OUT 0x06
+#define USBD_VENDOR_EP_IN 0x86
+
 #define USBD_STR_0 0x00
 #define USBD_STR_MANUF 0x01
 #define USBD_STR_PRODUCT 0x02
 #define USBD_STR_SERIAL 0x03
 #define USBD_STR_CDC 0x04
 #define USBD_STR_HID 0x00
+#define USBD_STR_CDC_1 0x05
+#define USBD_STR_VENDOR 0x06
 
 //--------------------------------------------------------------------+
 // Device Descriptors
@@ -67,14 +75,10 @@ uint8_t const *tud_hid_descriptor_report_cb(uint8_t itf) {
 // Configuration Descriptor
 //--------------------------------------------------------------------+
 
-#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_HID_INOUT_DESC_LEN)
+#define USBD_DESC_LEN (TUD_CONFIG_DESC_LEN + 2 * TUD_CDC_DESC_LEN + TUD_HID_INOUT_DESC_LEN + \
+                       CFG_TUD_VENDOR * TUD_VENDOR_DESC_LEN)
 
-enum {
-    USBD_ITF_CDC_0 = 0,
-    USBD_IFT_CDC_0_DATA __attribute__((unused)),
-    USBD_ITF_NUM_HID,
-    USBD_ITF_MAX
-};
+#define USBD_ITF_MAX (USBD_ITF_VENDOR + CFG_TUD_VENDOR)
 
 static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
         TUD_CONFIG_DESCRIPTOR(1, USBD_ITF_MAX, USBD_STR_0, USBD_DESC_LEN,
@@ -87,6 +91,15 @@ static const uint8_t usbd_desc_cfg[USBD_DESC_LEN] = {
         TUD_HID_INOUT_DESCRIPTOR(USBD_ITF_NUM_HID, USBD_STR_HID, HID_ITF_PROTOCOL_NONE,
                                  sizeof(desc_hid_report), USBD_HID_0_EP_OUT, USBD_HID_0_EP_IN,
                                  CFG_TUD_HID_EP_BUFSIZE, 10),
+
+        TUD_CDC_DESCRIPTOR(USBD_ITF_CDC_1, USBD_STR_CDC_1, USBD_CDC_1_EP_CMD,
+                           USBD_CDC_EP_CMD_SIZE, USBD_CDC_1_EP_OUT, USBD_CDC_1_EP_IN,
+                           CFG_TUD_CDC_EP_BUFSIZE),
+
+#if CFG_TUD_VENDOR
+        TUD_VENDOR_DESCRIPTOR(USBD_ITF_VENDOR, USBD_STR_VENDOR, USBD_VENDOR_EP_OUT, USBD_VENDOR_EP_IN,
+                              CFG_TUD_VENDOR_EPSIZE),
+#endif
 };
 
 // Invoked when received GET CONFIGURATION DESCRIPTOR request
@@ -102,11 +115,16 @@ const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
 
 #define DESC_STR_MAX 20
 
+// Unique ID of the flash chip in hex, tells the bridges on one host apart
+static char usbd_serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+
 static const char *const usbd_desc_str[] = {
         [USBD_STR_MANUF] = "Raspberry Pi",
         [USBD_STR_PRODUCT] = "Pico",
-        [USBD_STR_SERIAL] = "000000000000",
+        [USBD_STR_SERIAL] = usbd_serial,
         [USBD_STR_CDC] = "Board CDC",
+        [USBD_STR_CDC_1] = "Board CDC 1",
+        [USBD_STR_VENDOR] = "Board Bulk",
 };
 
 // Invoked when received GET STRING DESCRIPTOR request
@@ -125,6 +143,10 @@ const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
         if (index >= sizeof(usbd_desc_str) / sizeof(usbd_desc_str[0]))
             return NULL;
 
+        // Read from flash before main(), no flash access here
+        if (index == USBD_STR_SERIAL && !usbd_serial[0])
+            pico_get_unique_board_id_string(usbd_serial, sizeof(usbd_serial));
+
         str = usbd_desc_str[index];
         for (len = 0; len < DESC_STR_MAX - 1 && str[len]; ++len)
             desc_str[1 + len] = str[len];
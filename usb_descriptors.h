@@ -0,0 +1,19 @@
+#ifndef _LORA_BRIDGE_USB_DESCRIPTORS_H_
+#define _LORA_BRIDGE_USB_DESCRIPTORS_H_
+
+// Identity and interface numbers of the bridge, shared with the host tools
+
+#define USBD_VID 0x2E8A /* Raspberry Pi */
+#define USBD_PID 0x000A /* Raspberry Pi Pico SDK CDC */
+
+// Interfaces added later come last, the earlier ones keep their numbers
+enum {
+    USBD_ITF_CDC_0 = 0,
+    USBD_IFT_CDC_0_DATA,
+    USBD_ITF_NUM_HID,
+    USBD_ITF_CDC_1,
+    USBD_IFT_CDC_1_DATA,
+    USBD_ITF_VENDOR,        ///< Only with LORA_BRIDGE_VENDOR
+};
+
+#endif //_LORA_BRIDGE_USB_DESCRIPTORS_H_
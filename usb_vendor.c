@@ -0,0 +1,174 @@
+#include <memory.h>
+#include <tusb.h>
+
+#include "radio_core.h"
+#include "usb_command.h"
+#include "usb_vendor.h"
+
+#ifndef MIN
+#define MIN(a, b) ((a > b) ? b : a)
+#endif
+
+#define USB_VENDOR_RESPONSE_SIZE  (USB_VENDOR_HEADER_SIZE + CFG_TUD_HID_EP_BUFSIZE)
+
+/// Message from the host being parsed, may arrive over several calls
+typedef struct {
+    uint8_t header[USB_VENDOR_HEADER_SIZE];
+    uint32_t header_len;
+    uint32_t remaining;             ///< Payload bytes still to read
+    uint8_t command[CFG_TUD_HID_EP_BUFSIZE];
+    uint32_t command_len;
+} usb_vendor_rx_t;
+
+static usb_vendor_rx_t rx;
+static bool claimed[RADIO_CORE_MODULES];
+
+static void write_header(uint8_t type, uint8_t module, uint32_t len) {
+    uint8_t header[USB_VENDOR_HEADER_SIZE] = {type, module, len & 0xFF, len >> 8};
+    tud_vendor_write(header, sizeof(header));
+}
+
+bool usb_vendor_claimed(uint8_t module) {
+    return module < RADIO_CORE_MODULES && claimed[module];
+}
+
+void usb_vendor_release(uint8_t module) {
+    if (module < RADIO_CORE_MODULES)
+        claimed[module] = false;
+}
+
+bool usb_vendor_can_respond(void) {
+    return tud_vendor_write_available() >= USB_VENDOR_RESPONSE_SIZE;
+}
+
+void usb_vendor_respond(uint8_t const *report) {
+    write_header(USB_VENDOR_RESPONSE, report[USB_COMMAND_MODULE_INDEX], CFG_TUD_HID_EP_BUFSIZE);
+    tud_vendor_write(report, CFG_TUD_HID_EP_BUFSIZE);
+    tud_vendor_write_flush();
+}
+
+// Straight from the endpoint FIFO into the queue to core1. Once the queue is
+// full the data stays in the FIFO and the host is held off, as with CDC.
+static uint32_t read_data(uint8_t module) {
+    ring_buffer_t *queue = radio_core_tx_queue(module);
+    uint8_t *dst;
+    uint32_t space = ring_buffer_peek_free(queue, &dst);
+    uint32_t count = tud_vendor_read(dst, MIN(space, rx.remaining));
+
+    ring_buffer_produce(queue, count);
+    return count;
+}
+
+static uint32_t read_command(void) {
+    uint32_t len = MIN(sizeof(rx.command) - rx.command_len, rx.remaining);
+    uint32_t count = tud_vendor_read(&rx.command[rx.command_len], len);
+
+    rx.command_len += count;
+    return count;
+}
+
+// Unknown types, missing modules, oversized commands and release payloads
+static uint32_t discard(void) {
+    uint8_t scratch[CFG_TUD_VENDOR_EPSIZE];
+    return tud_vendor_read(scratch, MIN(sizeof(scratch), rx.remaining));
+}
+
+static void receive(void) {
+    while (true) {
+        if (rx.header_len < USB_VENDOR_HEADER_SIZE) {
+            rx.header_len += tud_vendor_read(&rx.header[rx.header_len], USB_VENDOR_HEADER_SIZE - rx.header_len);
+            if (rx.header_len < USB_VENDOR_HEADER_SIZE)
+                return;
+
+            rx.remaining = rx.header[2] | rx.header[3] << 8;
+            rx.command_len = 0;
+            memset(rx.command, 0, sizeof(rx.command));
+
+            if ((rx.header[0] == USB_VENDOR_DATA || rx.header[0] == USB_VENDOR_COMMAND) &&
+                rx.header[1] < RADIO_CORE_MODULES)
+                claimed[rx.header[1]] = true;
+        }
+
+        uint8_t type = rx.header[0];
+        uint8_t module = rx.header[1];
+
+        // Message complete, a command waits for room for its acknowledgement
+        if (rx.remaining == 0) {
+            if (type == USB_VENDOR_COMMAND) {
+                if (!usb_vendor_can_respond())
+                    return;
+
+                uint8_t response[CFG_TUD_HID_EP_BUFSIZE];
+                rx.command[USB_COMMAND_MODULE_INDEX] = module;
+                usb_vendor_command_cb(rx.command, response);
+                usb_vendor_respond(response);
+            } else if (type == USB_VENDOR_RELEASE) {
+                usb_vendor_release(module);
+            }
+
+            rx.header_len = 0;
+            continue;
+        }
+
+        uint32_t count;
+        if (type == USB_VENDOR_DATA && radio_core_present(module))
+            count = read_data(module);
+        else if (type == USB_VENDOR_COMMAND && rx.command_len < sizeof(rx.command))
+            count = read_command();
+        else
+            count = discard();
+
+        // Nothing more from the host, or no room for it yet
+        if (count == 0)
+            return;
+
+        rx.remaining -= count;
+    }
+}
+
+// Room for a response is kept free, a busy link does not hold up commands
+static void transmit(void) {
+    bool written = false;
+
+    for (uint32_t module = 0; module < RADIO_CORE_MODULES; ++module) {
+        if (!claimed[module] || !radio_core_present(module))
+            continue;
+
+        ring_buffer_t *queue = radio_core_rx_queue(module);
+        uint32_t space = tud_vendor_write_available();
+        uint32_t len = ring_buffer_count(queue);
+
+        if (len == 0 || space <= USB_VENDOR_RESPONSE_SIZE + USB_VENDOR_HEADER_SIZE)
+            continue;
+
+        len = MIN(len, MIN(space - USB_VENDOR_RESPONSE_SIZE - USB_VENDOR_HEADER_SIZE, USB_VENDOR_MAX_DATA));
+        write_header(USB_VENDOR_DATA, module, len);
+
+        // From the ring into the IN FIFO, in at most two spans
+        while (len > 0) {
+            uint8_t const *data;
+            uint32_t span = MIN(ring_buffer_peek(queue, &data), len);
+
+            tud_vendor_write(data, span);
+            ring_buffer_consume(queue, span);
+            len -= span;
+        }
+
+        written = true;
+    }
+
+    if (written)
+        tud_vendor_write_flush();
+}
+
+void usb_vendor_task(void) {
+    // A new host starts over, with the modules back on their CDC interfaces
+    if (!tud_vendor_mounted()) {
+        memset(&rx, 0, sizeof(rx));
+        memset(claimed, 0, sizeof(claimed));
+        return;
+    }
+
+    receive();
+    transmit();
+}
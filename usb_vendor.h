@@ -0,0 +1,51 @@
+#ifndef _LORA_BRIDGE_USB_VENDOR_H_
+#define _LORA_BRIDGE_USB_VENDOR_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Vendor bulk interface: one stream of messages each way, for hosts talking to
+// the bridge through libusb instead of the tty layer. Every message starts with
+// a type byte, the module it is about and a 16-bit little endian payload length.
+//
+// DATA carries the same bytes the CDC interface of the module would, framed
+// mode length prefixes included, and may be cut anywhere. COMMAND carries a
+// HID command report and is answered with RESPONSE messages holding the HID
+// reports, acknowledgement first. The module byte of the header replaces
+// USB_COMMAND_MODULE_INDEX of the command.
+//
+// The first DATA or COMMAND message about a module claims it for this
+// interface. The data received by a claimed module then only goes out here and
+// its CDC interface is no longer serviced, so every byte has one reader and
+// framed mode datagrams stay whole. RELEASE gives the module back to its CDC
+// interface, so does a tty opening that interface with DTR set, for when the
+// bulk host went away without releasing. Unmounting releases every module.
+
+#define USB_VENDOR_DATA         0x00    ///< Both ways
+#define USB_VENDOR_COMMAND      0x01    ///< Host to bridge
+#define USB_VENDOR_RESPONSE     0x02    ///< Bridge to host
+#define USB_VENDOR_RELEASE      0x03    ///< Host to bridge, no payload
+
+#define USB_VENDOR_HEADER_SIZE  4
+#define USB_VENDOR_MAX_DATA     1024    ///< Longest DATA payload sent by the bridge
+
+/// Moves data between the bulk endpoints and the queues of core1, and runs
+/// the commands found in the stream. Call from the USB loop on core0.
+void usb_vendor_task(void);
+
+/// True once the host claimed the module, its CDC interface is then left alone
+bool usb_vendor_claimed(uint8_t module);
+
+/// Hands the module back to its CDC interface
+void usb_vendor_release(uint8_t module);
+
+/// True when a RESPONSE message fits the IN FIFO
+bool usb_vendor_can_respond(void);
+
+void usb_vendor_respond(uint8_t const *report);
+
+// Implemented by the application, runs a command from the stream on core0 and
+// fills the report acknowledging it
+void usb_vendor_command_cb(uint8_t const *request, uint8_t *response);
+
+#endif //_LORA_BRIDGE_USB_VENDOR_H_